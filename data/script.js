@@ -80,7 +80,8 @@ function handleWebSocketMessage(event) {
         if (line) {
             var data = JSON.parse(line.trim());
             var temperature = parseFloat(data.temp); // Ensure 'temp' correctly maps to your JSON data key
-            var timestamp = new Date(data.time); // Convert ISO 8601 'time' string to Date object
+            // 'time' is ISO 8601 or epoch ms; before the device clock is synced only 'uptimeMs' is sent
+            var timestamp = data.time !== undefined ? new Date(data.time) : new Date();
 
             temperatureData.push({ x: timestamp, y: temperature });
             updateTemperatureChart();
@@ -102,18 +103,10 @@ function updateTemperatureChart() {
     }
 }
 
-// Function to download temperature data as CSV
+// Download the logged temperature history as CSV, converted by the device while streaming
 function downloadCSV() {
-    var csv = 'Time,Temperature\n';
-    temperatureData.forEach(function(row) {
-        var localTime = new Date(row.x.getTime() - row.x.getTimezoneOffset() * 60000);
-        csv += `${localTime.toISOString()},${row.y}\n`;
-    });
-    var csvBlob = new Blob([csv], { type: 'text/csv;charset=utf-8;' });
-    var csvUrl = URL.createObjectURL(csvBlob);
     var hiddenElement = document.createElement('a');
-    hiddenElement.href = csvUrl;
-    hiddenElement.target = '_blank';
+    hiddenElement.href = '/downloadcsv';
     hiddenElement.download = 'temperatureData.csv';
     hiddenElement.click();
 }
@@ -0,0 +1,112 @@
+/**
+ * @file csv_export.h
+ * @brief Log to CSV conversion for chunked HTTP responses.
+ *
+ * The exporter reads the log through a LogQuery and writes "time,<channel>"
+ * rows straight into the buffer handed over by the web server, so its RAM
+ * use does not depend on the size of the log. Each call does a bounded
+ * amount of card reading, which keeps the web server task from starving
+ * the sampling loop during a long download.
+ *
+ * HistoryExport does the same for charting: it reads the coarsest rollup
+ * tier that satisfies the requested resolution and writes
+ * "time,min,max,mean,count,last" rows, falling back to the raw log for
+ * resolutions below one minute.
+ */
+
+#ifndef CSV_EXPORT_H
+#define CSV_EXPORT_H
+
+#include <Arduino.h>
+#include "log_query.h"
+#include "timestamp.h"
+#include "rollup_store.h"
+
+#ifndef CSV_SCAN_BUDGET
+#define CSV_SCAN_BUDGET 256 /**< Log records examined per fill() call. */
+#endif
+
+#define CSV_LINE_MAX 48 /**< Longest CSV row including the newline. */
+#define HISTORY_LINE_MAX 112 /**< Longest history row including the newline. */
+#define CSV_TRY_AGAIN ((size_t)-1) /**< fill() result asking the web server to call again later. */
+
+/**
+ * @brief Streaming CSV view of one log channel.
+ */
+class CsvExport {
+public:
+    /**
+     * @brief Prepare an export of channel over [fromMs, toMs].
+     */
+    CsvExport(int64_t fromMs, int64_t toMs, uint8_t channel);
+
+    /**
+     * @brief Write the next part of the CSV.
+     * @param buffer Destination.
+     * @param maxLen Space in buffer.
+     * @return Bytes written, 0 at the end, or CSV_TRY_AGAIN if the scan budget
+     *         ran out before a row was found.
+     */
+    size_t fill(uint8_t* buffer, size_t maxLen);
+
+private:
+    /**
+     * @brief Format a record as a CSV row into line.
+     */
+    void formatRow(const LogEntry& entry);
+
+    LogQuery query; /**< Source of records. */
+    TimestampService formatter; /**< Own instance, the shared one belongs to the loop task. */
+    uint8_t channel; /**< Exported channel. */
+    char line[CSV_LINE_MAX]; /**< Row being written. */
+    size_t lineLength = 0; /**< Characters in line. */
+    size_t lineSent = 0; /**< Characters of line already written. */
+    bool finished = false; /**< Set once the query is exhausted. */
+};
+
+/**
+ * @brief Streaming CSV of one channel at a chosen resolution.
+ */
+class HistoryExport {
+public:
+    /**
+     * @brief Prepare an export of channel over [fromMs, toMs].
+     * @param resolutionMs Coarsest spacing the caller accepts; picks the rollup tier.
+     */
+    HistoryExport(int64_t fromMs, int64_t toMs, uint8_t channel, int64_t resolutionMs);
+
+    /**
+     * @brief Write the next part of the CSV, with the same contract as CsvExport::fill().
+     */
+    size_t fill(uint8_t* buffer, size_t maxLen);
+
+    /**
+     * @brief Tier name of the source, "raw" below one minute.
+     */
+    const char* source() const { return tier < 0 ? "raw" : rollupTierName[tier]; }
+
+private:
+    /**
+     * @brief Read the next row from the source into line.
+     * @return false once the source is exhausted.
+     */
+    bool nextRow();
+
+    /**
+     * @brief Format the time column and return its length.
+     */
+    size_t formatTime(int64_t timeMs);
+
+    int tier; /**< Rollup tier, -1 for the raw log. */
+    uint8_t channel; /**< Exported channel. */
+    LogQuery rawQuery; /**< Source below one minute resolution. */
+    RollupQuery rollupQuery; /**< Source from a rollup tier. */
+    TimestampService formatter; /**< Own instance, the shared one belongs to the loop task. */
+    char line[HISTORY_LINE_MAX]; /**< Row being written. */
+    size_t lineLength = 0; /**< Characters in line. */
+    size_t lineSent = 0; /**< Characters of line already written. */
+    uint32_t scanned = 0; /**< Records examined in the current fill() call. */
+    bool finished = false; /**< Set once the source is exhausted. */
+};
+
+#endif // CSV_EXPORT_H
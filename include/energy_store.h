@@ -0,0 +1,77 @@
+/**
+ * @file energy_store.h
+ * @brief Energy accumulators that survive deep sleep and soft resets.
+ *
+ * The live totals sit in RTC slow memory that is not initialised at boot,
+ * protected by a CRC so garbage after power-on is detected. They are copied
+ * to NVS only every ENERGY_CHECKPOINT_WH or ENERGY_CHECKPOINT_MIN, which
+ * bounds flash wear. Restoring at boot is one CRC check plus, after a
+ * power loss, a single NVS read.
+ */
+
+#ifndef ENERGY_STORE_H
+#define ENERGY_STORE_H
+
+#include <Arduino.h>
+#include <Arduino_JSON.h>
+
+#ifndef ENERGY_CHECKPOINT_WH
+#define ENERGY_CHECKPOINT_WH 10.0 /**< Checkpoint after this much energy on any channel. */
+#endif
+#ifndef ENERGY_CHECKPOINT_MIN
+#define ENERGY_CHECKPOINT_MIN 60 /**< Checkpoint at least this often while energy changes. */
+#endif
+
+/**
+ * @brief Energy channels kept by the store.
+ */
+enum EnergyChannel : uint8_t {
+    ENERGY_PULSE, /**< S0/LED pulse input. */
+    ENERGY_CHANNEL_COUNT
+};
+
+/**
+ * @brief RTC backed accumulators with wear-aware NVS checkpoints.
+ */
+class EnergyStore {
+public:
+    /**
+     * @brief Restore the accumulators from RTC memory or, if invalid, from NVS.
+     */
+    void begin();
+
+    /**
+     * @brief Accumulated energy of a channel in Wh.
+     */
+    double get(EnergyChannel channel) const;
+
+    /**
+     * @brief Set the accumulated energy of a channel.
+     */
+    void set(EnergyChannel channel, double wh);
+
+    /**
+     * @brief Write a checkpoint to NVS if the policy asks for one.
+     */
+    void maintain();
+
+    /**
+     * @brief Write a checkpoint to NVS now, e.g. before a planned restart.
+     */
+    void checkpoint();
+
+    /**
+     * @brief Restore source and checkpoint counters for the JSON status output.
+     */
+    JSONVar statusJson() const;
+
+private:
+    const char* restoredFrom = "none"; /**< "rtc", "nvs" or "none". */
+    uint32_t checkpoints = 0; /**< NVS writes since boot. */
+    unsigned long lastCheckpointMillis = 0; /**< millis() of the last NVS write. */
+    double checkpointWh[ENERGY_CHANNEL_COUNT] = {}; /**< Values written by the last checkpoint. */
+};
+
+extern EnergyStore energyStore; /**< Shared instance used by the application. */
+
+#endif // ENERGY_STORE_H
@@ -0,0 +1,34 @@
+/**
+ * @file fft.h
+ * @brief In-place radix-2 real FFT for 256 and 512 point windows.
+ *
+ * The N real inputs are transformed as N/2 complex points followed by a
+ * split step, using the twiddle table in fft_twiddles.h. No allocation and
+ * no Arduino dependencies, so the same code runs on the host.
+ */
+
+#ifndef FFT_H
+#define FFT_H
+
+#include <stddef.h>
+
+/**
+ * @brief Transform a real signal in place.
+ *
+ * On return data[0] holds X[0], data[1] holds X[N/2] (both real), and
+ * data[2k], data[2k+1] hold the real and imaginary part of X[k] for
+ * 0 < k < N/2.
+ * @param data N real samples.
+ * @param n Transform size, a power of two between 4 and FFT_TABLE_SIZE.
+ * @return false if n is not supported.
+ */
+bool realFft(float* data, size_t n);
+
+/**
+ * @brief Multiply a signal by a Hann window.
+ * @param data Samples to window in place.
+ * @param n Number of samples, a power of two up to FFT_TABLE_SIZE.
+ */
+void applyHannWindow(float* data, size_t n);
+
+#endif // FFT_H
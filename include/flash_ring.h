@@ -0,0 +1,129 @@
+/**
+ * @file flash_ring.h
+ * @brief Circular log in a raw internal flash partition.
+ *
+ * Without an SD card the log writer stores its journal blocks (see
+ * record_log.h) here instead. The "flashlog" data partition declared in
+ * partitions.csv is used as a ring of 512-byte blocks, each at a
+ * block-aligned offset and written exactly once between erases. A 4 KB
+ * sector is erased when the head enters it, so every sector is erased once
+ * per pass over the ring and wear is spread evenly; once the ring is full
+ * the oldest sector is given up. There is no index: at boot the first
+ * block of every sector is read to find the newest sector, and the head is
+ * the first erased block after it.
+ *
+ * Blocks in the ring carry journal id 0; erased sectors cannot hold stale
+ * blocks the way preallocated card space can.
+ *
+ * When a card appears the writer copies the blocks to SD and records the
+ * last copied sequence number in NVS, so the copied blocks are skipped from
+ * then on without erasing the whole partition.
+ */
+
+#ifndef FLASH_RING_H
+#define FLASH_RING_H
+
+#include <Arduino.h>
+#include <Arduino_JSON.h>
+#include <esp_partition.h>
+#include "record_log.h"
+
+#ifndef FLASH_RING_LABEL
+#define FLASH_RING_LABEL "flashlog" /**< Partition label in partitions.csv. */
+#endif
+#define FLASH_RING_SUBTYPE 0x40 /**< Data subtype of the partition, first custom one. */
+#define FLASH_RING_SECTOR_SIZE 4096 /**< Erase unit of the flash. */
+#define FLASH_RING_BLOCKS_PER_SECTOR (FLASH_RING_SECTOR_SIZE / RECORD_BLOCK_SIZE) /**< Journal blocks per sector. */
+
+/**
+ * @brief Ring of journal blocks in a raw flash partition.
+ */
+class FlashRing {
+public:
+    /**
+     * @brief Find the partition and locate the oldest unmigrated block and the head.
+     * @return false if there is no flash log partition.
+     */
+    bool begin();
+
+    /**
+     * @brief Whether begin() found the partition.
+     */
+    bool ready() const { return partition != nullptr; }
+
+    /**
+     * @brief Sequence number the next appended block should carry.
+     */
+    uint32_t nextSequence() const { return headSequence; }
+
+    /**
+     * @brief Store one sealed journal block at the head, erasing its sector first if needed.
+     * @return false if the flash write failed.
+     */
+    bool append(const uint8_t* block);
+
+    /**
+     * @brief Blocks not yet migrated.
+     */
+    uint32_t pending() const { return stored; }
+
+    /**
+     * @brief Take the oldest pending block, skipping blocks that fail their check.
+     * @param block Buffer of RECORD_BLOCK_SIZE bytes.
+     * @param count Set to the number of records in the block.
+     * @return false once no block is pending.
+     */
+    bool readOldest(uint8_t* block, uint8_t& count);
+
+    /**
+     * @brief Persist that every block taken by readOldest() is on the card.
+     */
+    void markMigrated();
+
+    /**
+     * @brief Drop all pending blocks.
+     */
+    void clear();
+
+    /**
+     * @brief Configuration and counters for the JSON status output.
+     */
+    JSONVar statusJson() const;
+
+private:
+    /**
+     * @brief Read the block at ring position index.
+     */
+    bool readBlock(uint32_t index, uint8_t* block);
+
+    /**
+     * @brief Read only the trailer of block index into scratch.
+     * @return false if the trailer is still erased.
+     */
+    bool readTrailer(uint32_t index);
+
+    /**
+     * @brief Find head and tail from the block trailers.
+     */
+    void locate();
+
+    const esp_partition_t* partition = nullptr; /**< The flash log partition. */
+    uint32_t totalBlocks = 0; /**< Capacity in blocks. */
+    uint32_t head = 0; /**< Position of the next block to write. */
+    uint32_t tail = 0; /**< Position of the oldest pending block. */
+    uint32_t stored = 0; /**< Block positions from tail to head. */
+    uint32_t headSequence = 0; /**< Sequence for the block at head. */
+    uint32_t migratedSequence = 0; /**< Newest block known to be on the card; sequences start at 1. */
+    uint32_t takenSequence = 0; /**< Newest block handed out by readOldest(). */
+    uint8_t scratch[RECORD_BLOCK_SIZE]; /**< Block read while locating. */
+    uint32_t appended = 0; /**< Blocks written. */
+    uint32_t erases = 0; /**< Sectors erased. */
+    uint32_t overwritten = 0; /**< Pending blocks lost because the ring was full. */
+    uint32_t migrated = 0; /**< Blocks copied to the card. */
+    uint32_t writeErrors = 0; /**< Failed erases or writes. */
+    uint32_t locateMicros = 0; /**< Duration of the boot scan. */
+};
+
+extern FlashRing flashRing; /**< Shared instance used by the log writer. */
+
+#endif // FLASH_RING_H
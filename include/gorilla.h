@@ -0,0 +1,144 @@
+/**
+ * @file gorilla.h
+ * @brief Gorilla-style block codec for archived log segments.
+ *
+ * One block holds samples of a single channel. Timestamps are stored as
+ * delta-of-delta and values as the XOR with the previous value, both
+ * bit-packed as in Facebook's Gorilla time series store, with 32-bit
+ * floats instead of doubles. Blocks are GORILLA_BLOCK_SIZE bytes, one SD
+ * sector, start with a plain header and end with a CRC-16, so every block
+ * decodes on its own. The module has no Arduino dependencies and is shared
+ * by the firmware and the host tools.
+ *
+ * Block layout, little-endian: magic(2) crc(2) count(2) channel(1)
+ * firstFlags(1) firstTimeMs(8) firstValue(4), then the bit stream.
+ *
+ * An archive file is one header block followed by the data blocks,
+ * grouped by channel and in time order within a channel.
+ */
+
+#ifndef GORILLA_H
+#define GORILLA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "record_log.h"
+
+#define GORILLA_BLOCK_SIZE 512 /**< Bytes per block. */
+#define GORILLA_BLOCK_MAGIC 0x4B42 /**< "BK" read as little-endian. */
+#define GORILLA_HEADER_SIZE 20 /**< Bytes before the bit stream. */
+#define ARCHIVE_MAGIC 0x43524145 /**< "EARC" read as little-endian. */
+#define ARCHIVE_VERSION 1 /**< Current archive format version. */
+
+/**
+ * @brief Contents of the first block of an archive file.
+ */
+struct ArchiveHeader {
+    uint32_t blocks; /**< Data blocks after the header block. */
+    uint32_t samples; /**< Samples over all blocks. */
+    int64_t firstMs; /**< Earliest sample time. */
+    int64_t lastMs; /**< Latest sample time. */
+    uint32_t checksum; /**< archiveChecksum() over all samples, for verification. */
+};
+
+/**
+ * @brief Serialize an archive header into a GORILLA_BLOCK_SIZE block.
+ */
+void encodeArchiveHeader(const ArchiveHeader& header, uint8_t* block);
+
+/**
+ * @brief Parse and validate an archive header block.
+ * @return false if the magic, version or checksum do not match.
+ */
+bool decodeArchiveHeader(const uint8_t* block, ArchiveHeader& header);
+
+/**
+ * @brief Order independent checksum of a sample, summed over an archive.
+ */
+uint32_t archiveChecksum(const LogEntry& entry);
+
+/**
+ * @brief Packs samples of one channel into a block.
+ */
+class GorillaEncoder {
+public:
+    /**
+     * @brief Start a new block.
+     * @param block Output of GORILLA_BLOCK_SIZE bytes.
+     * @param channel Channel of all samples in the block.
+     */
+    void begin(uint8_t* block, uint8_t channel);
+
+    /**
+     * @brief Add a sample.
+     * @return false if the block is full or the time gap does not fit; the sample is not added.
+     */
+    bool add(int64_t timeMs, float value, uint8_t flags);
+
+    /**
+     * @brief Write the header and checksum; the block is ready to store.
+     */
+    void finish();
+
+    uint16_t count() const { return samples; } /**< Samples in the block. */
+    size_t bitsUsed() const { return bitPosition; } /**< Bits of the stream used so far. */
+
+private:
+    void putBits(uint32_t bits, uint8_t count); /**< Append bits MSB first. */
+
+    uint8_t* block = nullptr; /**< Block being filled. */
+    size_t bitPosition = 0; /**< Next bit within the stream. */
+    uint16_t samples = 0; /**< Samples added. */
+    int64_t lastTime = 0; /**< Time of the previous sample. */
+    int64_t lastDelta = 0; /**< Previous time delta. */
+    uint32_t lastValue = 0; /**< Bits of the previous value. */
+    uint8_t lastFlags = 0; /**< Flags of the previous sample. */
+    uint8_t lastLeading = 0xFF; /**< Leading zeros of the previous XOR window, 0xFF if none yet. */
+    uint8_t lastTrailing = 0; /**< Trailing zeros of the previous XOR window. */
+};
+
+/**
+ * @brief Reads the samples back from a block.
+ */
+class GorillaDecoder {
+public:
+    /**
+     * @brief Validate a block and prepare to read it.
+     * @return false if the magic or checksum do not match.
+     */
+    bool open(const uint8_t* block);
+
+    /**
+     * @brief Decode the next sample.
+     * @return false once all samples were read.
+     */
+    bool next(LogEntry& entry);
+
+    uint16_t count() const { return samples; } /**< Samples in the block. */
+    uint8_t channel() const { return blockChannel; } /**< Channel of the block. */
+    int64_t firstTime() const { return firstTimeMs; } /**< Time of the first sample. */
+
+private:
+    uint32_t getBits(uint8_t count); /**< Read bits MSB first. */
+
+    const uint8_t* block = nullptr; /**< Block being read. */
+    size_t bitPosition = 0; /**< Next bit within the stream. */
+    uint16_t samples = 0; /**< Samples in the block. */
+    uint16_t decoded = 0; /**< Samples returned so far. */
+    uint8_t blockChannel = 0; /**< Channel of the block. */
+    int64_t firstTimeMs = 0; /**< Time of the first sample. */
+    int64_t lastTime = 0; /**< Time of the previous sample. */
+    int64_t lastDelta = 0; /**< Previous time delta. */
+    uint32_t lastValue = 0; /**< Bits of the previous value. */
+    uint8_t lastFlags = 0; /**< Flags of the previous sample. */
+    uint8_t lastLeading = 0; /**< Leading zeros of the current XOR window. */
+    uint8_t lastTrailing = 0; /**< Trailing zeros of the current XOR window. */
+};
+
+/**
+ * @brief Read the channel and first time of a block without decoding it.
+ * @return false if the magic does not match.
+ */
+bool gorillaBlockInfo(const uint8_t* block, uint8_t& channel, int64_t& firstTimeMs, uint16_t& count);
+
+#endif // GORILLA_H
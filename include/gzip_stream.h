@@ -0,0 +1,115 @@
+/**
+ * @file gzip_stream.h
+ * @brief Small-window streaming gzip compressor.
+ *
+ * Deflate with a DEFLATE_WINDOW_SIZE history, hash-chain LZ77 matching and
+ * the fixed Huffman codes, wrapped in a gzip header and CRC-32 trailer. The
+ * whole state lives in the object (about 24 KB with the default window),
+ * so the RAM use of a compressed download does not depend on its size.
+ * Fixed codes give up some ratio compared to zlib but need no second pass
+ * over the data. The module has no Arduino dependencies.
+ */
+
+#ifndef GZIP_STREAM_H
+#define GZIP_STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef DEFLATE_WINDOW_BITS
+#define DEFLATE_WINDOW_BITS 12 /**< log2 of the LZ77 history, 9 to 14. */
+#endif
+#if DEFLATE_WINDOW_BITS < 9 || DEFLATE_WINDOW_BITS > 14
+// Window positions are 16-bit and 0xFFFF marks an empty hash chain, so the doubled window must stay below 64 KB
+#error "DEFLATE_WINDOW_BITS must be 9 to 14"
+#endif
+#ifndef DEFLATE_HASH_BITS
+#define DEFLATE_HASH_BITS 12 /**< log2 of the match hash table size. */
+#endif
+#ifndef DEFLATE_MAX_CHAIN
+#define DEFLATE_MAX_CHAIN 32 /**< Candidates examined per match search. */
+#endif
+
+#define DEFLATE_WINDOW_SIZE (1 << DEFLATE_WINDOW_BITS) /**< LZ77 history in bytes. */
+#define GZIP_OUTPUT_SIZE 512 /**< Compressed bytes buffered before read(). */
+
+/**
+ * @brief Streaming gzip encoder fed with plain data and drained with read().
+ */
+class GzipStream {
+public:
+    GzipStream();
+
+    /**
+     * @brief Make room for input and report how much feed() accepts now.
+     */
+    size_t inputSpace();
+
+    /**
+     * @brief Add plain data; at most inputSpace() bytes.
+     */
+    void feed(const uint8_t* data, size_t length);
+
+    /**
+     * @brief Mark the end of the input; the stream is finished by the following reads.
+     */
+    void finish() { inputDone = true; }
+
+    /**
+     * @brief Compress what the input allows and copy out compressed bytes.
+     * @return Bytes written; 0 if more input is needed or the stream is complete.
+     */
+    size_t read(uint8_t* out, size_t maxLength);
+
+    /**
+     * @brief Whether the trailer has been read.
+     */
+    bool complete() const { return trailerWritten && outputHead == outputTail; }
+
+    uint32_t bytesIn() const { return inputSize; } /**< Plain bytes fed so far. */
+    uint32_t bytesOut() const { return outputTotal; } /**< Compressed bytes read so far. */
+
+private:
+    /**
+     * @brief Encode symbols while there is lookahead and output space.
+     */
+    void compress();
+
+    /**
+     * @brief Longest earlier match for the data at pos.
+     * @param distance Set to the match distance.
+     * @return Match length, 0 if shorter than 3.
+     */
+    uint16_t findMatch(uint16_t& distance);
+
+    /**
+     * @brief Enter position p into the hash chains.
+     */
+    void insert(uint16_t p);
+
+    void putBits(uint32_t bits, uint8_t count); /**< Append LSB-first bits to the output. */
+    void putByte(uint8_t value); /**< Append one byte to the output buffer. */
+    void putLiteral(uint8_t value); /**< Encode a literal with the fixed code. */
+    void putMatch(uint16_t length, uint16_t distance); /**< Encode a length/distance pair. */
+    void putSymbol(uint16_t symbol); /**< Encode a literal/length symbol with the fixed code. */
+    void writeTrailer(); /**< End-of-block, byte alignment and the gzip trailer. */
+    size_t outputFree() const; /**< Space left in the output buffer. */
+
+    uint8_t window[2 * DEFLATE_WINDOW_SIZE]; /**< History followed by lookahead. */
+    uint16_t head[1 << DEFLATE_HASH_BITS]; /**< Latest position per hash. */
+    uint16_t prev[DEFLATE_WINDOW_SIZE]; /**< Previous position with the same hash. */
+    uint16_t pos = 0; /**< Next byte to encode. */
+    uint16_t end = 0; /**< End of the data in window. */
+    uint8_t output[GZIP_OUTPUT_SIZE]; /**< Ring of compressed bytes. */
+    size_t outputHead = 0; /**< Next byte to read from output. */
+    size_t outputTail = 0; /**< Next byte to write to output. */
+    uint32_t bitBuffer = 0; /**< Bits not yet forming a byte. */
+    uint8_t bitCount = 0; /**< Valid bits in bitBuffer. */
+    uint32_t crc = 0xFFFFFFFF; /**< Running CRC-32 of the input. */
+    uint32_t inputSize = 0; /**< Input length modulo 2^32. */
+    uint32_t outputTotal = 0; /**< Bytes returned by read(). */
+    bool inputDone = false; /**< finish() was called. */
+    bool trailerWritten = false; /**< The stream end is in the output buffer. */
+};
+
+#endif // GZIP_STREAM_H
@@ -0,0 +1,84 @@
+/**
+ * @file harmonics.h
+ * @brief THD and harmonic magnitudes of a mains waveform.
+ *
+ * Samples are decimated into a fixed window covering about ten mains cycles
+ * so that FFT bins are a few Hz wide. Full windows are handed over to the
+ * analysis side, which runs the real FFT and sums the Hann main lobe around
+ * each harmonic. Arduino-free; builds on the host.
+ */
+
+#ifndef HARMONICS_H
+#define HARMONICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include "fft_twiddles.h"
+
+#ifndef HARMONIC_COUNT
+#define HARMONIC_COUNT 15 /**< Harmonics reported, including the fundamental. */
+#endif
+
+/**
+ * @brief Result of one analysed window.
+ */
+struct HarmonicResult {
+    float fundamentalHz = 0; /**< Estimated fundamental frequency. */
+    float fundamentalRms = 0; /**< RMS of the fundamental in input units. */
+    float thd = 0; /**< Total harmonic distortion as a ratio to the fundamental. */
+    float magnitudes[HARMONIC_COUNT] = {}; /**< RMS of harmonic h+1 relative to the fundamental. */
+};
+
+/**
+ * @brief Windowed harmonic analysis of one channel.
+ */
+class HarmonicAnalyzer {
+public:
+    /**
+     * @brief Create an analyzer.
+     * @param fftSize Window length, 256 or 512.
+     * @param decimation Input samples averaged into one window sample.
+     * @param sampleRateHz Input sample rate before decimation.
+     * @param scale Input units per ADC count, applied to fundamentalRms.
+     */
+    HarmonicAnalyzer(size_t fftSize, uint32_t decimation, float sampleRateHz, float scale);
+
+    /**
+     * @brief Add one raw sample; called from the capture side only.
+     */
+    void add(uint16_t sample);
+
+    /**
+     * @brief Whether a full window is waiting for analyze().
+     */
+    bool ready() const { return readyBuffer.load(std::memory_order_acquire) >= 0; }
+
+    /**
+     * @brief Analyse the waiting window; called from the analysis side only.
+     * @param result Receives the harmonics.
+     * @return false if no window was ready.
+     */
+    bool analyze(HarmonicResult& result);
+
+    /**
+     * @brief Duration of one window in microseconds, the real-time budget per analysis.
+     */
+    uint32_t windowMicros() const;
+
+    size_t size() const { return n; } /**< Window length. */
+
+private:
+    size_t n; /**< Window length. */
+    uint32_t decimation; /**< Raw samples per window sample. */
+    float windowRateHz; /**< Sample rate after decimation. */
+    float scale; /**< Units per ADC count. */
+    float buffers[2][FFT_TABLE_SIZE]; /**< Filling and waiting windows. */
+    int filling = 0; /**< Buffer written by add(). */
+    size_t fillCount = 0; /**< Samples in the filling buffer. */
+    uint32_t decimateCount = 0; /**< Raw samples in the running average. */
+    uint32_t decimateSum = 0; /**< Sum of the running average. */
+    std::atomic<int> readyBuffer{-1}; /**< Buffer waiting for analysis, -1 if none. */
+};
+
+#endif // HARMONICS_H
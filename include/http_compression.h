@@ -0,0 +1,78 @@
+/**
+ * @file http_compression.h
+ * @brief gzip content encoding for streamed downloads.
+ *
+ * Wraps a chunked response filler in a GzipStream when the client sends
+ * "Accept-Encoding: gzip". The compression ratio and the CPU time spent
+ * compressing are counted for the status output.
+ *
+ * Each compressed stream needs about 25 KB of heap for its lifetime, so at
+ * most HTTP_GZIP_MAX_STREAMS run at a time, and only while enough heap is
+ * left; other downloads are sent uncompressed.
+ */
+
+#ifndef HTTP_COMPRESSION_H
+#define HTTP_COMPRESSION_H
+
+#include <Arduino.h>
+#include <Arduino_JSON.h>
+#include <ESPAsyncWebServer.h>
+
+#ifndef HTTP_GZIP_ENABLED
+#define HTTP_GZIP_ENABLED 1 /**< Set to 0 to always send downloads uncompressed. */
+#endif
+#ifndef HTTP_GZIP_MAX_STREAMS
+#define HTTP_GZIP_MAX_STREAMS 2 /**< Compressed responses running at the same time. */
+#endif
+#ifndef HTTP_GZIP_HEAP_RESERVE
+#define HTTP_GZIP_HEAP_RESERVE 32768 /**< Free heap that must remain after a compressor is allocated. */
+#endif
+
+/**
+ * @brief Negotiates and applies gzip to chunked responses.
+ */
+class HttpCompression {
+public:
+    /**
+     * @brief Whether the client accepts a gzip body.
+     */
+    bool accepts(AsyncWebServerRequest* request) const;
+
+    /**
+     * @brief Start a chunked response, gzip encoded if the client accepts it.
+     * @param request Request being answered.
+     * @param contentType Type of the uncompressed body.
+     * @param source Filler producing the uncompressed body.
+     */
+    AsyncWebServerResponse* beginResponse(AsyncWebServerRequest* request, const char* contentType, AwsResponseFiller source);
+
+    /**
+     * @brief Compression counters for the JSON status output.
+     */
+    JSONVar statusJson() const;
+
+private:
+    /**
+     * @brief Filler that compresses the output of source.
+     * @return An empty filler if the compressor could not be allocated.
+     */
+    AwsResponseFiller gzipFiller(AwsResponseFiller source);
+
+    /**
+     * @brief Note that a compressed response was freed; called by its state.
+     */
+    void streamEnded() { activeStreams--; }
+
+    friend struct GzipFillerState;
+
+    uint32_t streams = 0; /**< Compressed responses started. */
+    uint8_t activeStreams = 0; /**< Compressed responses not yet freed; only touched by the async_tcp task. */
+    uint32_t fallbacks = 0; /**< Responses sent uncompressed for lack of a stream slot or heap. */
+    uint64_t bytesIn = 0; /**< Uncompressed bytes over all streams. */
+    uint64_t bytesOut = 0; /**< Compressed bytes over all streams. */
+    uint64_t compressMicros = 0; /**< Time spent in the compressor. */
+};
+
+extern HttpCompression httpCompression; /**< Shared instance used by the application. */
+
+#endif // HTTP_COMPRESSION_H
@@ -0,0 +1,153 @@
+/**
+ * @file log_query.h
+ * @brief Time range queries over the segmented SD log.
+ *
+ * A query asks the segment index for the segments overlapping the range,
+ * opens them one after another and binary searches the first so reading
+ * starts at the first matching record. The cost depends on the size of the
+ * range, not on how much history is on the card.
+ *
+ * Archived segments are read block by block; blocks outside the range, or
+ * of another channel when a channel hint is given, are skipped after
+ * reading only their header. Records of an archived segment come grouped
+ * by channel.
+ *
+ * Compacted segments yield one record per channel and minute: the bucket
+ * mean, stamped with the bucket start and flagged RECORD_FLAG_DOWNSAMPLED.
+ * Their buckets are not in strict time order and are all read.
+ *
+ * Every record, bucket and archive block looked at counts against the scan
+ * budget passed to next(), whether it is returned or skipped, so a caller
+ * on the async_tcp task is never held up by a long run outside the range.
+ */
+
+#ifndef LOG_QUERY_H
+#define LOG_QUERY_H
+
+#include <Arduino.h>
+#include <SD.h>
+#include "record_log.h"
+#include "gorilla.h"
+#include "rollup.h"
+#include "segment_index.h"
+
+#define LOG_QUERY_ALL_CHANNELS -1 /**< Channel hint that keeps every archive block. */
+#define LOG_QUERY_COMPACT_BUCKETS (GORILLA_BLOCK_SIZE / ROLLUP_RECORD_SIZE) /**< Compacted buckets read at a time. */
+#define LOG_QUERY_UNLIMITED UINT32_MAX /**< Scan budget that is never used up. */
+
+/**
+ * @brief Cursor over the records in [fromMs, toMs].
+ */
+class LogQuery {
+public:
+    /**
+     * @brief Prepare a query; no file is opened until next().
+     * @param channelHint Channel the caller is interested in, or LOG_QUERY_ALL_CHANNELS.
+     *        Archive blocks of other channels are skipped; records of raw
+     *        segments are returned for every channel, so callers still filter.
+     */
+    LogQuery(int64_t fromMs, int64_t toMs, int16_t channelHint = LOG_QUERY_ALL_CHANNELS);
+
+    /**
+     * @brief Close the open segment and let the log writer drop or replace it again.
+     */
+    ~LogQuery();
+
+    /**
+     * @brief Read the next record in the range.
+     *
+     * Records that fail their checksum are skipped.
+     * @return false once the range is exhausted.
+     */
+    bool next(LogEntry& entry);
+
+    /**
+     * @brief Read the next record in the range, examining at most budget entries.
+     * @param budget Records, buckets and archive blocks that may still be
+     *        examined; decreased by the number examined.
+     * @return false once the range is exhausted or the budget is used up;
+     *         finished() tells the two apart.
+     */
+    bool next(LogEntry& entry, uint32_t& budget);
+
+    /**
+     * @brief Whether the range is exhausted.
+     */
+    bool finished() const { return done; }
+
+    /**
+     * @brief Only visit the segments of days [firstDay, lastDay]; call before next().
+     */
+    void limitDays(uint32_t firstDay, uint32_t lastDay);
+
+    uint32_t segmentsOpened() const { return opened; } /**< Segments visited so far. */
+    uint32_t corruptRecords() const { return corrupt; } /**< Unused or unreadable record slots, bad archive blocks and buckets skipped. */
+
+private:
+    /**
+     * @brief Open the next overlapping segment and seek to the start of the range.
+     * @return false if there are no more segments.
+     */
+    bool openNextSegment();
+
+    /**
+     * @brief Close the open segment and release the hold on it.
+     */
+    void closeSegment();
+
+    /**
+     * @brief Take one unit of the scan budget.
+     * @return false if the budget is used up.
+     */
+    bool spend();
+
+    /**
+     * @brief next() without the budget bookkeeping of the public overloads.
+     */
+    bool scan(LogEntry& entry);
+
+    /**
+     * @brief Load the next archive block that may hold matching records.
+     * @return false if the archive has no more such blocks.
+     */
+    bool loadNextBlock();
+
+    /**
+     * @brief Next record of a raw segment, before range filtering.
+     */
+    bool nextRaw(LogEntry& entry);
+
+    /**
+     * @brief Next record of an archived segment, before range filtering.
+     */
+    bool nextArchived(LogEntry& entry);
+
+    /**
+     * @brief Next bucket mean of a compacted segment, before range filtering.
+     */
+    bool nextCompact(LogEntry& entry);
+
+    int64_t fromMs; /**< Start of the range, inclusive. */
+    int64_t toMs; /**< End of the range, inclusive. */
+    int16_t channelHint; /**< Channel whose archive blocks are read. */
+    uint32_t nextDay = 0; /**< Lowest day the next segment may have. */
+    uint32_t lastDay = UINT32_MAX; /**< Highest day a segment may have. */
+    File file; /**< Open segment. */
+    bool holding = false; /**< Whether heldDay is held with LogWriter::acquireSegment(). */
+    uint32_t heldDay = 0; /**< Day of the held segment. */
+    uint8_t format = SEGMENT_RAW; /**< Format of the open segment. */
+    RecordLogReader reader; /**< Reader over a raw segment, reads a block at a time. */
+    uint64_t position = 0; /**< Next record index in a raw segment, or bucket index in a compacted one. */
+    uint32_t bucketCount = 0; /**< Buckets in a compacted segment. */
+    uint8_t block[GORILLA_BLOCK_SIZE]; /**< Current archive block, or buckets of a compacted segment. */
+    GorillaDecoder decoder; /**< Decoder over block. */
+    bool decoding = false; /**< Whether decoder has samples left. */
+    uint32_t blockIndex = 0; /**< Next archive block to look at. */
+    uint32_t blockCount = 0; /**< Data blocks in the archive. */
+    bool done = false; /**< Set once no segment is left. */
+    uint32_t budget = LOG_QUERY_UNLIMITED; /**< Scan budget left in the current next() call. */
+    uint32_t opened = 0; /**< Segments visited. */
+    uint32_t corrupt = 0; /**< Record slots and archive blocks skipped. */
+};
+
+#endif // LOG_QUERY_H
@@ -0,0 +1,443 @@
+/**
+ * @file log_writer.h
+ * @brief SD card log written by a background task.
+ *
+ * The log is a binary record log (see record_log.h) split into one segment
+ * file per UTC day (see segment_index.h). Segments are journals: records
+ * are committed in 512-byte blocks, each carrying its sequence number and
+ * a CRC-32, so a block torn by a power loss never yields records. The
+ * writer moves to a new segment when a record of a later day arrives, and
+ * the segment index is rebuilt from the card at start-up.
+ * Card latency spikes must not delay sampling, so append() only copies the
+ * record into a bounded queue. A writer task keeps the log file open,
+ * collects queued records in RAM and writes them out as whole blocks. A
+ * partly filled block is written once the oldest unwritten record reaches
+ * LOG_FLUSH_AGE_MS, or on an explicit sync(). On the card it keeps its
+ * offset and sequence number and is rewritten with the added records
+ * until it is full, so flushing costs no space; a power loss during such a
+ * rewrite can cost that one block. The flash ring does not rewrite
+ * sectors, so there the next record starts a new block. When the queue is
+ * full, the overflow policy either drops the oldest record or blocks the
+ * producer.
+ *
+ * Segments are preallocated in LOG_PREALLOC_BYTES extents and written in
+ * place: the writer keeps the logical end, the offset of the next block,
+ * and writes whole blocks there, so every card write covers complete
+ * sectors at sector-aligned offsets and the FAT is only touched when a new
+ * extent is allocated. A failed write leaves the logical end where it was
+ * and the blocks in RAM, and the next write-out retries the same offset.
+ * Each journal has a random id mixed into its block checksums, so stale
+ * data in the preallocated space never passes as a block. Rotation
+ * truncates the previous segment to its logical end.
+ *
+ * Reopening a segment finds the logical end by a binary search over the
+ * block trailers (see RecordLogReader), so start-up time does not grow with
+ * the log; a torn last block is simply overwritten by the next one. A
+ * segment written in the older flat format is rewritten as a journal once,
+ * when it is reopened for appending.
+ *
+ * Readers hold a segment with acquireSegment() while its file is open;
+ * dropping, replacing or clearing a segment waits until it has no readers,
+ * so a download never loses the file under it.
+ *
+ * Without an SD card the same blocks go to the internal flash ring (see
+ * flash_ring.h). When begin() later finds a card, the writer task copies
+ * the ring's pending blocks into the day segments and replays the rollups
+ * before it writes anything else.
+ */
+
+#ifndef LOG_WRITER_H
+#define LOG_WRITER_H
+
+#include <Arduino.h>
+#include <Arduino_JSON.h>
+#include <SD.h>
+#include "record_log.h"
+#include "segment_index.h"
+
+#define LOG_OVERFLOW_DROP_OLDEST 0 /**< A full queue discards its oldest record. */
+#define LOG_OVERFLOW_BLOCK 1 /**< A full queue blocks the producer up to LOG_BLOCK_TIMEOUT_MS. */
+
+#ifndef LOG_BUFFER_SIZE
+#define LOG_BUFFER_SIZE 4096 /**< RAM buffer in front of the log file. */
+#endif
+#ifndef LOG_FLUSH_AGE_MS
+#define LOG_FLUSH_AGE_MS 30000 /**< Longest time a record stays in RAM. */
+#endif
+#ifndef LOG_QUEUE_DEPTH
+#define LOG_QUEUE_DEPTH 32 /**< Records queued for the writer task. */
+#endif
+#ifndef LOG_RECORD_MAX
+#define LOG_RECORD_MAX 256 /**< Longest record accepted by the queue, a multiple of RECORD_SIZE. */
+#endif
+#ifndef LOG_OVERFLOW_POLICY
+#define LOG_OVERFLOW_POLICY LOG_OVERFLOW_DROP_OLDEST /**< Behaviour when the queue is full. */
+#endif
+#ifndef LOG_BLOCK_TIMEOUT_MS
+#define LOG_BLOCK_TIMEOUT_MS 1000 /**< Longest producer wait with LOG_OVERFLOW_BLOCK. */
+#endif
+
+#ifndef LOG_SYNC_WAIT_MS
+#define LOG_SYNC_WAIT_MS 250 /**< Longest wait of requestSync() callers such as the web server. */
+#endif
+
+#ifndef LOG_READER_WAIT_MS
+#define LOG_READER_WAIT_MS 30000 /**< Longest wait of installArchive() for readers of the replaced segment. */
+#endif
+
+#ifndef LOG_PREALLOC_BYTES
+#define LOG_PREALLOC_BYTES 1048576 /**< Extent by which segment files grow. */
+#endif
+#ifndef LOG_SD_MOUNT
+#define LOG_SD_MOUNT "/sd" /**< VFS mount point of the SD library, for calls outside it. */
+#endif
+
+#define LOG_OPEN_UPDATE "r+" /**< Open mode for writing an existing segment at any offset. */
+#define LOG_SECTOR_SIZE RECORD_BLOCK_SIZE /**< Write granularity of the card, one journal block. */
+#define LOG_SYNC_REQUEST 0xFFFF /**< LogRecord length marking a sync request from requestSync(). */
+#define LOG_MAX_READER_DAYS 16 /**< Segments that can be held open for reading at once, above the socket limit. */
+
+#if LOG_BUFFER_SIZE % LOG_SECTOR_SIZE != 0 || LOG_BUFFER_SIZE < 2 * LOG_SECTOR_SIZE
+#error "LOG_BUFFER_SIZE must be a multiple of LOG_SECTOR_SIZE of at least two blocks"
+#endif
+#if LOG_PREALLOC_BYTES % LOG_SECTOR_SIZE != 0
+#error "LOG_PREALLOC_BYTES must be a multiple of LOG_SECTOR_SIZE"
+#endif
+
+/**
+ * @brief One queued record.
+ */
+struct LogRecord {
+    int64_t timeMs; /**< Sample time, selects the segment. */
+    uint16_t length; /**< Bytes used in data. */
+    char data[LOG_RECORD_MAX]; /**< Record contents. */
+};
+
+/**
+ * @brief RecordLogReader source over an SD File passed as context.
+ */
+size_t readLogFile(void* context, uint64_t offset, uint8_t* buffer, size_t length);
+
+/**
+ * @brief Grow a file open for writing to size bytes by seeking and writing its last byte.
+ * @return false if the card is full or the write failed.
+ */
+bool extendLogFile(File& file, uint64_t size);
+
+/**
+ * @brief Append-only segmented log fed through a queue.
+ */
+class LogWriter {
+public:
+    /**
+     * @brief Index the segments in the log directory and start the writer task.
+     * @param directory Segment directory on the SD card, created if missing.
+     * @return false if the directory could not be created.
+     */
+    bool begin(const char* directory);
+
+    /**
+     * @brief Start the writer task with the internal flash ring as the log, until begin() finds a card.
+     * @return false if there is no flash log partition either.
+     */
+    bool beginFallback();
+
+    /**
+     * @brief Queue a record for the writer task.
+     * @param timeMs Sample time in epoch milliseconds, selects the segment.
+     * @return false if the record was dropped.
+     */
+    bool append(const char* data, size_t length, int64_t timeMs);
+
+    /**
+     * @brief Write out everything queued or buffered and flush the file to the card.
+     */
+    void sync();
+
+    /**
+     * @brief Ask the writer task to do what sync() does, waiting a bounded time.
+     *
+     * For callers that must not stall behind the card, such as web server
+     * handlers: the request is queued behind the pending records, and the
+     * caller goes on after timeoutMs whether or not the writer got to it.
+     * @return false if the request timed out or could not be queued.
+     */
+    bool requestSync(uint32_t timeoutMs = LOG_SYNC_WAIT_MS);
+
+    /**
+     * @brief Discard queued and buffered data and delete all segments.
+     *
+     * Segments being read leave the index at once, but their files stay
+     * until finishClear() finds them released. Leftover .tmp and .bad files
+     * of days nobody holds are deleted too.
+     */
+    void clear();
+
+    /**
+     * @brief Delete the files that clear() or an index eviction left to readers that have finished since.
+     * @return true once no such segment is left.
+     */
+    bool finishClear();
+
+    /**
+     * @brief First segment at or after minDay that overlaps [fromMs, toMs].
+     * @return false if there is none.
+     */
+    bool findSegment(uint32_t minDay, int64_t fromMs, int64_t toMs, SegmentInfo& segment);
+
+    /**
+     * @brief Keep a segment from being dropped or replaced while its file is read.
+     * @param segment Segment as found by findSegment().
+     * @return false if the segment was dropped or replaced since it was found,
+     *         or every reader slot is taken; the segment must not be opened then.
+     */
+    bool acquireSegment(const SegmentInfo& segment);
+
+    /**
+     * @brief End a hold taken with acquireSegment().
+     */
+    void releaseSegment(uint32_t day);
+
+    /**
+     * @brief Path of the segment file for a day.
+     */
+    String segmentPath(uint32_t day, uint8_t format = SEGMENT_RAW) const;
+
+    /**
+     * @brief Oldest raw segment that is no longer written to.
+     * @return false if every raw segment may still receive records, or the
+     *         flash ring is still being migrated to the card.
+     */
+    bool findArchiveCandidate(SegmentInfo& segment);
+
+    /**
+     * @brief Oldest segment of the given format, before beforeDay, that is no longer written to.
+     * @return false if there is none, or the flash ring is still being migrated to the card.
+     */
+    bool findCompactCandidate(uint32_t beforeDay, uint8_t format, SegmentInfo& segment);
+
+    /**
+     * @brief Replace a segment by its verified archive or compacted version.
+     *
+     * Waits up to LOG_READER_WAIT_MS for readers of the segment to finish.
+     * @param segment Day, time range and format of the replacement.
+     * @param archivePath Finished replacement under a temporary name.
+     * @param sourceFormat Format of the segment being replaced.
+     * @return false if the replacement could not be moved into place.
+     */
+    bool installArchive(const SegmentInfo& segment, const String& archivePath, uint8_t sourceFormat = SEGMENT_RAW);
+
+    /**
+     * @brief Oldest segment that is not open for writing.
+     * @return false if there is none.
+     */
+    bool findOldestSegment(SegmentInfo& segment);
+
+    /**
+     * @brief Delete the files of a segment that is neither written nor read.
+     * @param freed Set to the size of the deleted files.
+     * @return false if the segment is open for writing or being read.
+     */
+    bool dropSegment(uint32_t day, uint64_t& freed);
+
+    /**
+     * @brief Size of all segment and rollup files; lists the directory without holding the lock.
+     */
+    uint64_t storedBytes();
+
+    /**
+     * @brief Start a new generation of 1-minute rollups when due, see RollupStore::rotateFine().
+     */
+    bool rotateRollups(int64_t nowMs);
+
+    /**
+     * @brief Whether the log is on the SD card rather than in the flash ring.
+     */
+    bool usingCard() const { return onCard; }
+
+    /**
+     * @brief Configuration and counters for the JSON status output.
+     */
+    JSONVar statusJson() const;
+
+private:
+    static void writerTask(void* param);
+
+    /**
+     * @brief Create the queue, the lock and the writer task once.
+     */
+    void startTask();
+
+    /**
+     * @brief After begin(), migrate the flash ring and replay the rollups; the caller holds the lock.
+     */
+    void finishSwitch();
+
+    /**
+     * @brief Copy the pending flash ring blocks into the day segments; the caller holds the lock.
+     */
+    void migrateFlash();
+
+    /**
+     * @brief First day from day on whose segment is raw or missing; the caller holds the lock.
+     *
+     * Archived and compacted days are never reopened, nor days whose cleared
+     * files are still read; their late records go to the next writable day.
+     */
+    uint32_t writableDay(uint32_t day) const;
+
+    /**
+     * @brief Whether clear() left the files of a day to its readers; the caller holds the lock.
+     */
+    bool clearing(uint32_t day) const;
+
+    /**
+     * @brief Delete the segment files of a day in every format; the caller holds the lock.
+     * @return Size of the deleted files.
+     */
+    uint64_t removeSegmentFiles(uint32_t day);
+
+    /**
+     * @brief Add a segment to the index, deleting the day a full index evicts.
+     */
+    void addSegment(const SegmentInfo& segment);
+
+    /**
+     * @brief Extend the open segment's range in the index by a record time.
+     */
+    void extendSegment(int64_t timeMs);
+
+    /**
+     * @brief Delete the files of a day that no longer fits in the index.
+     *
+     * Queries cannot reach the day any more. A day being read is left to
+     * finishClear() like a cleared one; the open segment is kept.
+     */
+    void evictDay(uint32_t day);
+
+    /**
+     * @brief Add every segment in the directory to the index.
+     */
+    void rebuildIndex();
+
+    /**
+     * @brief Close the current segment and open the one for day; the caller holds the lock.
+     */
+    void openSegment(uint32_t day);
+
+    /**
+     * @brief Open the segment of fileDay for appending; the caller holds the lock.
+     *
+     * A new segment gets its header block. An existing one continues at its
+     * logical end, and a flat one is converted first.
+     */
+    void prepareSegment();
+
+    /**
+     * @brief Write out the buffer, close the segment and trim its unused extent; the caller holds the lock.
+     */
+    void closeSegment();
+
+    /**
+     * @brief Make sure the open segment is allocated up to end; the caller holds the lock.
+     */
+    void reserve(uint64_t end);
+
+    /**
+     * @brief Rewrite a flat segment as a journal and open it for writing; the caller holds the lock.
+     * @param flat The segment; closed on return.
+     */
+    void convertSegment(File& flat, const String& segment);
+
+    /**
+     * @brief Write the header block of a new journal to file; the caller holds the lock.
+     */
+    void startJournal();
+
+    /**
+     * @brief Add one record to the RAM buffer, writing full blocks; the caller holds the lock.
+     */
+    void bufferRecord(const LogRecord& record);
+
+    /**
+     * @brief Add one encoded entry to the open block, committing it when full; the caller holds the lock.
+     */
+    void bufferEntry(const uint8_t* raw);
+
+    /**
+     * @brief Write out the buffer and flush the file and the rollups; the caller holds the lock.
+     */
+    void flush();
+
+    /**
+     * @brief Number of readers holding the segment of a day; the caller holds the lock.
+     */
+    uint8_t readers(uint32_t day) const;
+
+    /**
+     * @brief Bytes in the RAM buffer that are not on the card yet.
+     */
+    size_t buffered() const { return sealed + (blockFill - flushedFill) * RECORD_SIZE; }
+
+    /**
+     * @brief Move queued records into the RAM buffer; the caller holds the lock.
+     */
+    void drainQueue();
+
+    /**
+     * @brief Write the committed blocks of the RAM buffer to the file; the caller holds the lock.
+     * @param wholeSectorsOnly Leave the open block out instead of writing it partly filled.
+     * @return false if the card refused the write; the blocks stay buffered for a retry.
+     */
+    bool writeBuffer(bool wholeSectorsOnly);
+
+    String path; /**< Segment directory. */
+    bool onCard = false; /**< Whether blocks go to the SD card rather than the flash ring. */
+    bool switchPending = false; /**< Set by begin() until finishSwitch() ran. */
+    File file; /**< Open segment. */
+    uint32_t fileDay = 0; /**< Day of the open segment. */
+    SegmentIndex index; /**< Time ranges of all segments. */
+    QueueHandle_t queue = nullptr; /**< Records waiting for the writer task. */
+    SemaphoreHandle_t lock = nullptr; /**< Recursive mutex guarding the file, the RAM buffer and the index. */
+    SemaphoreHandle_t syncDone = nullptr; /**< Given by the writer task after each requested sync. */
+    uint32_t syncRequested = 0; /**< Ticket of the latest sync request. */
+    volatile uint32_t syncCompleted = 0; /**< Ticket of the latest sync request carried out. */
+    alignas(4) uint8_t buffer[LOG_BUFFER_SIZE]; /**< Committed blocks followed by the open block; word aligned for the SD driver's DMA. */
+    size_t sealed = 0; /**< Bytes of committed blocks in buffer. */
+    uint8_t blockFill = 0; /**< Records in the open block. */
+    uint8_t flushedFill = 0; /**< Records of the open block already written to the card. */
+    uint32_t nextSequence = 0; /**< Sequence number of the open block. */
+    uint32_t journalId = 0; /**< Id of the open segment, 0 while writing to the flash ring. */
+    uint64_t logicalEnd = 0; /**< Offset of the next block in the open segment. */
+    uint64_t allocatedEnd = 0; /**< Size of the open segment including preallocated space. */
+    unsigned long oldestMillis = 0; /**< millis() when the first buffered byte arrived. */
+    uint32_t records = 0; /**< Records accepted. */
+    uint32_t dropped = 0; /**< Records lost to overflow, oversize or a missing file. */
+    uint32_t rotations = 0; /**< Segments opened by the writer. */
+    uint32_t convertedSegments = 0; /**< Flat segments rewritten as journals. */
+    uint32_t migratedRecords = 0; /**< Records copied from the flash ring to the card. */
+    uint32_t lastRecoveryMicros = 0; /**< Time the last segment open took. */
+    uint32_t maxRecoveryMicros = 0; /**< Slowest segment open, conversions excluded. */
+    uint32_t preallocations = 0; /**< Extents added to segments. */
+    uint32_t lastPreallocMicros = 0; /**< Time the last extent took to allocate. */
+    uint32_t maxPreallocMicros = 0; /**< Slowest extent allocation. */
+    uint32_t trims = 0; /**< Segments truncated to their logical end on rotation. */
+    uint32_t maxQueueDepth = 0; /**< Highest queue depth seen. */
+    uint32_t syncTimeouts = 0; /**< Sync requests that gave up waiting. */
+    uint32_t readerDays[LOG_MAX_READER_DAYS] = {}; /**< Days of the segments being read. */
+    uint8_t readerCounts[LOG_MAX_READER_DAYS] = {}; /**< Readers per entry of readerDays, 0 for a free slot. */
+    bool readerCleared[LOG_MAX_READER_DAYS] = {}; /**< Slots whose day was cleared or evicted while read, kept until finishClear(). */
+    uint32_t evictedSegments = 0; /**< Days deleted because the index was full. */
+    uint32_t readerDeferrals = 0; /**< Drops and replacements put off because the segment was being read. */
+    uint32_t readerOverflows = 0; /**< Holds refused because every reader slot was taken. */
+    uint32_t writes = 0; /**< Buffer write-outs. */
+    uint32_t writeErrors = 0; /**< Short or failed writes. */
+    uint32_t lastWriteMicros = 0; /**< Duration of the last write-out. */
+    uint32_t maxWriteMicros = 0; /**< Slowest write-out. */
+    uint64_t totalWriteMicros = 0; /**< Sum of write-out durations. */
+    uint64_t bytesWritten = 0; /**< Bytes written out to the card or the flash ring. */
+};
+
+extern LogWriter logWriter; /**< Shared instance used by the application. */
+
+#endif // LOG_WRITER_H
@@ -0,0 +1,115 @@
+/**
+ * @file modbus_meters.h
+ * @brief Round-robin polling of Modbus RTU energy meters over RS-485.
+ *
+ * A task on a hardware UART polls every configured meter address in turn.
+ * The points of the register map are batched into as few requests as
+ * possible, and each request follows the previous response after just the
+ * t3.5 inter-frame gap. The latest decoded values are added to every record.
+ */
+
+#ifndef MODBUS_METERS_H
+#define MODBUS_METERS_H
+
+#include <Arduino.h>
+#include <Arduino_JSON.h>
+#include "modbus_rtu.h"
+
+#ifndef MODBUS_ENABLED
+#define MODBUS_ENABLED 0 /**< Set to 1 to poll Modbus meters. */
+#endif
+#ifndef MODBUS_METER_ADDRESSES
+#define MODBUS_METER_ADDRESSES 1 /**< Comma separated slave addresses (e.g. -DMODBUS_METER_ADDRESSES=1,2,3). */
+#endif
+#ifndef MODBUS_RX_PIN
+#define MODBUS_RX_PIN 16 /**< UART RX pin connected to the RS-485 transceiver. */
+#endif
+#ifndef MODBUS_TX_PIN
+#define MODBUS_TX_PIN 17 /**< UART TX pin connected to the RS-485 transceiver. */
+#endif
+#ifndef MODBUS_DE_PIN
+#define MODBUS_DE_PIN 25 /**< Driver enable pin, driven by the UART in RS-485 half-duplex mode. */
+#endif
+#ifndef MODBUS_BAUD
+#define MODBUS_BAUD 9600 /**< Bus baud rate, 8N1. */
+#endif
+#ifndef MODBUS_RESPONSE_TIMEOUT_MS
+#define MODBUS_RESPONSE_TIMEOUT_MS 100 /**< Time allowed for a slave to answer. */
+#endif
+#ifndef MODBUS_MAX_GAP
+#define MODBUS_MAX_GAP 16 /**< Unused registers allowed inside one batched read. */
+#endif
+#ifndef MODBUS_POLL_INTERVAL_MS
+#define MODBUS_POLL_INTERVAL_MS 1000 /**< Pause between polling rounds; 0 polls back to back. */
+#endif
+
+#define MAX_MODBUS_METERS 8 /**< Maximum number of polled addresses. */
+#define MAX_MODBUS_POINTS 8 /**< Maximum number of points in the register map. */
+#define MAX_MODBUS_SPANS 8 /**< Maximum number of requests per meter and round. */
+
+/**
+ * @brief Latest values of one meter.
+ */
+struct ModbusMeter {
+    uint8_t address; /**< Slave address. */
+    float values[MAX_MODBUS_POINTS]; /**< Decoded values in register map order. */
+    bool valid; /**< All spans were read successfully in the last round. */
+    uint32_t timeouts; /**< Requests without a complete answer. */
+    uint32_t crcErrors; /**< Responses with a bad checksum. */
+    uint32_t badFrames; /**< Responses with a wrong address, function or length. */
+    uint32_t exceptions; /**< Exception responses. */
+};
+
+/**
+ * @brief Modbus RTU master polling the configured meters.
+ */
+class ModbusMeters {
+public:
+    /**
+     * @brief Plan the requests, open the UART and start the polling task.
+     */
+    void begin();
+
+    /**
+     * @brief Whether Modbus polling is compiled in.
+     */
+    bool enabled() const { return MODBUS_ENABLED; }
+
+    /**
+     * @brief Add the latest meter values to a sensor record.
+     * @param record Record to extend.
+     */
+    void addToRecord(JSONVar& record) const;
+
+    /**
+     * @brief Bus counters and throughput for the JSON status output.
+     */
+    JSONVar statusJson() const;
+
+private:
+    static void pollTask(void* param);
+
+    /**
+     * @brief Read one span of one meter.
+     * @param meter Meter to query; its error counters are updated.
+     * @param span Register range.
+     * @param registers Output registers.
+     * @return true if the registers are valid.
+     */
+    bool readSpan(ModbusMeter& meter, const ModbusSpan& span, uint16_t* registers);
+
+    ModbusMeter meters[MAX_MODBUS_METERS]; /**< Polled meters. */
+    size_t meterCount = 0; /**< Number of valid entries in meters. */
+    ModbusSpan spans[MAX_MODBUS_SPANS]; /**< Batched requests of the register map. */
+    size_t spanCount = 0; /**< Number of valid entries in spans. */
+    uint32_t frameGapUs = 0; /**< t3.5 at the configured baud rate. */
+    uint32_t lastFrameEndUs = 0; /**< micros() when the bus last went idle. */
+    uint32_t requests = 0; /**< Requests sent. */
+    volatile uint32_t registersRead = 0; /**< Registers received in valid responses; 32 bits so /status reads it in one access. */
+    uint32_t roundMicros = 0; /**< Duration of the last polling round. */
+    uint32_t roundRegisters = 0; /**< Registers read in the last polling round. */
+};
+
+extern ModbusMeters modbusMeters; /**< Shared instance used by the application. */
+
+#endif // MODBUS_METERS_H
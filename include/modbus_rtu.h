@@ -0,0 +1,117 @@
+/**
+ * @file modbus_rtu.h
+ * @brief Modbus RTU framing, register batching and value decoding.
+ *
+ * Everything here works on byte buffers only. The UART side lives in
+ * modbus_meters.cpp, so this part also builds on the host.
+ */
+
+#ifndef MODBUS_RTU_H
+#define MODBUS_RTU_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MODBUS_READ_HOLDING 0x03 /**< Read holding registers. */
+#define MODBUS_READ_INPUT 0x04 /**< Read input registers. */
+#define MODBUS_MAX_READ_REGISTERS 125 /**< Protocol limit for one read request. */
+#define MODBUS_REQUEST_LENGTH 8 /**< Length of a read request frame. */
+#define MODBUS_EXCEPTION_LENGTH 5 /**< Length of an exception response frame. */
+
+/**
+ * @brief Encoding of a value in consecutive registers.
+ */
+enum ModbusType : uint8_t {
+    MODBUS_U16, /**< One unsigned register. */
+    MODBUS_S16, /**< One signed register. */
+    MODBUS_U32, /**< Two registers, high word first. */
+    MODBUS_S32, /**< Two registers, high word first, signed. */
+    MODBUS_FLOAT32 /**< IEEE 754 float, high word first. */
+};
+
+/**
+ * @brief Outcome of parsing a response frame.
+ */
+enum ModbusStatus : uint8_t {
+    MODBUS_OK, /**< Valid response, registers decoded. */
+    MODBUS_TIMEOUT, /**< Fewer bytes than expected arrived. */
+    MODBUS_CRC_ERROR, /**< Frame checksum mismatch. */
+    MODBUS_EXCEPTION, /**< Slave answered with an exception code. */
+    MODBUS_BAD_FRAME /**< Wrong address, function or byte count. */
+};
+
+/**
+ * @brief A named value read from a meter.
+ */
+struct ModbusPoint {
+    const char* name; /**< Field name in the record. */
+    uint16_t reg; /**< First register. */
+    ModbusType type; /**< Register encoding. */
+    float scale; /**< Multiplier applied to the decoded value. */
+};
+
+/**
+ * @brief Contiguous register range fetched with one request.
+ */
+struct ModbusSpan {
+    uint16_t start; /**< First register. */
+    uint16_t count; /**< Number of registers. */
+};
+
+/**
+ * @brief Modbus CRC-16 (polynomial 0xA001, initial 0xFFFF).
+ */
+uint16_t modbusCrc16(const uint8_t* data, size_t length);
+
+/**
+ * @brief Number of registers a value occupies.
+ */
+uint8_t modbusTypeWidth(ModbusType type);
+
+/**
+ * @brief Build a read request frame.
+ * @param frame Output buffer of at least MODBUS_REQUEST_LENGTH bytes.
+ * @return Frame length.
+ */
+size_t modbusBuildReadRequest(uint8_t* frame, uint8_t address, uint8_t function, uint16_t start, uint16_t count);
+
+/**
+ * @brief Length of a successful read response for a register count.
+ */
+inline size_t modbusReadResponseLength(uint16_t count) { return 5 + 2 * count; }
+
+/**
+ * @brief Validate a read response and extract its registers.
+ * @param frame Received bytes.
+ * @param length Number of received bytes.
+ * @param address Expected slave address.
+ * @param function Expected function code.
+ * @param count Expected register count.
+ * @param registers Output, count registers in host order.
+ * @param exceptionCode Receives the exception code for MODBUS_EXCEPTION.
+ */
+ModbusStatus modbusParseReadResponse(const uint8_t* frame, size_t length, uint8_t address, uint8_t function,
+                                     uint16_t count, uint16_t* registers, uint8_t* exceptionCode);
+
+/**
+ * @brief Group points into as few read requests as possible.
+ *
+ * Points must be sorted by register. Neighbouring points are merged into one
+ * span when the unused registers between them do not exceed maxGap and the
+ * span stays within MODBUS_MAX_READ_REGISTERS.
+ * @return Number of spans written.
+ */
+size_t modbusPlanSpans(const ModbusPoint* points, size_t pointCount, uint16_t maxGap, ModbusSpan* spans, size_t maxSpans);
+
+/**
+ * @brief Decode a value and apply its scale.
+ * @param registers Registers starting at the value.
+ */
+float modbusDecode(const uint16_t* registers, const ModbusPoint& point);
+
+/**
+ * @brief Minimum silent interval between frames (t3.5) in microseconds.
+ */
+uint32_t modbusFrameGapMicros(uint32_t baud);
+
+#endif // MODBUS_RTU_H
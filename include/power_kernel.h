@@ -0,0 +1,98 @@
+/**
+ * @file power_kernel.h
+ * @brief Fixed-point RMS and real power kernel for mains waveforms.
+ *
+ * The kernel takes raw 12-bit ADC samples of voltage and current, removes
+ * their DC bias and integrates V², I² and V·I over each mains cycle using
+ * only integer arithmetic. Cycles are delimited by rising zero crossings of
+ * the voltage. It has no Arduino dependencies and builds on the host.
+ */
+
+#ifndef POWER_KERNEL_H
+#define POWER_KERNEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Result of one mains cycle, in ADC units.
+ *
+ * Centered samples carry 4 fractional bits (Q4), so RMS values are Q4 ADC
+ * counts and the mean power is Q8 counts².
+ */
+struct PowerCycle {
+    uint32_t samples; /**< Samples per channel in the cycle. */
+    uint32_t vRmsQ4; /**< Voltage RMS in Q4 ADC counts. */
+    uint32_t iRmsQ4; /**< Current RMS in Q4 ADC counts. */
+    int64_t powerQ8; /**< Mean of V·I in Q8 counts². */
+    int16_t pfQ15; /**< Power factor in Q15, negative when power flows back. */
+};
+
+/**
+ * @brief Weighted sum of cycles, closed once per record.
+ */
+struct PowerWindow {
+    uint32_t cycles = 0; /**< Number of cycles in the window. */
+    uint64_t samples = 0; /**< Samples per channel over all cycles. */
+    uint64_t sumV2 = 0; /**< Sum of V² in Q8 counts². */
+    uint64_t sumI2 = 0; /**< Sum of I² in Q8 counts². */
+    int64_t sumP = 0; /**< Sum of V·I in Q8 counts². */
+
+    /**
+     * @brief Add a completed cycle to the window.
+     */
+    void add(const PowerCycle& cycle);
+};
+
+/**
+ * @brief Integer square root, floor(sqrt(value)).
+ */
+uint32_t isqrt64(uint64_t value);
+
+/**
+ * @brief Streaming per-cycle RMS and power kernel.
+ */
+class PowerKernel {
+public:
+    /**
+     * @brief Create a kernel.
+     * @param minCycleSamples Shortest accepted cycle, rejects noise crossings.
+     * @param maxCycleSamples Longest cycle; without voltage the cycle is closed here.
+     */
+    PowerKernel(uint32_t minCycleSamples, uint32_t maxCycleSamples);
+
+    /**
+     * @brief Forget the DC estimate and any partial cycle.
+     */
+    void reset();
+
+    /**
+     * @brief Process a block of simultaneous voltage and current samples.
+     * @param voltage Raw voltage samples.
+     * @param current Raw current samples.
+     * @param count Number of samples in each array.
+     * @param cycles Output array for completed cycles.
+     * @param maxCycles Capacity of the output array.
+     * @return Number of cycles written to cycles.
+     */
+    size_t process(const uint16_t* voltage, const uint16_t* current, size_t count, PowerCycle* cycles, size_t maxCycles);
+
+private:
+    /**
+     * @brief Finish the running cycle into result.
+     */
+    void closeCycle(PowerCycle& result);
+
+    uint32_t minSamples; /**< Shortest accepted cycle. */
+    uint32_t maxSamples; /**< Longest cycle before it is forced closed. */
+    int32_t vOffsetQ16; /**< DC bias of the voltage channel, Q16 counts. */
+    int32_t iOffsetQ16; /**< DC bias of the current channel, Q16 counts. */
+    bool armed; /**< Voltage went below the negative hysteresis level. */
+    bool synced; /**< A first rising crossing has been seen. */
+    uint32_t samples; /**< Samples in the running cycle. */
+    uint64_t sumV2; /**< Running sum of V². */
+    uint64_t sumI2; /**< Running sum of I². */
+    int64_t sumP; /**< Running sum of V·I. */
+};
+
+#endif // POWER_KERNEL_H
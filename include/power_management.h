@@ -0,0 +1,99 @@
+/**
+ * @file power_management.h
+ * @brief Opt-in low power mode between scheduled samples.
+ *
+ * With POWER_SAVE_MODE the loop blocks until the next sample tick instead of
+ * spinning, the CPU clock scales down through esp_pm with automatic light
+ * sleep, and WiFi uses modem sleep with a listen interval derived from the
+ * allowed WebSocket latency. Time spent active and idle is accounted so the
+ * average current can be weighed against update latency.
+ *
+ * The loop split alone does not show what the chip did while the loop was
+ * blocked. With POWER_SLEEP_TRACE the build wraps esp_light_sleep_start()
+ * (-Wl,--wrap=esp_light_sleep_start) and the time between each actual sleep
+ * entry and exit is summed. With CONFIG_PM_PROFILING in the SDK the esp_pm
+ * residency per mode (CPU_MAX, APB_MAX, APB_MIN, SLEEP) is reported as well,
+ * which covers the frequency scaling.
+ */
+
+#ifndef POWER_MANAGEMENT_H
+#define POWER_MANAGEMENT_H
+
+#include <Arduino.h>
+#include <Arduino_JSON.h>
+
+#ifndef POWER_SAVE_MODE
+#define POWER_SAVE_MODE 0 /**< Set to 1 to enable light sleep, frequency scaling and modem sleep. */
+#endif
+#ifndef POWER_MAX_LATENCY_MS
+#define POWER_MAX_LATENCY_MS 300 /**< Longest acceptable delay for incoming WebSocket traffic. */
+#endif
+#ifndef POWER_MIN_CPU_MHZ
+#define POWER_MIN_CPU_MHZ 80 /**< Lowest CPU clock used by frequency scaling. */
+#endif
+#ifndef POWER_WAKE_MS
+#define POWER_WAKE_MS 250 /**< Longest idle wait, so polled inputs are still serviced. */
+#endif
+#ifndef POWER_SLEEP_TRACE
+#define POWER_SLEEP_TRACE 0 /**< Set to 1 together with -Wl,--wrap=esp_light_sleep_start to time light sleep. */
+#endif
+
+/**
+ * @brief Power states accounted by PowerManagement.
+ */
+enum PowerState : uint8_t {
+    POWER_ACTIVE, /**< Loop doing work at full clock. */
+    POWER_IDLE, /**< Loop blocked; the CPU may scale down or light sleep. */
+    POWER_STATE_COUNT
+};
+
+/**
+ * @brief Low power configuration and per-state time accounting.
+ */
+class PowerManagement {
+public:
+    /**
+     * @brief Configure frequency scaling, light sleep and modem sleep.
+     *
+     * Call after WiFi is connected.
+     */
+    void begin();
+
+    /**
+     * @brief Whether the low power mode is compiled in.
+     */
+    bool enabled() const { return POWER_SAVE_MODE; }
+
+    /**
+     * @brief Block until the next sample tick, accounting active and idle time.
+     *
+     * Returns immediately when the low power mode is off.
+     */
+    void waitForWork();
+
+    /**
+     * @brief Account one light sleep; called from the esp_light_sleep_start() wrapper.
+     * @param sleptUs Time between sleep entry and exit.
+     * @param woke Whether the sleep was entered, as opposed to rejected.
+     */
+    void IRAM_ATTR noteLightSleep(int64_t sleptUs, bool woke);
+
+    /**
+     * @brief Configuration and time per power state for the JSON status output.
+     */
+    JSONVar statusJson() const;
+
+private:
+    bool pmConfigured = false; /**< esp_pm accepted the configuration. */
+    bool lightSleep = false; /**< Automatic light sleep was requested. */
+    uint16_t listenInterval = 0; /**< Beacon intervals between modem wake-ups. */
+    int64_t stateUs[POWER_STATE_COUNT] = {}; /**< Time accumulated per state. */
+    int64_t lastChangeUs = 0; /**< esp_timer time of the last state change. */
+    int64_t lightSleepUs = 0; /**< Time actually spent in light sleep. */
+    uint32_t lightSleeps = 0; /**< Light sleeps entered. */
+    uint32_t lightSleepRejects = 0; /**< Light sleep attempts that returned an error. */
+};
+
+extern PowerManagement powerManagement; /**< Shared instance used by the application. */
+
+#endif // POWER_MANAGEMENT_H
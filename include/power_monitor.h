@@ -0,0 +1,108 @@
+/**
+ * @file power_monitor.h
+ * @brief Continuous mains voltage/current capture for CT clamp monitoring.
+ *
+ * The ADC runs in continuous (I2S/DMA) mode on two ADC1 channels. A capture
+ * task de-interleaves the DMA output into one of two sample blocks and hands
+ * it to a processing task, which runs the fixed-point PowerKernel on it while
+ * the other block is being filled. Per-cycle results are summed into a window
+ * that is closed with every record.
+ */
+
+#ifndef POWER_MONITOR_H
+#define POWER_MONITOR_H
+
+#include <Arduino.h>
+#include <Arduino_JSON.h>
+#include "power_kernel.h"
+#include "harmonics.h"
+
+#ifndef POWER_MONITOR_ENABLED
+#define POWER_MONITOR_ENABLED 0 /**< Set to 1 to capture mains waveforms. */
+#endif
+#ifndef POWER_VOLTAGE_CHANNEL
+#define POWER_VOLTAGE_CHANNEL 0 /**< ADC1 channel of the voltage transformer (0 = GPIO36). */
+#endif
+#ifndef POWER_CURRENT_CHANNEL
+#define POWER_CURRENT_CHANNEL 3 /**< ADC1 channel of the CT clamp (3 = GPIO39). */
+#endif
+#ifndef POWER_SAMPLE_RATE_HZ
+#define POWER_SAMPLE_RATE_HZ 20000 /**< Total conversion rate, shared by both channels. */
+#endif
+#ifndef POWER_VOLTS_PER_COUNT
+#define POWER_VOLTS_PER_COUNT 0.35f /**< Voltage calibration, volts per ADC count. */
+#endif
+#ifndef POWER_AMPS_PER_COUNT
+#define POWER_AMPS_PER_COUNT 0.0153f /**< Current calibration, amps per ADC count. */
+#endif
+
+#ifndef HARMONICS_FFT_SIZE
+#define HARMONICS_FFT_SIZE 512 /**< Harmonic analysis window, 256 or 512 points. */
+#endif
+#ifndef HARMONICS_DECIMATION
+#define HARMONICS_DECIMATION 4 /**< Samples averaged per FFT point, 512 points then span ~10 mains cycles. */
+#endif
+#ifndef HARMONICS_INTERVAL_MS
+#define HARMONICS_INTERVAL_MS 5000 /**< Cadence of the background harmonic analysis. */
+#endif
+
+#define POWER_CHANNEL_RATE_HZ (POWER_SAMPLE_RATE_HZ / 2) /**< Samples per second per channel. */
+#define POWER_BLOCK_SAMPLES 512 /**< Samples per channel in one capture block. */
+
+/**
+ * @brief Mains power monitor fed by the continuous ADC.
+ */
+class PowerMonitor {
+public:
+    PowerMonitor();
+
+    /**
+     * @brief Start the ADC and the capture and processing tasks.
+     */
+    void begin();
+
+    /**
+     * @brief Whether waveform capture is compiled in.
+     */
+    bool enabled() const { return POWER_MONITOR_ENABLED; }
+
+    /**
+     * @brief Close the current window and add its results to a sensor record.
+     * @param record Record to extend.
+     */
+    void addToRecord(JSONVar& record);
+
+    /**
+     * @brief Capture counters and kernel cost for the JSON status output.
+     */
+    JSONVar statusJson() const;
+
+private:
+    static void captureTask(void* param);
+    static void processTask(void* param);
+    static void harmonicsTask(void* param);
+
+    PowerKernel kernel; /**< Per-cycle integrator. */
+    PowerWindow window; /**< Cycles since the last record. */
+    PowerCycle lastCycle = {}; /**< Most recent completed cycle. */
+    uint16_t voltageBlocks[2][POWER_BLOCK_SAMPLES]; /**< Double buffered voltage samples. */
+    uint16_t currentBlocks[2][POWER_BLOCK_SAMPLES]; /**< Double buffered current samples. */
+    volatile bool blockBusy[2] = { false, false }; /**< Block handed to the processing task and not yet released. */
+    TaskHandle_t processHandle = nullptr; /**< Task woken for each filled block. */
+    uint32_t blocks = 0; /**< Blocks processed. */
+    uint32_t overruns = 0; /**< Blocks dropped because processing fell behind. */
+    uint64_t kernelCycles = 0; /**< CPU cycles spent in the kernel. */
+    uint64_t kernelSamples = 0; /**< Samples passed through the kernel. */
+    HarmonicAnalyzer voltageHarmonics; /**< Harmonic analysis of the voltage channel. */
+    HarmonicAnalyzer currentHarmonics; /**< Harmonic analysis of the current channel. */
+    HarmonicResult voltageResult; /**< Latest voltage harmonics. */
+    HarmonicResult currentResult; /**< Latest current harmonics. */
+    uint32_t analyses = 0; /**< Harmonic windows analysed. */
+    uint32_t analysisMicros = 0; /**< Time of the last analysis of both channels. */
+    uint32_t maxAnalysisMicros = 0; /**< Worst analysis time seen. */
+    uint32_t overBudget = 0; /**< Analyses that took longer than one window. */
+};
+
+extern PowerMonitor powerMonitor; /**< Shared instance used by the application. */
+
+#endif // POWER_MONITOR_H
@@ -0,0 +1,81 @@
+/**
+ * @file pulse_input.h
+ * @brief S0/LED pulse input channel of an energy meter.
+ *
+ * A GPIO interrupt timestamps every pulse into a lock-free ring and keeps a
+ * running pulse count. The loop drains the ring into a PulseMeter, which
+ * turns the pulses into power and accumulated energy for each record.
+ */
+
+#ifndef PULSE_INPUT_H
+#define PULSE_INPUT_H
+
+#include <Arduino.h>
+#include <Arduino_JSON.h>
+#include "pulse_meter.h"
+#include "pulse_ring.h"
+
+#ifndef PULSE_INPUT_PIN
+#define PULSE_INPUT_PIN -1 /**< GPIO pin of the S0/LED pulse input, -1 disables the channel. */
+#endif
+#ifndef PULSES_PER_KWH
+#define PULSES_PER_KWH 1000.0f /**< Meter constant in impulses per kWh. */
+#endif
+#ifndef PULSE_MIN_INTERVAL_US
+#define PULSE_MIN_INTERVAL_US 0 /**< Pulses closer than this are treated as bounce and ignored. */
+#endif
+
+#define PULSE_RING_SIZE 1024 /**< Timestamps buffered between two drains of the ring. */
+
+/**
+ * @brief Interrupt driven pulse counter with its energy meter.
+ */
+class PulseInput {
+public:
+    PulseInput() : meter(PULSES_PER_KWH) {}
+
+    /**
+     * @brief Configure the pin and attach the interrupt.
+     */
+    void begin();
+
+    /**
+     * @brief Whether a pulse input pin is configured.
+     */
+    bool enabled() const { return PULSE_INPUT_PIN >= 0; }
+
+    /**
+     * @brief Move queued timestamps from the ring into the meter.
+     */
+    void poll();
+
+    /**
+     * @brief Close the record window and update power and energy.
+     */
+    void account();
+
+    /**
+     * @brief Add power and energy fields to a sensor record.
+     * @param record Record to extend.
+     */
+    void addToRecord(JSONVar& record) const;
+
+    /**
+     * @brief Counters for the JSON status output.
+     */
+    JSONVar statusJson() const;
+
+    PulseMeter meter; /**< Energy accounting for this channel. */
+
+private:
+    /**
+     * @brief Read the interrupt counters atomically.
+     */
+    PulseSnapshot snapshot() const;
+
+    static void IRAM_ATTR handlePulse();
+};
+
+extern PulseInput pulseInput; /**< Shared instance used by the application. */
+
+#endif // PULSE_INPUT_H
@@ -0,0 +1,88 @@
+/**
+ * @file pulse_meter.h
+ * @brief Energy and power derived from S0/LED meter pulses.
+ *
+ * The meter has no Arduino dependencies so it can be driven with synthetic
+ * pulse trains on the host. Energy is taken from the interrupt's running
+ * pulse count, which never loses pulses, while the per-pulse timestamps
+ * from the ring give the instantaneous and peak power.
+ */
+
+#ifndef PULSE_METER_H
+#define PULSE_METER_H
+
+#include <stdint.h>
+
+/**
+ * @brief Consistent view of the interrupt counters at one instant.
+ */
+struct PulseSnapshot {
+    uint32_t total; /**< Pulses counted since boot, wraps at 2^32. */
+    uint32_t lastPulseUs; /**< Timestamp of the most recent pulse in microseconds. */
+};
+
+/**
+ * @brief Converts pulses into accumulated Wh and power in W.
+ */
+class PulseMeter {
+public:
+    /**
+     * @brief Create a meter.
+     * @param pulsesPerKWh Meter constant, e.g. 1000 imp/kWh.
+     */
+    explicit PulseMeter(float pulsesPerKWh);
+
+    /**
+     * @brief Feed one pulse timestamp taken from the ring.
+     * @param timestampUs Time of the pulse in microseconds.
+     */
+    void consume(uint32_t timestampUs);
+
+    /**
+     * @brief Close the current record window.
+     *
+     * Adds the pulses counted since the previous call to the energy total
+     * and computes the mean power over the window.
+     * @param snapshot Interrupt counters taken just before the call.
+     * @param nowUs Current time in microseconds.
+     */
+    void account(const PulseSnapshot& snapshot, uint32_t nowUs);
+
+    /**
+     * @brief Restart counting from the given interrupt counters.
+     */
+    void reset(const PulseSnapshot& snapshot);
+
+    /**
+     * @brief Set the accumulated energy, e.g. after restoring it from storage.
+     */
+    void setEnergyWh(double wh) { energy = wh; }
+
+    double energyWh() const { return energy; } /**< Accumulated energy in Wh. */
+    float powerW() const { return meanPower; } /**< Mean power over the last window in W. */
+    float instantPowerW() const { return instantPower; } /**< Power from the last pulse interval in W. */
+    float peakPowerW() const { return peakPower; } /**< Highest per-pulse power in the last window in W. */
+    uint32_t pulsesInWindow() const { return windowPulses; } /**< Pulses counted in the last window. */
+
+private:
+    /**
+     * @brief Power for a number of pulses over an interval.
+     */
+    float powerFor(uint32_t pulses, uint32_t intervalUs) const;
+
+    double whPerPulse; /**< Energy represented by one pulse. */
+    double energy = 0; /**< Accumulated energy in Wh. */
+    float meanPower = 0; /**< Mean power of the last closed window. */
+    float instantPower = 0; /**< Power from the most recent pulse interval. */
+    float peakPower = 0; /**< Peak per-pulse power of the last closed window. */
+    float windowPeak = 0; /**< Peak per-pulse power of the open window. */
+    uint32_t windowPulses = 0; /**< Pulses in the last closed window. */
+    uint32_t lastTotal = 0; /**< Pulse count at the previous account(). */
+    uint32_t lastPulseUs = 0; /**< Last pulse time at the previous account(). */
+    uint32_t previousTimestamp = 0; /**< Last timestamp seen by consume(). */
+    uint32_t firstTimestamp = 0; /**< First timestamp seen by consume() after reset(). */
+    bool havePulse = false; /**< Whether lastPulseUs refers to a real pulse. */
+    bool haveTimestamp = false; /**< Whether previousTimestamp is valid. */
+};
+
+#endif // PULSE_METER_H
@@ -0,0 +1,83 @@
+/**
+ * @file pulse_ring.h
+ * @brief Lock-free single-producer/single-consumer ring buffer.
+ *
+ * The producer is an interrupt handler and the consumer is a task, so
+ * push() and pop() never block and never take a lock. The header has no
+ * Arduino dependencies and builds on the host as well.
+ */
+
+#ifndef PULSE_RING_H
+#define PULSE_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+#if defined(__GNUC__)
+#define RING_INLINE inline __attribute__((always_inline)) /**< Keep ring code inside IRAM interrupt handlers. */
+#else
+#define RING_INLINE inline
+#endif
+
+/**
+ * @brief Fixed capacity SPSC ring.
+ * @tparam T Element type, copied by value.
+ * @tparam N Capacity, must be a power of two.
+ */
+template <typename T, size_t N>
+class PulseRing {
+    static_assert((N & (N - 1)) == 0, "PulseRing capacity must be a power of two");
+
+public:
+    /**
+     * @brief Append an element; called by the producer only.
+     * @return false if the ring is full and the element was dropped.
+     */
+    RING_INLINE bool push(const T& item) {
+        uint32_t head = headIndex.load(std::memory_order_relaxed);
+        if (head - tailIndex.load(std::memory_order_acquire) >= N) {
+            dropped.store(dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return false;
+        }
+        items[head & (N - 1)] = item;
+        headIndex.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Remove the oldest element; called by the consumer only.
+     * @return false if the ring is empty.
+     */
+    RING_INLINE bool pop(T& item) {
+        uint32_t tail = tailIndex.load(std::memory_order_relaxed);
+        if (tail == headIndex.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = items[tail & (N - 1)];
+        tailIndex.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Number of elements waiting to be consumed.
+     */
+    size_t size() const {
+        return headIndex.load(std::memory_order_acquire) - tailIndex.load(std::memory_order_acquire);
+    }
+
+    /**
+     * @brief Number of elements dropped because the ring was full.
+     */
+    uint32_t droppedCount() const { return dropped.load(std::memory_order_relaxed); }
+
+    static constexpr size_t capacity = N; /**< Maximum number of queued elements. */
+
+private:
+    T items[N]; /**< Element storage. */
+    std::atomic<uint32_t> headIndex{0}; /**< Next write position, owned by the producer. */
+    std::atomic<uint32_t> tailIndex{0}; /**< Next read position, owned by the consumer. */
+    std::atomic<uint32_t> dropped{0}; /**< Elements rejected because the ring was full. */
+};
+
+#endif // PULSE_RING_H
@@ -0,0 +1,64 @@
+/**
+ * @file record_channels.h
+ * @brief Channel identifiers of the binary log and their mapping from records.
+ */
+
+#ifndef RECORD_CHANNELS_H
+#define RECORD_CHANNELS_H
+
+#include <Arduino.h>
+#include <Arduino_JSON.h>
+#include "record_log.h"
+
+#define CHANNEL_TEMP_BASE 0 /**< Probe N temperature in degrees Celsius, N < CHANNEL_TEMP_COUNT. */
+#define CHANNEL_PULSE_POWER 32 /**< Pulse input mean power in W. */
+#define CHANNEL_PULSE_ENERGY 33 /**< Pulse input accumulated energy in Wh. */
+#define CHANNEL_MAINS_VRMS 40 /**< Mains voltage RMS in V. */
+#define CHANNEL_MAINS_IRMS 41 /**< Mains current RMS in A. */
+#define CHANNEL_MAINS_POWER 42 /**< Mains real power in W. */
+#define CHANNEL_MAINS_PF 43 /**< Mains power factor. */
+#define CHANNEL_MAINS_FREQ 44 /**< Mains frequency in Hz. */
+#define CHANNEL_MODBUS_BASE 64 /**< Modbus meter M (its configured index) point P at 64 + 8 * M + P. */
+
+#define CHANNEL_TEMP_COUNT 16 /**< Probes with a channel of their own. */
+#define CHANNEL_SCALAR_COUNT 7 /**< Pulse and mains channels. */
+#define CHANNEL_MODBUS_METERS 24 /**< Meters with a channel range, up to the end of the 8-bit channel space. */
+#define CHANNEL_MODBUS_POINTS 8 /**< Channels per meter. */
+
+/**
+ * @brief Upper bound of log entries produced by one record: every channel once.
+ */
+#define MAX_RECORD_ENTRIES (CHANNEL_TEMP_COUNT + CHANNEL_SCALAR_COUNT + CHANNEL_MODBUS_METERS * CHANNEL_MODBUS_POINTS)
+
+#define CHANNEL_NAME_LENGTH 24 /**< Buffer size for channelName(). */
+
+/**
+ * @brief Convert a sensor record into binary log entries.
+ * @param record Sensor record as sent over the WebSocket.
+ * @param timeMs Sample time in epoch milliseconds.
+ * @param flags RECORD_FLAG_* bits applied to every entry.
+ * @param entries Output array of at least MAX_RECORD_ENTRIES entries.
+ * @return Number of entries written.
+ */
+size_t recordToEntries(JSONVar& record, int64_t timeMs, uint8_t flags, LogEntry* entries);
+
+/**
+ * @brief Record fields left out of the log because they have no channel,
+ *        such as a 17th probe or a meter point past CHANNEL_MODBUS_POINTS.
+ */
+uint32_t unmappedRecordFields();
+
+/**
+ * @brief Short name of a channel for exports, e.g. "temp" or "temp2".
+ * @param channel Channel identifier.
+ * @param out Buffer of at least CHANNEL_NAME_LENGTH bytes.
+ */
+void channelName(uint8_t channel, char* out);
+
+/**
+ * @brief Look up a channel by the name channelName() gives it.
+ * @return false if no channel has that name.
+ */
+bool channelFromName(const char* name, uint8_t& channel);
+
+#endif // RECORD_CHANNELS_H
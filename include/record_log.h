@@ -0,0 +1,219 @@
+/**
+ * @file record_log.h
+ * @brief Binary append-only log of fixed-size records.
+ *
+ * A log file starts with a versioned header followed by 16-byte records
+ * (epoch milliseconds, channel, flags, value and a CRC-16). Integers are
+ * little-endian. This reader/writer library has no Arduino dependencies and
+ * is shared by the firmware and the host tool in tools/logdump.
+ *
+ * Version 1 ("flat") logs store records back to back after a 32-byte
+ * header; downloads use it. Version 2 ("journal") logs, written on the SD
+ * card, commit records in 512-byte blocks: 31 record slots and a trailer
+ * with the block sequence number, the number of used slots and a CRC-32
+ * over the whole block, mixed with a random journal id from the header.
+ * The header fills block 0. A block is only read once its trailer checks
+ * out, so a block torn by a power loss is skipped as a whole, and blocks
+ * left over from another file in preallocated space never match. The
+ * logical end of a journal is the end of its committed blocks, which may
+ * lie before the end of the file.
+ */
+
+#ifndef RECORD_LOG_H
+#define RECORD_LOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define RECORD_LOG_MAGIC 0x474F4C45 /**< "ELOG" read as little-endian. */
+#define RECORD_LOG_VERSION_FLAT 1 /**< Records follow the header back to back. */
+#define RECORD_LOG_VERSION_JOURNAL 2 /**< Records are committed in checksummed blocks. */
+#define RECORD_LOG_HEADER_SIZE 32 /**< Encoded header; a flat log's first record follows it. */
+#define RECORD_SIZE 16 /**< Bytes per record. */
+
+#define RECORD_BLOCK_SIZE 512 /**< Journal block, one card sector. */
+#define RECORD_BLOCK_SLOTS (RECORD_BLOCK_SIZE / RECORD_SIZE - 1) /**< Record slots per journal block. */
+#define RECORD_BLOCK_MAGIC 0x4B4C424A /**< "JBLK" read as little-endian, starts a block trailer. */
+
+#define RECORD_FLAG_INVALID 0x01 /**< The sensor did not deliver a valid value. */
+#define RECORD_FLAG_TIME_FIXED_UP 0x02 /**< Time was derived from the monotonic clock after sync. */
+#define RECORD_FLAG_DOWNSAMPLED 0x04 /**< Mean of a 1-minute bucket of a compacted segment, stamped with the bucket start. */
+
+/**
+ * @brief File header.
+ */
+struct LogHeader {
+    uint32_t magic; /**< RECORD_LOG_MAGIC. */
+    uint16_t version; /**< Format version. */
+    uint16_t headerSize; /**< Offset of the first record. */
+    uint16_t recordSize; /**< Bytes per record. */
+    uint16_t blockSize; /**< Journal block size, 0 for a flat log. */
+    uint32_t journalId; /**< Random per journal, binds its blocks to the file. */
+    int64_t createdMs; /**< Creation time in epoch milliseconds. */
+};
+
+/**
+ * @brief One decoded record.
+ */
+struct LogEntry {
+    int64_t timeMs; /**< Sample time in epoch milliseconds. */
+    float value; /**< Sample value in the channel's unit. */
+    uint8_t channel; /**< Channel identifier, see record_channels.h. */
+    uint8_t flags; /**< RECORD_FLAG_* bits. */
+};
+
+/**
+ * @brief Store the low bytes bytes of an unsigned integer little-endian.
+ */
+void putLe(uint8_t* out, uint64_t value, size_t bytes);
+
+/**
+ * @brief Load an unsigned little-endian integer of bytes bytes.
+ */
+uint64_t getLe(const uint8_t* in, size_t bytes);
+
+/**
+ * @brief CRC-16/CCITT-FALSE (polynomial 0x1021, initial 0xFFFF).
+ */
+uint16_t recordCrc16(const uint8_t* data, size_t length);
+
+/**
+ * @brief Serialize a header into RECORD_LOG_HEADER_SIZE bytes.
+ */
+void encodeLogHeader(const LogHeader& header, uint8_t* out);
+
+/**
+ * @brief Parse and validate a header.
+ * @return false if the magic, version or checksum do not match.
+ */
+bool decodeLogHeader(const uint8_t* in, LogHeader& header);
+
+/**
+ * @brief Serialize a record into RECORD_SIZE bytes.
+ */
+void encodeLogEntry(const LogEntry& entry, uint8_t* out);
+
+/**
+ * @brief Parse a record.
+ * @return false if the record checksum does not match.
+ */
+bool decodeLogEntry(const uint8_t* in, LogEntry& entry);
+
+/**
+ * @brief Header with the current format constants.
+ * @param blockSize RECORD_BLOCK_SIZE for a journal, 0 for a flat log.
+ * @param journalId Random value for a journal.
+ */
+LogHeader makeLogHeader(int64_t createdMs, uint16_t blockSize = 0, uint32_t journalId = 0);
+
+/**
+ * @brief CRC-32 (ISO-HDLC, as in zlib) of a buffer.
+ */
+uint32_t recordCrc32(const uint8_t* data, size_t length);
+
+/**
+ * @brief Continue a CRC-32 over data that arrives in pieces.
+ * @param crc Register from the previous call, 0xFFFFFFFF to start; the CRC
+ *        of all pieces is the complement of the last result.
+ */
+uint32_t recordCrc32Update(uint32_t crc, const uint8_t* data, size_t length);
+
+/**
+ * @brief Commit a journal block: fill the unused slots and write the trailer.
+ * @param block RECORD_BLOCK_SIZE bytes whose first count slots hold records.
+ * @param sequence Position of the block after the header block.
+ * @param count Used slots, at most RECORD_BLOCK_SLOTS.
+ * @param journalId Journal id from the header.
+ */
+void sealLogBlock(uint8_t* block, uint32_t sequence, uint8_t count, uint32_t journalId);
+
+/**
+ * @brief Check the trailer of a journal block.
+ * @param sequence Expected position of the block, which catches stale sectors.
+ * @param journalId Journal id from the header, which catches blocks of other files.
+ * @param count Set to the number of used slots.
+ * @return false if the block was not completely written.
+ */
+bool checkLogBlock(const uint8_t* block, uint32_t sequence, uint32_t journalId, uint8_t& count);
+
+/**
+ * @brief Sequence number in a block trailer, before the block is checked.
+ */
+uint32_t logBlockSequence(const uint8_t* block);
+
+/**
+ * @brief Random access reader over any byte source.
+ *
+ * Reads go through a one-block cache, so sequential access costs one
+ * source read per block. Records of a journal block that fails its check,
+ * and unused slots of partly filled blocks, read as missing. A journal is
+ * cut at its logical end, found by binary search when it is opened; that
+ * assumes failing blocks before the end stand alone.
+ */
+class RecordLogReader {
+public:
+    /**
+     * @brief Reads length bytes at offset into buffer and returns the number read.
+     */
+    typedef size_t (*ReadFunction)(void* context, uint64_t offset, uint8_t* buffer, size_t length);
+
+    /**
+     * @brief Validate the header of a log.
+     * @param read Byte source.
+     * @param context Passed through to read.
+     * @param size Total size of the log in bytes.
+     * @return false if the header is missing or invalid.
+     */
+    bool open(ReadFunction read, void* context, uint64_t size);
+
+    /**
+     * @brief Number of record slots in the log, up to its logical end.
+     */
+    uint64_t count() const { return records; }
+
+    /**
+     * @brief Read record index.
+     * @return false if it is out of range, an unused slot, or fails a checksum.
+     */
+    bool read(uint64_t index, LogEntry& entry);
+
+    /**
+     * @brief Index of the first record with timeMs >= timeMs, assuming time order.
+     *
+     * Records that fail their checksum are skipped while searching.
+     */
+    uint64_t lowerBound(int64_t timeMs);
+
+    /**
+     * @brief Journal blocks before the logical end that failed their check, each counted once per load.
+     */
+    uint32_t rejectedBlocks() const { return rejected; }
+
+    const LogHeader& header() const { return fileHeader; } /**< Parsed file header. */
+
+private:
+    /**
+     * @brief Load a block into the cache and count its readable slots.
+     * @return false if a journal block fails its check.
+     */
+    bool loadBlock(uint64_t block);
+
+    /**
+     * @brief Number of journal blocks before the logical end.
+     * @param blocks Whole blocks in the file.
+     */
+    uint64_t committedBlocks(uint64_t blocks);
+
+    ReadFunction source = nullptr; /**< Byte source. */
+    void* sourceContext = nullptr; /**< Argument of source. */
+    LogHeader fileHeader = {}; /**< Parsed header. */
+    uint64_t size = 0; /**< Total size of the log. */
+    uint64_t records = 0; /**< Record slots after the header. */
+    uint16_t perBlock = 0; /**< Record slots per cached block. */
+    uint8_t cache[RECORD_BLOCK_SIZE]; /**< Last block read. */
+    uint64_t cachedBlock = UINT64_MAX; /**< Block in cache. */
+    uint8_t cachedCount = 0; /**< Readable slots in cache. */
+    uint32_t rejected = 0; /**< Journal blocks that failed their check. */
+};
+
+#endif // RECORD_LOG_H
@@ -0,0 +1,112 @@
+/**
+ * @file retention_manager.h
+ * @brief Background retention and clearing of the SD log.
+ *
+ * A low priority task deletes whole day segments, oldest first, once they
+ * are older than RETENTION_MAX_AGE_DAYS, once the segments and rollups
+ * together exceed RETENTION_MAX_BYTES, or while less than
+ * RETENTION_MIN_FREE_PERCENT of the card is free. The segment being written
+ * is never dropped. Rollups outlive the raw data they were built from: the
+ * 1-minute tier ages out in generations (see rollup_store.h), and its
+ * previous generation is only deleted once no segment is left to drop.
+ *
+ * Clearing the log also runs in this task, so the web server never waits
+ * for the card: a clear request is queued as a job and answered at once
+ * with the job's id and state. Requests made while a job is still queued
+ * join that job. The job stays running until segments that were being
+ * downloaded are deleted too.
+ */
+
+#ifndef RETENTION_MANAGER_H
+#define RETENTION_MANAGER_H
+
+#include <Arduino.h>
+#include <Arduino_JSON.h>
+
+#ifndef RETENTION_MAX_AGE_DAYS
+#define RETENTION_MAX_AGE_DAYS 0 /**< Age at which a segment is dropped, 0 to keep segments regardless of age. */
+#endif
+#ifndef RETENTION_MAX_BYTES
+#define RETENTION_MAX_BYTES 0ULL /**< Size limit of all segments together, 0 for none. */
+#endif
+#ifndef RETENTION_MIN_FREE_PERCENT
+#define RETENTION_MIN_FREE_PERCENT 10 /**< Free card space below which the oldest segments go, 0 to disable. */
+#endif
+#ifndef RETENTION_CHECK_INTERVAL_MS
+#define RETENTION_CHECK_INTERVAL_MS 600000UL /**< How often the policies are applied. */
+#endif
+
+#ifndef RETENTION_CLEAR_POLL_MS
+#define RETENTION_CLEAR_POLL_MS 250 /**< How often a clear job checks for released segments. */
+#endif
+
+#define RETENTION_JOB_NONE 0 /**< No clear was requested yet. */
+#define RETENTION_JOB_QUEUED 1 /**< Waiting for the retention task. */
+#define RETENTION_JOB_RUNNING 2 /**< Being carried out. */
+#define RETENTION_JOB_DONE 3 /**< Finished. */
+
+/**
+ * @brief Owns the retention task, its policies and the clear job.
+ */
+class RetentionManager {
+public:
+    /**
+     * @brief Start the retention task; works with or without a card.
+     */
+    void begin();
+
+    /**
+     * @brief Queue clearing the whole log.
+     * @return Id of the job that will carry it out.
+     */
+    uint32_t requestClear();
+
+    /**
+     * @brief Id and state of the latest clear job.
+     */
+    JSONVar clearJobJson() const;
+
+    /**
+     * @brief Policies and counters for the JSON status output.
+     */
+    JSONVar statusJson() const;
+
+private:
+    static void retentionTask(void* param);
+
+    /**
+     * @brief Carry out a queued clear job.
+     */
+    void runClear();
+
+    /**
+     * @brief Drop segments until every policy is met.
+     */
+    void enforce();
+
+    /**
+     * @brief Whether the oldest segment, of the given day, violates a policy.
+     * @param storedBytes Size of all segments and rollups.
+     */
+    bool overLimit(uint32_t day, uint64_t storedBytes) const;
+
+    /**
+     * @brief Whether the size or free space policy is violated.
+     * @param storedBytes Size of all segments and rollups.
+     */
+    bool overSpace(uint64_t storedBytes) const;
+
+    TaskHandle_t task = nullptr; /**< The retention task. */
+    volatile uint32_t jobId = 0; /**< Id of the latest clear job. */
+    volatile uint8_t jobState = RETENTION_JOB_NONE; /**< RETENTION_JOB_* state of that job. */
+    uint32_t jobMillis = 0; /**< Duration of the last finished clear. */
+    uint32_t checks = 0; /**< Policy runs. */
+    uint32_t dropped = 0; /**< Segments deleted by the policies. */
+    uint64_t freedBytes = 0; /**< Bytes those segments took. */
+    uint64_t storedBytes = 0; /**< Segment and rollup bytes found by the last policy run. */
+    uint32_t lastCheckMillis = 0; /**< Duration of the last policy run. */
+};
+
+extern RetentionManager retentionManager; /**< Shared instance used by the application. */
+
+#endif // RETENTION_MANAGER_H
@@ -0,0 +1,153 @@
+/**
+ * @file rollup.h
+ * @brief Multi-resolution rollups of logged samples.
+ *
+ * Every sample updates one open bucket per tier (1 minute, 1 hour and
+ * 1 day) of its channel in O(1). When a sample falls into a later bucket,
+ * the open one is closed and handed to a sink, which persists it. Buckets
+ * hold min, max, mean, count and last value. Bucket records are 32 bytes
+ * with a CRC-16. The module has no Arduino dependencies.
+ *
+ * The same records make up compacted log segments: a header record (see
+ * RollupSegmentHeader) followed by the 1-minute buckets of one day.
+ */
+
+#ifndef ROLLUP_H
+#define ROLLUP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ROLLUP_TIERS 3 /**< Number of rollup resolutions. */
+#define ROLLUP_RECORD_SIZE 32 /**< Bytes per stored bucket. */
+
+#define ROLLUP_SEGMENT_MAGIC 0x314D4352 /**< "RCM1" read as little-endian, starts a compacted segment. */
+
+#ifndef ROLLUP_MAX_CHANNELS
+#define ROLLUP_MAX_CHANNELS 32 /**< Channels that can have open buckets at the same time. */
+#endif
+
+extern const int64_t rollupWidthMs[ROLLUP_TIERS]; /**< Bucket width per tier, finest first. */
+extern const char* const rollupTierName[ROLLUP_TIERS]; /**< "1m", "1h" and "1d". */
+
+/**
+ * @brief Aggregate of one channel over one bucket.
+ */
+struct RollupBucket {
+    int64_t startMs; /**< Start of the bucket in epoch milliseconds. */
+    float min; /**< Smallest value. */
+    float max; /**< Largest value. */
+    float mean; /**< Mean value. */
+    float last; /**< Latest value. */
+    uint32_t count; /**< Samples in the bucket. */
+    uint8_t channel; /**< Channel identifier. */
+    uint8_t tier; /**< Index into rollupWidthMs. */
+};
+
+/**
+ * @brief Serialize a bucket into ROLLUP_RECORD_SIZE bytes.
+ */
+void encodeRollupBucket(const RollupBucket& bucket, uint8_t* out);
+
+/**
+ * @brief Parse a bucket.
+ * @return false if the checksum does not match.
+ */
+bool decodeRollupBucket(const uint8_t* in, RollupBucket& bucket);
+
+/**
+ * @brief Header record of a compacted segment.
+ */
+struct RollupSegmentHeader {
+    uint32_t buckets; /**< Bucket records after the header. */
+    uint32_t samples; /**< Sum of the bucket counts. */
+    int64_t firstMs; /**< Earliest bucket start. */
+    int64_t lastMs; /**< Latest bucket start. */
+};
+
+/**
+ * @brief Serialize a compacted segment header into ROLLUP_RECORD_SIZE bytes.
+ */
+void encodeRollupSegmentHeader(const RollupSegmentHeader& header, uint8_t* out);
+
+/**
+ * @brief Parse a compacted segment header.
+ * @return false if the magic or the checksum do not match.
+ */
+bool decodeRollupSegmentHeader(const uint8_t* in, RollupSegmentHeader& header);
+
+/**
+ * @brief Coarsest tier whose width does not exceed resolutionMs.
+ * @return Tier index, or -1 if even the finest tier is too coarse.
+ */
+int rollupTierFor(int64_t resolutionMs);
+
+/**
+ * @brief Receives buckets as they close.
+ */
+typedef void (*RollupSink)(void* context, const RollupBucket& bucket);
+
+/**
+ * @brief Open buckets of all tiers and channels.
+ */
+class RollupAggregator {
+public:
+    /**
+     * @brief Set where closed buckets go.
+     */
+    void begin(RollupSink sink, void* context);
+
+    /**
+     * @brief Add a sample.
+     *
+     * Samples older than the open bucket of a tier, e.g. records released
+     * after time sync, do not update that tier.
+     */
+    void add(uint8_t channel, int64_t timeMs, float value);
+
+    /**
+     * @brief Suppress buckets starting at or before startMs, which are already persisted.
+     *
+     * Used while replaying the raw log after a restart.
+     */
+    void setPersistedUntil(uint8_t tier, int64_t startMs) { persistedUntil[tier] = startMs; }
+
+    /**
+     * @brief Hand every open bucket to the sink and forget all channels.
+     *
+     * Used at the end of a compaction, whose source has no later samples.
+     */
+    void closeAll();
+
+    uint32_t lateSamples() const { return late; } /**< Samples too old for an open bucket. */
+    uint32_t closedBuckets() const { return closed; } /**< Buckets handed to the sink. */
+
+private:
+    /**
+     * @brief Running aggregate of an open bucket.
+     */
+    struct OpenBucket {
+        int64_t startMs; /**< Start of the bucket, INT64_MIN if none is open. */
+        float min; /**< Smallest value. */
+        float max; /**< Largest value. */
+        float last; /**< Latest value. */
+        double sum; /**< Sum of values, for the mean. */
+        uint32_t count; /**< Samples so far. */
+    };
+
+    /**
+     * @brief Hand an open bucket to the sink unless it was persisted before.
+     */
+    void close(uint8_t tier, uint8_t channel, const OpenBucket& open);
+
+    RollupSink sink = nullptr; /**< Destination of closed buckets. */
+    void* sinkContext = nullptr; /**< Passed to sink. */
+    uint8_t slotOf[256]; /**< Open bucket slot per channel, 0xFF if none. */
+    uint8_t slots = 0; /**< Slots in use. */
+    OpenBucket open[ROLLUP_MAX_CHANNELS][ROLLUP_TIERS]; /**< Open buckets per slot and tier. */
+    int64_t persistedUntil[ROLLUP_TIERS]; /**< Start of the newest stored bucket per tier. */
+    uint32_t late = 0; /**< Samples too old for an open bucket. */
+    uint32_t closed = 0; /**< Buckets handed to the sink. */
+};
+
+#endif // ROLLUP_H
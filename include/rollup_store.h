@@ -0,0 +1,197 @@
+/**
+ * @file rollup_store.h
+ * @brief Rollup tiers persisted next to the raw log.
+ *
+ * The SD writer task feeds every logged sample into a RollupAggregator and
+ * appends closed buckets to one file per tier (1m.bin, 1h.bin, 1d.bin).
+ * Buckets are appended in time order, so a query binary searches the tier
+ * file for the start of its range. After a restart the open buckets are
+ * rebuilt by replaying the raw log from the start of the current day;
+ * buckets that were already stored are not written again. The replay never
+ * reaches further back than the newest logged day, so a card whose older
+ * days were never rolled up keeps them in the raw log only.
+ *
+ * The 1-minute tier would grow by about a megabyte a day, so it is kept in
+ * generations: once its first bucket is ROLLUP_FINE_KEEP_DAYS old, 1m.bin
+ * becomes 1m.old, replacing the previous generation. Queries read both. The
+ * hourly and daily tiers are small and kept for good.
+ */
+
+#ifndef ROLLUP_STORE_H
+#define ROLLUP_STORE_H
+
+#include <Arduino.h>
+#include <Arduino_JSON.h>
+#include <SD.h>
+#include "rollup.h"
+#include "record_log.h"
+
+#define ROLLUP_READ_BUCKETS 16 /**< Buckets read from the card at a time. */
+
+#ifndef ROLLUP_FINE_KEEP_DAYS
+#define ROLLUP_FINE_KEEP_DAYS 31 /**< Span of a 1-minute generation; one to two generations are kept. */
+#endif
+
+/**
+ * @brief Rollup files and the aggregator feeding them.
+ */
+class RollupStore {
+public:
+    /**
+     * @brief Open the tier files and note the newest stored bucket of each tier.
+     * @param directory Rollup directory on the SD card, created if missing.
+     */
+    bool begin(const char* directory);
+
+    /**
+     * @brief Rebuild the open buckets from the raw log; runs in the writer task.
+     * @param newestDayMs Start of the newest day in the log, where the replay starts at the earliest.
+     */
+    void replay(int64_t newestDayMs);
+
+    /**
+     * @brief Add a logged sample; runs in the writer task.
+     */
+    void add(const LogEntry& entry);
+
+    /**
+     * @brief Flush the tier files to the card.
+     */
+    void flush();
+
+    /**
+     * @brief Delete all tiers and forget the open buckets.
+     */
+    void clear();
+
+    /**
+     * @brief Path of the file of a tier.
+     */
+    String tierPath(uint8_t tier) const;
+
+    /**
+     * @brief Path of the previous generation of the 1-minute tier.
+     */
+    String fineOldPath() const;
+
+    /**
+     * @brief Start a new 1-minute generation if the current one is due; the caller holds the log writer's lock.
+     * @return false if it was not due yet or is being read.
+     */
+    bool rotateFine(int64_t nowMs);
+
+    /**
+     * @brief Delete the previous 1-minute generation to free space.
+     * @return Size of the deleted file, 0 if there is none or it is being read.
+     */
+    uint64_t dropOldFine();
+
+    /**
+     * @brief Size of all tier files, both 1-minute generations included.
+     */
+    uint64_t storedBytes();
+
+    /**
+     * @brief Keep the 1-minute generations in place while a RollupQuery reads them.
+     * @return false while a generation is being rotated or dropped.
+     */
+    bool acquireFine();
+
+    /**
+     * @brief End a hold taken with acquireFine().
+     */
+    void releaseFine();
+
+    /**
+     * @brief Counters for the JSON status output.
+     */
+    JSONVar statusJson() const;
+
+private:
+    /**
+     * @brief RollupSink appending a bucket to its tier file.
+     */
+    static void storeBucket(void* context, const RollupBucket& bucket);
+
+    /**
+     * @brief Pad a torn last bucket and return the newest stored bucket start.
+     */
+    int64_t prepareTier(uint8_t tier);
+
+    /**
+     * @brief Claim the 1-minute generations for renaming or deleting.
+     * @return false if they are being read.
+     */
+    bool beginFineChange();
+
+    /**
+     * @brief Let readers at the 1-minute generations again.
+     */
+    void endFineChange();
+
+    String path; /**< Rollup directory. */
+    File files[ROLLUP_TIERS]; /**< Open tier files. */
+    RollupAggregator aggregator; /**< Open buckets. */
+    int64_t newestStored[ROLLUP_TIERS]; /**< Start of the newest bucket per tier at begin(). */
+    bool ready = false; /**< begin() succeeded. */
+    uint32_t written[ROLLUP_TIERS] = {}; /**< Buckets written per tier. */
+    uint32_t writeErrors = 0; /**< Short or failed bucket writes. */
+    uint32_t replayed = 0; /**< Samples replayed after the last restart. */
+    uint32_t replayMillis = 0; /**< Duration of the replay. */
+    uint8_t fineReaders = 0; /**< RollupQuery instances reading the 1-minute tier. */
+    bool fineBusy = false; /**< A 1-minute generation is being rotated or dropped. */
+    uint32_t fineRotations = 0; /**< 1-minute generations started. */
+    uint32_t fineDrops = 0; /**< Previous generations deleted to free space. */
+};
+
+/**
+ * @brief Cursor over the buckets of one tier and channel in a time range.
+ */
+class RollupQuery {
+public:
+    /**
+     * @brief Prepare a query; buckets overlapping [fromMs, toMs] are returned.
+     */
+    RollupQuery(uint8_t tier, int64_t fromMs, int64_t toMs, uint8_t channel);
+
+    /**
+     * @brief Release the 1-minute generations.
+     */
+    ~RollupQuery();
+
+    /**
+     * @brief Read the next bucket.
+     * @return false once the range is exhausted.
+     */
+    bool next(RollupBucket& bucket);
+
+private:
+    /**
+     * @brief Read bucket index through the read buffer.
+     */
+    bool readBucket(uint32_t index, RollupBucket& bucket);
+
+    /**
+     * @brief First bucket index with startMs >= startMs.
+     */
+    uint32_t lowerBound(int64_t startMs);
+
+    uint8_t tier; /**< Queried tier. */
+    int64_t fromMs; /**< Start of the range. */
+    int64_t toMs; /**< End of the range. */
+    uint8_t channel; /**< Queried channel. */
+    File file; /**< Tier file. */
+    File oldFile; /**< Previous 1-minute generation, read before file. */
+    bool holding = false; /**< Whether the 1-minute tier is held with RollupStore::acquireFine(). */
+    uint32_t oldCount = 0; /**< Buckets in oldFile. */
+    uint32_t count = 0; /**< Buckets in both files. */
+    uint32_t position = 0; /**< Next bucket index. */
+    bool started = false; /**< Whether the file was opened. */
+    uint8_t buffer[ROLLUP_READ_BUCKETS * ROLLUP_RECORD_SIZE]; /**< Buckets read ahead. */
+    uint32_t bufferStart = 0; /**< Index of the first buffered bucket. */
+    uint32_t bufferCount = 0; /**< Buckets in buffer. */
+};
+
+extern RollupStore rollupStore; /**< Shared instance used by the application. */
+
+#endif // ROLLUP_STORE_H
@@ -0,0 +1,70 @@
+/**
+ * @file sample_scheduler.h
+ * @brief Drift-free sample ticks from a periodic esp_timer.
+ *
+ * The timer fires on a fixed grid (start + k * interval), independent of how
+ * long a sample takes to process. The loop consumes the ticks and the delay
+ * between the scheduled and the actual start is collected in a histogram.
+ */
+
+#ifndef SAMPLE_SCHEDULER_H
+#define SAMPLE_SCHEDULER_H
+
+#include <Arduino.h>
+#include <Arduino_JSON.h>
+#include <esp_timer.h>
+
+#define JITTER_BUCKETS 7 /**< Histogram buckets: <100us, <1ms, <10ms, <100ms, <1s, <10s, more. */
+
+/**
+ * @brief Periodic sample tick source with start-time jitter statistics.
+ */
+class SampleScheduler {
+public:
+    /**
+     * @brief Start the periodic timer.
+     * @param intervalMs Sample interval in milliseconds.
+     */
+    void begin(unsigned long intervalMs);
+
+    /**
+     * @brief Consume a pending tick, if any, and record its start jitter.
+     * @return true if a sample is due.
+     */
+    bool takeTick();
+
+    /**
+     * @brief Block the calling task until a tick is pending or the timeout expires.
+     * @param timeoutMs Longest time to wait in milliseconds.
+     */
+    void waitForTick(uint32_t timeoutMs);
+
+    /**
+     * @brief Scheduled time of the tick last returned by takeTick(), in esp_timer microseconds.
+     */
+    int64_t scheduledMicros() const { return lastScheduled; }
+
+    /**
+     * @brief Tick counters and jitter histogram for the JSON status output.
+     */
+    JSONVar statusJson() const;
+
+private:
+    static void onTimer(void* arg);
+
+    esp_timer_handle_t timer = nullptr; /**< Periodic timer. */
+    volatile TaskHandle_t waiter = nullptr; /**< Task blocked in waitForTick(), woken by the timer. */
+    int64_t intervalUs = 0; /**< Tick period. */
+    int64_t firstTickUs = 0; /**< Time of tick 0 on the grid. */
+    volatile uint32_t fired = 0; /**< Ticks raised by the timer. */
+    uint32_t consumed = 0; /**< Ticks handled or skipped by the loop. */
+    uint32_t missed = 0; /**< Ticks skipped because the loop fell a full interval behind. */
+    int64_t lastScheduled = 0; /**< Scheduled time of the last consumed tick. */
+    uint32_t lastJitterUs = 0; /**< Start delay of the last tick. */
+    uint32_t maxJitterUs = 0; /**< Worst start delay seen. */
+    uint32_t histogram[JITTER_BUCKETS] = {}; /**< Start delay distribution. */
+};
+
+extern SampleScheduler sampleScheduler; /**< Shared instance used by the application. */
+
+#endif // SAMPLE_SCHEDULER_H
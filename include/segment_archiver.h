@@ -0,0 +1,69 @@
+/**
+ * @file segment_archiver.h
+ * @brief Background conversion of finished log segments to Gorilla archives.
+ *
+ * Once a day's raw segment no longer receives records, a low priority task
+ * re-encodes it channel by channel into Gorilla blocks (see gorilla.h),
+ * decodes the result again to verify sample count and checksum, and only
+ * then replaces the raw segment with the archive.
+ */
+
+#ifndef SEGMENT_ARCHIVER_H
+#define SEGMENT_ARCHIVER_H
+
+#include <Arduino.h>
+#include <Arduino_JSON.h>
+#include <SD.h>
+#include "gorilla.h"
+#include "segment_index.h"
+
+#ifndef ARCHIVE_ENABLED
+#define ARCHIVE_ENABLED 1 /**< Set to 0 to keep past days as raw segments. */
+#endif
+#ifndef ARCHIVE_CHECK_INTERVAL_MS
+#define ARCHIVE_CHECK_INTERVAL_MS 600000UL /**< How often the task looks for finished segments. */
+#endif
+
+/**
+ * @brief Owns the archiver task and its statistics.
+ */
+class SegmentArchiver {
+public:
+    /**
+     * @brief Start the archiver task; call after logWriter.begin().
+     */
+    void begin();
+
+    /**
+     * @brief Counters for the JSON status output.
+     */
+    JSONVar statusJson() const;
+
+private:
+    static void archiverTask(void* param);
+
+    /**
+     * @brief Archive one raw segment and install the result.
+     * @return false if archiving or verification failed.
+     */
+    bool archive(const SegmentInfo& segment);
+
+    /**
+     * @brief Decode an archive and compare it against its header.
+     */
+    bool verify(File& archive, const ArchiveHeader& expected);
+
+    File raw; /**< Raw segment being archived. */
+    RecordLogReader reader; /**< Reader over raw, kept off the task stack. */
+    uint64_t rawRecords = 0; /**< Record slots in raw. */
+    uint8_t block[GORILLA_BLOCK_SIZE]; /**< Block being encoded or verified. */
+    uint32_t archived = 0; /**< Segments replaced by archives. */
+    uint32_t failures = 0; /**< Segments whose archive failed or did not verify. */
+    uint64_t rawBytes = 0; /**< Size of the archived raw segments. */
+    uint64_t archiveBytes = 0; /**< Size of the archives that replaced them. */
+    uint32_t lastMillis = 0; /**< Duration of the last archive run. */
+};
+
+extern SegmentArchiver segmentArchiver; /**< Shared instance used by the application. */
+
+#endif // SEGMENT_ARCHIVER_H
@@ -0,0 +1,113 @@
+/**
+ * @file segment_compactor.h
+ * @brief Background compaction of old log segments to 1-minute buckets.
+ *
+ * Months-old 3-second samples are rarely needed but take most of the card
+ * and of the scan time. Once a day is COMPACT_AFTER_DAYS old, a low
+ * priority task re-reads its segment and rewrites it as a compacted
+ * segment (see rollup.h): one min/max/mean/count/last bucket per channel
+ * and minute. The result is read back and checked against the totals
+ * gathered while writing, and only then swapped in for the source with a
+ * rename (see LogWriter::installArchive()).
+ *
+ * The work is done in slices of COMPACT_SLICE_RECORDS records with a pause
+ * after each, so the task never holds the card or the log writer's lock
+ * for long. Samples flagged invalid are left out, as in the rollup tiers.
+ */
+
+#ifndef SEGMENT_COMPACTOR_H
+#define SEGMENT_COMPACTOR_H
+
+#include <Arduino.h>
+#include <Arduino_JSON.h>
+#include <SD.h>
+#include "rollup.h"
+#include "segment_index.h"
+
+#ifndef COMPACT_ENABLED
+#define COMPACT_ENABLED 1 /**< Set to 0 to keep every day at full resolution. */
+#endif
+#ifndef COMPACT_AFTER_DAYS
+#define COMPACT_AFTER_DAYS 90 /**< Age in days at which a segment is compacted. */
+#endif
+#ifndef COMPACT_CHECK_INTERVAL_MS
+#define COMPACT_CHECK_INTERVAL_MS 3600000UL /**< How often the task looks for old segments. */
+#endif
+#ifndef COMPACT_SLICE_RECORDS
+#define COMPACT_SLICE_RECORDS 512 /**< Records or buckets handled between pauses. */
+#endif
+#ifndef COMPACT_SLICE_PAUSE_MS
+#define COMPACT_SLICE_PAUSE_MS 20 /**< Pause after each slice. */
+#endif
+
+#define COMPACT_BUFFER_BUCKETS 16 /**< Buckets written or verified at a time. */
+
+/**
+ * @brief Owns the compaction task and its statistics.
+ */
+class SegmentCompactor {
+public:
+    /**
+     * @brief Start the compaction task; call after logWriter.begin().
+     */
+    void begin();
+
+    /**
+     * @brief Configuration and counters for the JSON status output.
+     */
+    JSONVar statusJson() const;
+
+private:
+    static void compactorTask(void* param);
+
+    /**
+     * @brief RollupSink collecting the 1-minute buckets into buffer.
+     */
+    static void storeBucket(void* context, const RollupBucket& bucket);
+
+    /**
+     * @brief Oldest segment due for compaction.
+     */
+    bool findCandidate(SegmentInfo& segment);
+
+    /**
+     * @brief Compact one segment and install the result.
+     * @return false if compaction or verification failed.
+     */
+    bool compact(const SegmentInfo& segment);
+
+    /**
+     * @brief Write the buffered buckets to output.
+     */
+    void writeBuffered();
+
+    /**
+     * @brief Read a compacted file back and compare it against its header.
+     */
+    bool verify(File& compacted, const RollupSegmentHeader& expected);
+
+    /**
+     * @brief Pause after every COMPACT_SLICE_RECORDS calls.
+     */
+    void step();
+
+    RollupAggregator aggregator; /**< Builds the buckets, only tier 0 is kept. */
+    File output; /**< Compacted file being written. */
+    bool outputOk = true; /**< Whether every write to output succeeded. */
+    RollupSegmentHeader written; /**< Totals of the buckets handed to output. */
+    uint8_t buffer[COMPACT_BUFFER_BUCKETS * ROLLUP_RECORD_SIZE]; /**< Buckets waiting to be written, or being verified. */
+    size_t buffered = 0; /**< Buckets in buffer. */
+    uint32_t sliceCount = 0; /**< Records or buckets handled in the current slice. */
+    uint32_t compacted = 0; /**< Segments replaced by compacted ones. */
+    uint32_t failures = 0; /**< Segments whose compaction failed or did not verify. */
+    uint32_t samples = 0; /**< Samples folded into buckets. */
+    uint32_t lateSamples = 0; /**< Samples out of time order within their channel, dropped. */
+    uint32_t slices = 0; /**< Pauses taken. */
+    uint64_t sourceBytes = 0; /**< Size of the compacted source segments. */
+    uint64_t compactBytes = 0; /**< Size of the compacted segments that replaced them. */
+    uint32_t lastMillis = 0; /**< Duration of the last compaction, pauses included. */
+};
+
+extern SegmentCompactor segmentCompactor; /**< Shared instance used by the application. */
+
+#endif // SEGMENT_COMPACTOR_H
@@ -0,0 +1,122 @@
+/**
+ * @file segment_index.h
+ * @brief Index of time-bounded log segments.
+ *
+ * The binary log is split into one segment file per UTC day, named after
+ * the day (e.g. 20261017.bin). Past days are later converted to Gorilla
+ * archives (20261017.gor, see gorilla.h), and old days to compacted
+ * 1-minute segments (20261017.min, see rollup.h). The index keeps the
+ * first and last sample time of every segment in day order, so a range
+ * query finds the overlapping segments with a binary search and never
+ * touches the others. It has no Arduino dependencies.
+ */
+
+#ifndef SEGMENT_INDEX_H
+#define SEGMENT_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef LOG_MAX_SEGMENTS
+#define LOG_MAX_SEGMENTS 400 /**< Segments tracked by the index; older days are evicted beyond this. */
+#endif
+
+#define SEGMENT_DAY_MS 86400000LL /**< Length of a segment in milliseconds. */
+#define SEGMENT_NAME_LENGTH 13 /**< Bytes needed for "YYYYMMDD.bin" and the terminator. */
+
+#define SEGMENT_RAW 0 /**< Binary record log, see record_log.h. */
+#define SEGMENT_ARCHIVE 1 /**< Gorilla block archive, see gorilla.h. */
+#define SEGMENT_COMPACT 2 /**< 1-minute rollup buckets, see rollup.h. */
+
+/**
+ * @brief Time range of one segment.
+ */
+struct SegmentInfo {
+    uint32_t day; /**< Days since 1970-01-01 UTC. */
+    int64_t firstMs; /**< Earliest sample time in the segment. */
+    int64_t lastMs; /**< Latest sample time in the segment. */
+    uint8_t format; /**< SEGMENT_RAW, SEGMENT_ARCHIVE or SEGMENT_COMPACT. */
+};
+
+/**
+ * @brief Segment day of an epoch time.
+ */
+uint32_t segmentDay(int64_t epochMs);
+
+/**
+ * @brief File name of a segment, "YYYYMMDD.bin", "YYYYMMDD.gor" or "YYYYMMDD.min".
+ * @param out At least SEGMENT_NAME_LENGTH bytes.
+ */
+void segmentFileName(uint32_t day, uint8_t format, char* out);
+
+/**
+ * @brief Parse a segment file name.
+ * @return false if name is not a segment file name.
+ */
+bool parseSegmentFileName(const char* name, uint32_t& day, uint8_t& format);
+
+/**
+ * @brief Day-ordered list of segments and their time ranges.
+ */
+class SegmentIndex {
+public:
+    /**
+     * @brief Record a sample time, extending its segment or adding a new raw one.
+     * @param evicted Set to the day left out of a full index, see add().
+     * @return true if a day was evicted.
+     */
+    bool update(uint32_t day, int64_t timeMs, uint32_t& evicted);
+
+    /**
+     * @brief Add a segment found on the card, replacing an entry for the same day.
+     *
+     * A full index keeps the newest LOG_MAX_SEGMENTS days. The day left out,
+     * the oldest one or the new one if it is older still, is reported so the
+     * caller can delete its files.
+     * @param evicted Set to the day left out.
+     * @return true if a day was evicted.
+     */
+    bool add(const SegmentInfo& segment, uint32_t& evicted);
+
+    /**
+     * @brief Forget a segment.
+     */
+    void remove(uint32_t day);
+
+    /**
+     * @brief Forget all segments.
+     */
+    void clear() { total = 0; }
+
+    /**
+     * @brief Segment of a day.
+     * @return false if the day has none.
+     */
+    bool find(uint32_t day, SegmentInfo& segment) const;
+
+    /**
+     * @brief First segment at or after minDay whose range overlaps [fromMs, toMs].
+     * @return false if there is none.
+     */
+    bool findOverlapping(uint32_t minDay, int64_t fromMs, int64_t toMs, SegmentInfo& segment) const;
+
+    /**
+     * @brief Oldest segment of the given format of a day before beforeDay.
+     * @return false if there is none.
+     */
+    bool findBefore(uint32_t beforeDay, uint8_t format, SegmentInfo& segment) const;
+
+    size_t count() const { return total; } /**< Number of segments. */
+    const SegmentInfo& at(size_t i) const { return segments[i]; } /**< Segment i in day order. */
+
+private:
+    /**
+     * @brief Position of the first segment with day >= day.
+     */
+    size_t lowerBound(uint32_t day) const;
+
+    SegmentInfo segments[LOG_MAX_SEGMENTS]; /**< Segments in day order. */
+    size_t total = 0; /**< Valid entries in segments. */
+};
+
+#endif // SEGMENT_INDEX_H
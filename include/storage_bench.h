@@ -0,0 +1,82 @@
+/**
+ * @file storage_bench.h
+ * @brief On-device comparison of the SD card write paths.
+ *
+ * A one-shot low priority task writes the same amount of data to a scratch
+ * file twice: once as small appends the way the log used to be written,
+ * and once as whole 512-byte sectors into a preallocated file the way the
+ * log writer does now (see log_writer.h). Both runs flush every
+ * BENCH_FLUSH_BYTES. Throughput and the slowest single write of each run
+ * are reported in the status output, so the gain can be checked on the
+ * card actually fitted.
+ */
+
+#ifndef STORAGE_BENCH_H
+#define STORAGE_BENCH_H
+
+#include <Arduino.h>
+#include <Arduino_JSON.h>
+
+#ifndef BENCH_PATH
+#define BENCH_PATH "/data/bench.tmp" /**< Scratch file, deleted after each run. */
+#endif
+#define BENCH_DEFAULT_KB 1024 /**< Data written per run when no size is given. */
+#define BENCH_MAX_KB 16384 /**< Largest accepted run. */
+#define BENCH_APPEND_SIZE 16 /**< Write size of the append run, one log record. */
+#define BENCH_FLUSH_BYTES 4096 /**< Data between flushes in both runs. */
+
+/**
+ * @brief Result of one benchmark run.
+ */
+struct BenchResult {
+    uint32_t bytes = 0; /**< Bytes written. */
+    uint32_t micros = 0; /**< Total duration including flushes. */
+    uint32_t maxWriteMicros = 0; /**< Slowest single write or flush. */
+    bool ok = false; /**< Whether every write succeeded. */
+};
+
+/**
+ * @brief Runs the write path comparison in its own task.
+ */
+class StorageBench {
+public:
+    /**
+     * @brief Start a run in the background.
+     * @param kilobytes Data per write path, clamped to [1, BENCH_MAX_KB].
+     * @return false if a run is already in progress.
+     */
+    bool start(uint32_t kilobytes);
+
+    /**
+     * @brief Whether a run is in progress.
+     */
+    bool running() const { return active; }
+
+    /**
+     * @brief Results of the last run for the JSON status output.
+     */
+    JSONVar statusJson() const;
+
+private:
+    static void benchTask(void* param);
+
+    /**
+     * @brief Write with BENCH_APPEND_SIZE appends.
+     */
+    BenchResult runAppend();
+
+    /**
+     * @brief Write whole sectors into a preallocated file.
+     */
+    BenchResult runAligned();
+
+    volatile bool active = false; /**< Set while the task runs. */
+    uint32_t size = 0; /**< Bytes per write path of the current run. */
+    uint32_t runs = 0; /**< Completed runs. */
+    BenchResult append; /**< Last append run. */
+    BenchResult aligned; /**< Last aligned run. */
+};
+
+extern StorageBench storageBench; /**< Shared instance used by the application. */
+
+#endif // STORAGE_BENCH_H
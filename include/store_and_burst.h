@@ -0,0 +1,105 @@
+/**
+ * @file store_and_burst.h
+ * @brief Low power logging that keeps the radio off between bursts.
+ *
+ * Samples are buffered in RTC slow memory, which survives deep sleep, and
+ * the device sleeps between samples. Every BURST_INTERVAL_MIN minutes, or
+ * when the buffer is full, WiFi is brought up once to push the whole batch
+ * in a single HTTP request. Radio-on time is measured to estimate the energy
+ * spent per transmitted sample.
+ */
+
+#ifndef STORE_AND_BURST_H
+#define STORE_AND_BURST_H
+
+#include <Arduino.h>
+#include <time.h>
+
+#ifndef STORE_AND_BURST_MODE
+#define STORE_AND_BURST_MODE 0 /**< Set to 1 to buffer samples in RTC memory and upload them in bursts. */
+#endif
+#ifndef BURST_SAMPLE_INTERVAL_S
+#define BURST_SAMPLE_INTERVAL_S 60 /**< Deep sleep between two samples. */
+#endif
+#ifndef BURST_INTERVAL_MIN
+#define BURST_INTERVAL_MIN 30 /**< Time between two uploads. */
+#endif
+#ifndef BURST_UPLOAD_URL
+#define BURST_UPLOAD_URL "http://esp32-collector.local/ingest" /**< Endpoint receiving newline separated JSON records. */
+#endif
+#ifndef BURST_RADIO_CURRENT_MA
+#define BURST_RADIO_CURRENT_MA 120 /**< Average supply current with WiFi on, for the energy estimate. */
+#endif
+#ifndef BURST_SUPPLY_MV
+#define BURST_SUPPLY_MV 3300 /**< Supply voltage, for the energy estimate. */
+#endif
+
+#define BURST_BUFFER_SAMPLES 400 /**< Samples held in RTC memory. */
+
+/**
+ * @brief Compact sample kept in RTC memory.
+ */
+struct BurstSample {
+    uint32_t time; /**< Epoch seconds from the RTC. */
+    int16_t centiCelsius; /**< Temperature of the first probe in 0.01 degrees Celsius. */
+};
+
+/**
+ * @brief RTC memory sample buffer and burst bookkeeping.
+ */
+class StoreAndBurst {
+public:
+    /**
+     * @brief Whether the store-and-burst mode is compiled in.
+     */
+    bool enabled() const { return STORE_AND_BURST_MODE; }
+
+    /**
+     * @brief Append a sample, dropping the oldest one if the buffer is full.
+     */
+    void store(time_t time, float celsius);
+
+    /**
+     * @brief Whether the radio should be brought up on this wake-up.
+     * @param now Current epoch time.
+     */
+    bool burstDue(time_t now) const;
+
+    /**
+     * @brief Number of buffered samples.
+     */
+    size_t pending() const;
+
+    /**
+     * @brief Access a buffered sample, 0 being the oldest.
+     */
+    const BurstSample& sample(size_t index) const;
+
+    /**
+     * @brief Shift samples stamped before the clock was synced.
+     * @param deltaSeconds Step of the RTC clock at synchronisation.
+     */
+    void fixUpTimes(int64_t deltaSeconds);
+
+    /**
+     * @brief Record a finished burst.
+     * @param now Current epoch time.
+     * @param sent Samples delivered; they are removed from the buffer.
+     * @param radioMicros Time the radio was powered.
+     */
+    void completeBurst(time_t now, size_t sent, int64_t radioMicros);
+
+    /**
+     * @brief Estimated energy per sample of the last successful burst in millijoules.
+     */
+    float energyPerSampleMj() const;
+
+    /**
+     * @brief Sleep until the next sample is due.
+     */
+    void sleep() const;
+};
+
+extern StoreAndBurst storeAndBurst; /**< Shared instance used by the application. */
+
+#endif // STORE_AND_BURST_H
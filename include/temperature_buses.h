@@ -0,0 +1,124 @@
+/**
+ * @file temperature_buses.h
+ * @brief DS18B20 probes spread over several OneWire buses.
+ *
+ * Every bus gets its own OneWire/DallasTemperature pair. Conversions are
+ * started on all buses at once and the results are collected in a single
+ * pass, so a sweep takes one conversion time no matter how many probes
+ * are attached.
+ */
+
+#ifndef TEMPERATURE_BUSES_H
+#define TEMPERATURE_BUSES_H
+
+#include <Arduino.h>
+#include <OneWire.h>
+#include <DallasTemperature.h>
+#include <Arduino_JSON.h>
+
+#ifndef TEMP_SENSOR_PINS
+#define TEMP_SENSOR_PINS 4 /**< Comma separated GPIO pins, one OneWire bus per pin (e.g. -DTEMP_SENSOR_PINS=4,26,27; 16/17 are the RS-485 UART and 18/19/23 the SD card bus). */
+#endif
+
+#define MAX_TEMP_BUSES 4 /**< Maximum number of OneWire buses. */
+#define MAX_TEMP_PROBES 16 /**< Maximum number of probes over all buses. */
+
+#ifndef TEMP_READ_RETRIES
+#define TEMP_READ_RETRIES 2 /**< Extra scratchpad reads allowed after a failed read. */
+#endif
+#ifndef TEMP_READ_BUDGET_US
+#define TEMP_READ_BUDGET_US 60000UL /**< Time in microseconds after which a sweep stops retrying. */
+#endif
+
+/**
+ * @brief Read health counters of a single probe.
+ */
+struct ProbeStats {
+    uint32_t reads = 0; /**< Successful reads. */
+    uint32_t crcErrors = 0; /**< Scratchpads that failed the CRC check. */
+    uint32_t disconnects = 0; /**< Attempts without a presence pulse or with an all-zero scratchpad. */
+    uint32_t retries = 0; /**< Attempts beyond the first in a sweep. */
+    uint32_t failures = 0; /**< Sweeps that ended without a valid reading. */
+    uint32_t lastLatencyUs = 0; /**< Time spent on the probe in the last sweep. */
+    uint32_t maxLatencyUs = 0; /**< Worst time spent on the probe in a sweep. */
+    uint64_t totalLatencyUs = 0; /**< Sum of all sweep latencies, for the mean. */
+};
+
+/**
+ * @brief A single probe found during bus enumeration.
+ */
+struct TemperatureProbe {
+    uint8_t bus; /**< Index of the bus the probe is attached to. */
+    DeviceAddress address; /**< 64-bit ROM address of the probe. */
+    float celsius; /**< Last reading, DEVICE_DISCONNECTED_C if the read failed. */
+    ProbeStats stats; /**< Read health counters. */
+};
+
+/**
+ * @brief Owns all OneWire buses and the probes found on them.
+ */
+class TemperatureBuses {
+public:
+    /**
+     * @brief Initialise every configured bus and enumerate its probes.
+     */
+    void begin();
+
+    /**
+     * @brief Start a conversion on all buses without waiting for it.
+     */
+    void startConversions();
+
+    /**
+     * @brief Wait for the running conversion and read every probe once.
+     * @return Number of probes read.
+     */
+    size_t collectReadings();
+
+    /**
+     * @brief Number of probes found by begin().
+     */
+    size_t probeCount() const { return probeTotal; }
+
+    /**
+     * @brief Access a probe by index.
+     * @param index Probe index, 0 <= index < probeCount().
+     */
+    const TemperatureProbe& probe(size_t index) const { return probes[index]; }
+
+    /**
+     * @brief Duration of the last startConversions()/collectReadings() sweep in milliseconds.
+     */
+    unsigned long lastSweepMillis() const { return sweepMillis; }
+
+    /**
+     * @brief Bus health statistics for the JSON status output.
+     * @return Object with the sweep counters and one entry per probe.
+     */
+    JSONVar statusJson() const;
+
+private:
+    /**
+     * @brief Read one probe with bounded retries.
+     * @param probe Probe to read; its reading and statistics are updated.
+     * @param sweepStart micros() at the start of the sweep, used for the retry budget.
+     * @return true if a valid reading was obtained.
+     */
+    bool readProbe(TemperatureProbe& probe, unsigned long sweepStart);
+
+    OneWire wires[MAX_TEMP_BUSES]; /**< One OneWire instance per bus. */
+    DallasTemperature sensors[MAX_TEMP_BUSES]; /**< Dallas driver per bus. */
+    uint8_t busTotal = 0; /**< Number of buses in use. */
+    TemperatureProbe probes[MAX_TEMP_PROBES]; /**< Probes over all buses. */
+    size_t probeTotal = 0; /**< Number of valid entries in probes. */
+    unsigned long conversionStart = 0; /**< millis() when the conversion was started. */
+    unsigned long conversionMillis = 0; /**< Longest conversion time over all buses. */
+    unsigned long sweepMillis = 0; /**< Duration of the last sweep. */
+    uint32_t sweeps = 0; /**< Number of completed sweeps. */
+    uint32_t budgetExhausted = 0; /**< Sweeps in which retries were cut short by the budget. */
+    bool budgetHit = false; /**< Set when the current sweep ran out of retry budget. */
+};
+
+extern TemperatureBuses temperatureBuses; /**< Shared instance used by the application. */
+
+#endif // TEMPERATURE_BUSES_H
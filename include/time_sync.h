@@ -0,0 +1,72 @@
+/**
+ * @file time_sync.h
+ * @brief Background NTP synchronisation with retroactive record fix-up.
+ *
+ * SNTP runs in the background instead of blocking setup(). Until it has
+ * answered, records carry "uptimeMs" from the monotonic esp_timer clock and
+ * are held back from the log. Once the wall clock is known, the offset
+ * between both clocks is applied to the held records, which are then logged
+ * with their correct wall-clock time.
+ */
+
+#ifndef TIME_SYNC_H
+#define TIME_SYNC_H
+
+#include <Arduino.h>
+#include <Arduino_JSON.h>
+
+#ifndef TIME_SYNC_PENDING_RECORDS
+#define TIME_SYNC_PENDING_RECORDS 100 /**< Records held while the clock is unsynced. */
+#endif
+
+/**
+ * @brief Receives held records with their wall-clock time once it is known.
+ */
+typedef void (*RecordSink)(JSONVar& record, int64_t epochMs, uint8_t flags);
+
+/**
+ * @brief Tracks clock synchronisation and holds unsynced records.
+ */
+class TimeSync {
+public:
+    /**
+     * @brief Start SNTP in the background.
+     * @param sink Where held records go once they carry wall-clock time.
+     */
+    void begin(long gmtOffsetSec, int daylightOffsetSec, const char* server, RecordSink sink);
+
+    /**
+     * @brief Detect the first synchronisation and release held records.
+     * @return true exactly once, when synchronisation is first seen.
+     */
+    bool poll();
+
+    /**
+     * @brief Monotonic milliseconds since boot.
+     */
+    static int64_t monotonicMs();
+
+    /**
+     * @brief Keep a record stamped with "uptimeMs" until the clock is synced.
+     */
+    void hold(const String& record);
+
+    /**
+     * @brief Counters for the JSON status output.
+     */
+    JSONVar statusJson() const;
+
+private:
+    RecordSink sink = nullptr; /**< Destination of released records. */
+    bool done = false; /**< Synchronisation has been seen. */
+    int64_t offsetMs = 0; /**< Wall clock minus monotonic clock. */
+    String pending[TIME_SYNC_PENDING_RECORDS]; /**< Held records, circular. */
+    size_t pendingHead = 0; /**< Index of the oldest held record. */
+    size_t pendingCount = 0; /**< Number of held records. */
+    uint32_t dropped = 0; /**< Held records discarded because the buffer was full. */
+    uint32_t fixedUp = 0; /**< Records rewritten to wall-clock time. */
+};
+
+extern TimeSync timeSync; /**< Shared instance used by the application. */
+
+#endif // TIME_SYNC_H
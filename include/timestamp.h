@@ -0,0 +1,73 @@
+/**
+ * @file timestamp.h
+ * @brief Fast record timestamps with cached ISO 8601 formatting.
+ *
+ * Formatting a full local time with strftime for every sample is wasteful
+ * when only the seconds change. The service caches the "YYYY-MM-DDTHH:"
+ * prefix and the zone suffix for the current local hour and only writes the
+ * minute and second digits. Alternatively records carry the time as integer
+ * epoch milliseconds.
+ */
+
+#ifndef TIMESTAMP_H
+#define TIMESTAMP_H
+
+#include <Arduino.h>
+#include <Arduino_JSON.h>
+#include <time.h>
+
+#define TIMESTAMP_ISO 0 /**< "time" is an ISO 8601 string with zone offset. */
+#define TIMESTAMP_EPOCH_MS 1 /**< "time" is an integer number of milliseconds since the epoch. */
+
+#ifndef TIMESTAMP_MODE
+#define TIMESTAMP_MODE TIMESTAMP_ISO /**< Timestamp representation in records, logs and WebSocket frames. */
+#endif
+
+#define TIMESTAMP_ISO_LENGTH 25 /**< "2024-01-31T23:59:59+0100" plus terminator. */
+#define EPOCH_VALID_AFTER 1577836800LL /**< 2020-01-01, earlier clocks are treated as unsynced. */
+
+/**
+ * @brief Timestamp source and formatter for records.
+ */
+class TimestampService {
+public:
+    /**
+     * @brief Current wall-clock time in epoch milliseconds.
+     */
+    int64_t nowEpochMs() const;
+
+    /**
+     * @brief Whether the wall clock has been set.
+     */
+    bool synced() const;
+
+    /**
+     * @brief Format a time as local ISO 8601 with zone offset.
+     * @param epochMs Time in epoch milliseconds.
+     * @param out Buffer of at least TIMESTAMP_ISO_LENGTH bytes.
+     * @return Number of characters written.
+     */
+    size_t formatIso(int64_t epochMs, char* out);
+
+    /**
+     * @brief Set the "time" field of a record in the configured representation.
+     * @param record Record to stamp.
+     * @param epochMs Time in epoch milliseconds.
+     */
+    void stamp(JSONVar& record, int64_t epochMs);
+
+private:
+    /**
+     * @brief Rebuild the cached prefix and suffix for the hour containing seconds.
+     */
+    void refreshCache(time_t seconds);
+
+    time_t hourStart = 0; /**< Epoch seconds at which the cached local hour begins. */
+    bool cacheValid = false; /**< Whether prefix and zone are filled. */
+    char prefix[15]; /**< "YYYY-MM-DDTHH:" of the cached hour. */
+    char zone[6]; /**< "+hhmm" of the cached hour. */
+};
+
+extern TimestampService timestampService; /**< Shared instance used by the application. */
+
+#endif // TIMESTAMP_H
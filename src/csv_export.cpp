@@ -0,0 +1,145 @@
+/**
+ * @file csv_export.cpp
+ * @brief Chunked CSV conversion of the binary log and the rollups.
+ */
+
+#include "csv_export.h"
+#include "record_channels.h"
+
+CsvExport::CsvExport(int64_t fromMs, int64_t toMs, uint8_t exportChannel)
+    : query(fromMs, toMs, exportChannel), channel(exportChannel) {
+    char name[CHANNEL_NAME_LENGTH];
+    channelName(channel, name);
+    lineLength = snprintf(line, sizeof(line), "time,%s\n", name);
+}
+
+void CsvExport::formatRow(const LogEntry& entry) {
+#if TIMESTAMP_MODE == TIMESTAMP_EPOCH_MS
+    lineLength = snprintf(line, sizeof(line), "%lld,", (long long)entry.timeMs);
+#else
+    lineLength = formatter.formatIso(entry.timeMs, line);
+    line[lineLength++] = ',';
+#endif
+    // Failed reads are kept as empty cells so gaps stay visible
+    if (!(entry.flags & RECORD_FLAG_INVALID)) {
+        lineLength += snprintf(line + lineLength, sizeof(line) - lineLength, "%.7g", entry.value);
+    }
+    line[lineLength++] = '\n';
+    lineSent = 0;
+}
+
+size_t CsvExport::fill(uint8_t* buffer, size_t maxLen) {
+    size_t length = 0;
+    uint32_t budget = CSV_SCAN_BUDGET;
+
+    for (;;) {
+        if (lineSent < lineLength) {
+            size_t chunk = min(lineLength - lineSent, maxLen - length);
+            memcpy(buffer + length, line + lineSent, chunk);
+            lineSent += chunk;
+            length += chunk;
+            if (length == maxLen) {
+                return length;
+            }
+        }
+
+        LogEntry entry;
+        if (finished || budget == 0) {
+            break;
+        }
+        if (!query.next(entry, budget)) {
+            finished = query.finished();
+            break;
+        }
+        if (entry.channel == channel) {
+            formatRow(entry);
+        }
+    }
+
+    if (length == 0 && !finished) {
+        return CSV_TRY_AGAIN;
+    }
+    return length;
+}
+
+HistoryExport::HistoryExport(int64_t fromMs, int64_t toMs, uint8_t exportChannel, int64_t resolutionMs)
+    : tier(rollupTierFor(resolutionMs)),
+      channel(exportChannel),
+      rawQuery(fromMs, toMs, exportChannel),
+      rollupQuery(tier < 0 ? 0 : tier, fromMs, toMs, exportChannel) {
+    lineLength = snprintf(line, sizeof(line), "time,min,max,mean,count,last\n");
+}
+
+size_t HistoryExport::formatTime(int64_t timeMs) {
+#if TIMESTAMP_MODE == TIMESTAMP_EPOCH_MS
+    size_t length = snprintf(line, sizeof(line), "%lld,", (long long)timeMs);
+#else
+    size_t length = formatter.formatIso(timeMs, line);
+    line[length++] = ',';
+#endif
+    return length;
+}
+
+bool HistoryExport::nextRow() {
+    if (tier >= 0) {
+        RollupBucket bucket;
+        if (!rollupQuery.next(bucket)) {
+            return false;
+        }
+        scanned++;
+        lineLength = formatTime(bucket.startMs);
+        lineLength += snprintf(line + lineLength, sizeof(line) - lineLength, "%.7g,%.7g,%.7g,%lu,%.7g\n",
+            bucket.min, bucket.max, bucket.mean, (unsigned long)bucket.count, bucket.last);
+        lineSent = 0;
+        return true;
+    }
+
+    // Raw samples are single-sample buckets
+    LogEntry entry;
+    while (scanned < CSV_SCAN_BUDGET) {
+        uint32_t budget = CSV_SCAN_BUDGET - scanned;
+        bool found = rawQuery.next(entry, budget);
+        scanned = CSV_SCAN_BUDGET - budget;
+        if (!found) {
+            return !rawQuery.finished(); // an unfinished query used up the budget
+        }
+        if (entry.channel != channel || (entry.flags & RECORD_FLAG_INVALID)) {
+            continue;
+        }
+        lineLength = formatTime(entry.timeMs);
+        lineLength += snprintf(line + lineLength, sizeof(line) - lineLength, "%.7g,%.7g,%.7g,1,%.7g\n",
+            entry.value, entry.value, entry.value, entry.value);
+        lineSent = 0;
+        return true;
+    }
+    return true; // budget used up, lineSent == lineLength so nothing is written
+}
+
+size_t HistoryExport::fill(uint8_t* buffer, size_t maxLen) {
+    size_t length = 0;
+    scanned = 0;
+
+    for (;;) {
+        if (lineSent < lineLength) {
+            size_t chunk = min(lineLength - lineSent, maxLen - length);
+            memcpy(buffer + length, line + lineSent, chunk);
+            lineSent += chunk;
+            length += chunk;
+            if (length == maxLen) {
+                return length;
+            }
+        }
+        if (finished || scanned >= CSV_SCAN_BUDGET) {
+            break;
+        }
+        if (!nextRow()) {
+            finished = true;
+            break;
+        }
+    }
+
+    if (length == 0 && !finished) {
+        return CSV_TRY_AGAIN;
+    }
+    return length;
+}
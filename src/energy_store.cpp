@@ -0,0 +1,116 @@
+/**
+ * @file energy_store.cpp
+ * @brief RTC memory accumulators with NVS checkpoints.
+ */
+
+#include "energy_store.h"
+#include <Preferences.h>
+#include <esp_rom_crc.h>
+#include <math.h>
+
+#define ENERGY_MAGIC 0x454E5247 /**< "ENRG", marks an initialised block. */
+#define ENERGY_NAMESPACE "energy" /**< NVS namespace of the checkpoint. */
+#define ENERGY_KEY "acc" /**< NVS key of the checkpoint blob. */
+
+/**
+ * @brief Accumulator block, identical in RTC memory and NVS.
+ */
+struct EnergyBlock {
+    uint32_t magic; /**< ENERGY_MAGIC. */
+    uint32_t sequence; /**< Incremented on every update. */
+    double wh[ENERGY_CHANNEL_COUNT]; /**< Accumulated energy per channel. */
+    uint32_t crc; /**< CRC32 of the fields above. */
+};
+
+// Not initialised at boot, so it keeps its content across soft resets and deep sleep
+RTC_NOINIT_ATTR static EnergyBlock rtcEnergy;
+
+EnergyStore energyStore;
+
+/**
+ * @brief CRC32 of a block excluding its crc field.
+ */
+static uint32_t blockCrc(const EnergyBlock& block) {
+    return esp_rom_crc32_le(0, (const uint8_t*)&block, offsetof(EnergyBlock, crc));
+}
+
+/**
+ * @brief Whether a block carries the magic and a matching CRC.
+ */
+static bool blockValid(const EnergyBlock& block) {
+    return block.magic == ENERGY_MAGIC && block.crc == blockCrc(block);
+}
+
+void EnergyStore::begin() {
+    if (blockValid(rtcEnergy)) {
+        restoredFrom = "rtc";
+    } else {
+        EnergyBlock stored;
+        Preferences prefs;
+        prefs.begin(ENERGY_NAMESPACE, true);
+        size_t length = prefs.getBytes(ENERGY_KEY, &stored, sizeof(stored));
+        prefs.end();
+
+        if (length == sizeof(stored) && blockValid(stored)) {
+            rtcEnergy = stored;
+            restoredFrom = "nvs";
+        } else {
+            memset(&rtcEnergy, 0, sizeof(rtcEnergy));
+            rtcEnergy.magic = ENERGY_MAGIC;
+            rtcEnergy.crc = blockCrc(rtcEnergy);
+            restoredFrom = "none";
+        }
+    }
+
+    for (int i = 0; i < ENERGY_CHANNEL_COUNT; i++) {
+        checkpointWh[i] = rtcEnergy.wh[i];
+    }
+    lastCheckpointMillis = millis();
+    Serial.printf("Energy accumulators restored from %s\n", restoredFrom);
+}
+
+double EnergyStore::get(EnergyChannel channel) const {
+    return rtcEnergy.wh[channel];
+}
+
+void EnergyStore::set(EnergyChannel channel, double wh) {
+    rtcEnergy.wh[channel] = wh;
+    rtcEnergy.sequence++;
+    rtcEnergy.crc = blockCrc(rtcEnergy);
+}
+
+void EnergyStore::maintain() {
+    bool changed = false;
+    bool threshold = false;
+    for (int i = 0; i < ENERGY_CHANNEL_COUNT; i++) {
+        double delta = fabs(rtcEnergy.wh[i] - checkpointWh[i]);
+        changed |= delta > 0;
+        threshold |= delta >= ENERGY_CHECKPOINT_WH;
+    }
+    bool overdue = millis() - lastCheckpointMillis >= ENERGY_CHECKPOINT_MIN * 60000UL;
+    if (threshold || (changed && overdue)) {
+        checkpoint();
+    }
+}
+
+void EnergyStore::checkpoint() {
+    Preferences prefs;
+    prefs.begin(ENERGY_NAMESPACE, false);
+    prefs.putBytes(ENERGY_KEY, &rtcEnergy, sizeof(rtcEnergy));
+    prefs.end();
+
+    for (int i = 0; i < ENERGY_CHANNEL_COUNT; i++) {
+        checkpointWh[i] = rtcEnergy.wh[i];
+    }
+    lastCheckpointMillis = millis();
+    checkpoints++;
+}
+
+JSONVar EnergyStore::statusJson() const {
+    JSONVar status;
+    status["restoredFrom"] = restoredFrom;
+    status["checkpoints"] = (double)checkpoints;
+    status["sinceCheckpointS"] = (double)((millis() - lastCheckpointMillis) / 1000);
+    status["sequence"] = (double)rtcEnergy.sequence;
+    return status;
+}
@@ -0,0 +1,123 @@
+/**
+ * @file fft.cpp
+ * @brief Radix-2 real FFT using the flash twiddle table.
+ */
+
+#include "fft.h"
+#include "fft_twiddles.h"
+
+#define QUARTER (FFT_TABLE_SIZE / 4) /**< Table index of a quarter turn. */
+
+/**
+ * @brief sin(2*pi*j/FFT_TABLE_SIZE) for 0 <= j < FFT_TABLE_SIZE / 2.
+ */
+static inline float tableSin(size_t j) {
+    return j <= QUARTER ? fftQuarterSine[j] : fftQuarterSine[2 * QUARTER - j];
+}
+
+/**
+ * @brief cos(2*pi*j/FFT_TABLE_SIZE) for 0 <= j < FFT_TABLE_SIZE / 2.
+ */
+static inline float tableCos(size_t j) {
+    return j <= QUARTER ? fftQuarterSine[QUARTER - j] : -fftQuarterSine[j - QUARTER];
+}
+
+/**
+ * @brief In-place complex FFT on interleaved re/im pairs.
+ * @param data 2*m floats.
+ * @param m Number of complex points.
+ * @param stride Table step for one twiddle index at size m.
+ */
+static void complexFft(float* data, size_t m, size_t stride) {
+    // Bit-reversal permutation
+    for (size_t i = 1, j = 0; i < m; i++) {
+        size_t bit = m >> 1;
+        for (; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j) {
+            float re = data[2 * i];
+            float im = data[2 * i + 1];
+            data[2 * i] = data[2 * j];
+            data[2 * i + 1] = data[2 * j + 1];
+            data[2 * j] = re;
+            data[2 * j + 1] = im;
+        }
+    }
+
+    for (size_t length = 2; length <= m; length <<= 1) {
+        size_t half = length >> 1;
+        size_t step = stride * (m / length);
+        for (size_t k = 0; k < half; k++) {
+            // W = exp(-2*pi*i*k/length)
+            float wr = tableCos(k * step);
+            float wi = -tableSin(k * step);
+            for (size_t start = k; start < m; start += length) {
+                float* a = &data[2 * start];
+                float* b = &data[2 * (start + half)];
+                float tr = b[0] * wr - b[1] * wi;
+                float ti = b[0] * wi + b[1] * wr;
+                b[0] = a[0] - tr;
+                b[1] = a[1] - ti;
+                a[0] += tr;
+                a[1] += ti;
+            }
+        }
+    }
+}
+
+bool realFft(float* data, size_t n) {
+    if (n < 4 || n > FFT_TABLE_SIZE || (n & (n - 1)) != 0) {
+        return false;
+    }
+
+    size_t m = n / 2;
+    size_t stride = FFT_TABLE_SIZE / n; // table step for one index at size n
+    complexFft(data, m, 2 * stride);
+
+    // Split the packed spectrum Z into the spectrum X of the real input
+    float z0re = data[0];
+    float z0im = data[1];
+    data[0] = z0re + z0im;
+    data[1] = z0re - z0im;
+
+    for (size_t k = 1; k <= m / 2; k++) {
+        size_t mk = m - k;
+        float ar = data[2 * k], ai = data[2 * k + 1];
+        float br = data[2 * mk], bi = data[2 * mk + 1];
+
+        // Even part E = (Z[k] + conj(Z[m-k])) / 2, odd part O = (Z[k] - conj(Z[m-k])) / 2
+        float er = 0.5f * (ar + br), ei = 0.5f * (ai - bi);
+        float or_ = 0.5f * (ar - br), oi = 0.5f * (ai + bi);
+
+        // X[k] = E - i * W^k * O with W = exp(-2*pi*i/n)
+        float wr = tableCos(k * stride);
+        float wi = -tableSin(k * stride);
+        float tr = wr * or_ - wi * oi;
+        float ti = wr * oi + wi * or_;
+
+        data[2 * k] = er + ti;
+        data[2 * k + 1] = ei - tr;
+        if (mk != k) {
+            // X[m-k] = conj(E) - i * W^(m-k) * conj(O), with W^(m-k) = -conj(W^k)
+            data[2 * mk] = er - ti;
+            data[2 * mk + 1] = -ei - tr;
+        }
+    }
+    return true;
+}
+
+void applyHannWindow(float* data, size_t n) {
+    size_t stride = FFT_TABLE_SIZE / n;
+    for (size_t i = 0; i < n; i++) {
+        // sin^2(pi*i/n) = sin^2(2*pi*(i*stride/2)/FFT_TABLE_SIZE)
+        size_t j = i * stride / 2;
+        float s = tableSin(j);
+        if ((i * stride) & 1) {
+            // Odd half-steps fall between table entries: average the neighbours
+            s = 0.5f * (s + tableSin(j + 1));
+        }
+        data[i] *= s * s;
+    }
+}
@@ -0,0 +1,194 @@
+/**
+ * @file flash_ring.cpp
+ * @brief Raw partition ring buffer for the log without an SD card.
+ */
+
+#include "flash_ring.h"
+#include <Preferences.h>
+
+#define FLASH_RING_NAMESPACE "flashlog" /**< NVS namespace of the migration mark. */
+#define FLASH_RING_KEY "migrated" /**< NVS key of the newest migrated sequence. */
+
+FlashRing flashRing;
+
+bool FlashRing::begin() {
+    if (partition != nullptr) {
+        return true;
+    }
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)FLASH_RING_SUBTYPE,
+        FLASH_RING_LABEL);
+    if (partition == nullptr) {
+        Serial.println("No flash log partition, records are dropped without an SD card");
+        return false;
+    }
+    totalBlocks = partition->size / FLASH_RING_SECTOR_SIZE * FLASH_RING_BLOCKS_PER_SECTOR;
+
+    unsigned long start = micros();
+    locate();
+    locateMicros = micros() - start;
+    Serial.printf("Flash log: %u of %u blocks pending\n", (unsigned)stored, (unsigned)totalBlocks);
+    return true;
+}
+
+bool FlashRing::readBlock(uint32_t index, uint8_t* block) {
+    return esp_partition_read(partition, (size_t)index * RECORD_BLOCK_SIZE, block, RECORD_BLOCK_SIZE) == ESP_OK;
+}
+
+bool FlashRing::readTrailer(uint32_t index) {
+    uint8_t* trailer = scratch + RECORD_BLOCK_SLOTS * RECORD_SIZE;
+    if (esp_partition_read(partition, (size_t)index * RECORD_BLOCK_SIZE + RECORD_BLOCK_SLOTS * RECORD_SIZE,
+            trailer, RECORD_SIZE) != ESP_OK) {
+        return false;
+    }
+    for (size_t i = 0; i < RECORD_SIZE; i++) {
+        if (trailer[i] != 0xFF) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void FlashRing::locate() {
+    Preferences prefs;
+    prefs.begin(FLASH_RING_NAMESPACE, true);
+    migratedSequence = prefs.getUInt(FLASH_RING_KEY, 0);
+    prefs.end();
+    takenSequence = migratedSequence;
+
+    // A sector is erased before its first block is written, so the first
+    // blocks alone give the age of every sector
+    uint32_t sectors = totalBlocks / FLASH_RING_BLOCKS_PER_SECTOR;
+    uint32_t newest = 0;
+    uint32_t newestSector = 0;
+    uint32_t oldest = UINT32_MAX;
+    uint32_t oldestSector = 0;
+    uint8_t count;
+    for (uint32_t sector = 0; sector < sectors; sector++) {
+        uint32_t index = sector * FLASH_RING_BLOCKS_PER_SECTOR;
+        if (!readBlock(index, scratch) || !checkLogBlock(scratch, logBlockSequence(scratch), 0, count)) {
+            continue;
+        }
+        uint32_t sequence = logBlockSequence(scratch);
+        if (sequence >= newest) {
+            newest = sequence;
+            newestSector = sector;
+        }
+        if (sequence < oldest) {
+            oldest = sequence;
+            oldestSector = sector;
+        }
+    }
+    if (newest == 0) {
+        head = tail = stored = 0;
+        headSequence = migratedSequence + 1;
+        return;
+    }
+
+    // The head is the first erased block of the newest sector; a programmed
+    // block that fails its check is a torn write and is stepped over
+    headSequence = newest + 1;
+    uint32_t position = newestSector * FLASH_RING_BLOCKS_PER_SECTOR + 1;
+    uint32_t sectorEnd = (newestSector + 1) * FLASH_RING_BLOCKS_PER_SECTOR;
+    for (; position < sectorEnd && readTrailer(position); position++) {
+        if (readBlock(position, scratch) && checkLogBlock(scratch, logBlockSequence(scratch), 0, count)) {
+            headSequence = max(headSequence, logBlockSequence(scratch) + 1);
+        }
+    }
+    head = position % totalBlocks;
+    headSequence = max(headSequence, migratedSequence + 1);
+
+    // Blocks up to the migration mark are already on the card
+    tail = oldestSector * FLASH_RING_BLOCKS_PER_SECTOR;
+    stored = (head + totalBlocks - tail) % totalBlocks;
+    if (stored == 0) {
+        stored = totalBlocks; // head caught up with the oldest sector
+    }
+    while (stored > 0 && readTrailer(tail) && logBlockSequence(scratch) <= migratedSequence) {
+        tail = (tail + 1) % totalBlocks;
+        stored--;
+    }
+}
+
+bool FlashRing::append(const uint8_t* block) {
+    if (partition == nullptr) {
+        return false;
+    }
+
+    if (head % FLASH_RING_BLOCKS_PER_SECTOR == 0) {
+        // Pending blocks in the sector about to be erased are lost
+        uint32_t lost = stored + FLASH_RING_BLOCKS_PER_SECTOR > totalBlocks
+            ? stored + FLASH_RING_BLOCKS_PER_SECTOR - totalBlocks : 0;
+        if (lost > 0) {
+            tail = (head + FLASH_RING_BLOCKS_PER_SECTOR) % totalBlocks;
+            stored -= lost;
+            overwritten += lost;
+        }
+        if (esp_partition_erase_range(partition, (size_t)head * RECORD_BLOCK_SIZE, FLASH_RING_SECTOR_SIZE) != ESP_OK) {
+            writeErrors++;
+            return false;
+        }
+        erases++;
+    }
+
+    // A failed write still uses up its position; the block fails its check later
+    bool written = esp_partition_write(partition, (size_t)head * RECORD_BLOCK_SIZE, block, RECORD_BLOCK_SIZE) == ESP_OK;
+    head = (head + 1) % totalBlocks;
+    stored++;
+    headSequence = logBlockSequence(block) + 1;
+    appended++;
+    if (!written) {
+        writeErrors++;
+    }
+    return written;
+}
+
+bool FlashRing::readOldest(uint8_t* block, uint8_t& count) {
+    while (partition != nullptr && stored > 0) {
+        uint32_t index = tail;
+        tail = (tail + 1) % totalBlocks;
+        stored--;
+        if (!readBlock(index, block)) {
+            continue;
+        }
+        uint32_t sequence = logBlockSequence(block);
+        if (sequence > migratedSequence && checkLogBlock(block, sequence, 0, count)) {
+            takenSequence = max(takenSequence, sequence);
+            return true;
+        }
+    }
+    return false;
+}
+
+void FlashRing::markMigrated() {
+    if (partition == nullptr || takenSequence == migratedSequence) {
+        return;
+    }
+    migrated += takenSequence - migratedSequence;
+    migratedSequence = takenSequence;
+    Preferences prefs;
+    prefs.begin(FLASH_RING_NAMESPACE, false);
+    prefs.putUInt(FLASH_RING_KEY, migratedSequence);
+    prefs.end();
+}
+
+void FlashRing::clear() {
+    tail = head;
+    stored = 0;
+    takenSequence = headSequence - 1;
+    markMigrated();
+}
+
+JSONVar FlashRing::statusJson() const {
+    JSONVar status;
+    status["present"] = partition != nullptr;
+    status["capacityBlocks"] = (double)totalBlocks;
+    status["pendingBlocks"] = (double)stored;
+    status["nextSequence"] = (double)headSequence;
+    status["appended"] = (double)appended;
+    status["erases"] = (double)erases;
+    status["overwritten"] = (double)overwritten;
+    status["migrated"] = (double)migrated;
+    status["writeErrors"] = (double)writeErrors;
+    status["locateUs"] = (double)locateMicros;
+    return status;
+}
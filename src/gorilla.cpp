@@ -0,0 +1,242 @@
+/**
+ * @file gorilla.cpp
+ * @brief Delta-of-delta and XOR bit packing.
+ */
+
+#include "gorilla.h"
+#include <string.h>
+
+#define STREAM_BITS ((GORILLA_BLOCK_SIZE - GORILLA_HEADER_SIZE) * 8) /**< Capacity of the bit stream. */
+#define MAX_SAMPLE_BITS 90 /**< Worst case for one sample: 36 time, 43 value, 9 flags bits. */
+
+static inline uint32_t floatBits(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static inline uint8_t leadingZeros(uint32_t x) {
+    return x ? (uint8_t)__builtin_clz(x) : 32;
+}
+
+static inline uint8_t trailingZeros(uint32_t x) {
+    return x ? (uint8_t)__builtin_ctz(x) : 32;
+}
+
+void GorillaEncoder::begin(uint8_t* out, uint8_t channel) {
+    block = out;
+    memset(block, 0, GORILLA_BLOCK_SIZE);
+    block[6] = channel;
+    bitPosition = 0;
+    samples = 0;
+    lastLeading = 0xFF;
+}
+
+void GorillaEncoder::putBits(uint32_t bits, uint8_t count) {
+    uint8_t* stream = block + GORILLA_HEADER_SIZE;
+    for (int8_t i = count - 1; i >= 0; i--) {
+        if ((bits >> i) & 1) {
+            stream[bitPosition >> 3] |= 0x80 >> (bitPosition & 7);
+        }
+        bitPosition++;
+    }
+}
+
+bool GorillaEncoder::add(int64_t timeMs, float value, uint8_t flags) {
+    uint32_t valueBits = floatBits(value);
+    if (samples == 0) {
+        putLe(block + 8, (uint64_t)timeMs, 8);
+        putLe(block + 16, valueBits, 4);
+        block[7] = flags;
+        lastTime = timeMs;
+        lastDelta = 0;
+        lastValue = valueBits;
+        lastFlags = flags;
+        samples = 1;
+        return true;
+    }
+
+    int64_t delta = timeMs - lastTime;
+    int64_t dod = delta - lastDelta;
+    if (dod < INT32_MIN || dod > INT32_MAX || samples == UINT16_MAX || bitPosition + MAX_SAMPLE_BITS > STREAM_BITS) {
+        return false;
+    }
+
+    // Timestamp: buckets of the Gorilla paper with ms resolution
+    if (dod == 0) {
+        putBits(0, 1);
+    } else if (dod >= -63 && dod <= 64) {
+        putBits(0x2, 2);
+        putBits((uint32_t)(dod + 63), 7);
+    } else if (dod >= -255 && dod <= 256) {
+        putBits(0x6, 3);
+        putBits((uint32_t)(dod + 255), 9);
+    } else if (dod >= -2047 && dod <= 2048) {
+        putBits(0xE, 4);
+        putBits((uint32_t)(dod + 2047), 12);
+    } else {
+        putBits(0xF, 4);
+        putBits((uint32_t)(int32_t)dod, 32);
+    }
+
+    // Value: XOR with the previous one, reusing the last window of meaningful bits when it fits
+    uint32_t x = valueBits ^ lastValue;
+    if (x == 0) {
+        putBits(0, 1);
+    } else {
+        uint8_t leading = leadingZeros(x);
+        uint8_t trailing = trailingZeros(x);
+        if (leading > 31) {
+            leading = 31;
+        }
+        if (lastLeading != 0xFF && leading >= lastLeading && trailing >= lastTrailing) {
+            putBits(0x2, 2);
+            uint8_t width = 32 - lastLeading - lastTrailing;
+            putBits(x >> lastTrailing, width);
+        } else {
+            uint8_t width = 32 - leading - trailing;
+            putBits(0x3, 2);
+            putBits(leading, 5);
+            putBits(width - 1, 5);
+            putBits(x >> trailing, width);
+            lastLeading = leading;
+            lastTrailing = trailing;
+        }
+    }
+
+    // Flags rarely change
+    if (flags == lastFlags) {
+        putBits(0, 1);
+    } else {
+        putBits(1, 1);
+        putBits(flags, 8);
+    }
+
+    lastTime = timeMs;
+    lastDelta = delta;
+    lastValue = valueBits;
+    lastFlags = flags;
+    samples++;
+    return true;
+}
+
+void GorillaEncoder::finish() {
+    putLe(block, GORILLA_BLOCK_MAGIC, 2);
+    putLe(block + 4, samples, 2);
+    putLe(block + 2, recordCrc16(block + 4, GORILLA_BLOCK_SIZE - 4), 2);
+}
+
+bool gorillaBlockInfo(const uint8_t* block, uint8_t& channel, int64_t& firstTimeMs, uint16_t& count) {
+    if (getLe(block, 2) != GORILLA_BLOCK_MAGIC) {
+        return false;
+    }
+    count = (uint16_t)getLe(block + 4, 2);
+    channel = block[6];
+    firstTimeMs = (int64_t)getLe(block + 8, 8);
+    return true;
+}
+
+bool GorillaDecoder::open(const uint8_t* in) {
+    block = in;
+    if (!gorillaBlockInfo(block, blockChannel, firstTimeMs, samples)) {
+        return false;
+    }
+    if (getLe(block + 2, 2) != recordCrc16(block + 4, GORILLA_BLOCK_SIZE - 4)) {
+        return false;
+    }
+    bitPosition = 0;
+    decoded = 0;
+    return true;
+}
+
+uint32_t GorillaDecoder::getBits(uint8_t count) {
+    const uint8_t* stream = block + GORILLA_HEADER_SIZE;
+    uint32_t bits = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        bits = (bits << 1) | ((stream[bitPosition >> 3] >> (7 - (bitPosition & 7))) & 1);
+        bitPosition++;
+    }
+    return bits;
+}
+
+bool GorillaDecoder::next(LogEntry& entry) {
+    if (decoded >= samples) {
+        return false;
+    }
+
+    if (decoded == 0) {
+        lastTime = firstTimeMs;
+        lastDelta = 0;
+        lastValue = (uint32_t)getLe(block + 16, 4);
+        lastFlags = block[7];
+    } else {
+        int64_t dod;
+        if (getBits(1) == 0) {
+            dod = 0;
+        } else if (getBits(1) == 0) {
+            dod = (int64_t)getBits(7) - 63;
+        } else if (getBits(1) == 0) {
+            dod = (int64_t)getBits(9) - 255;
+        } else if (getBits(1) == 0) {
+            dod = (int64_t)getBits(12) - 2047;
+        } else {
+            dod = (int32_t)getBits(32);
+        }
+        lastDelta += dod;
+        lastTime += lastDelta;
+
+        if (getBits(1) == 1) {
+            if (getBits(1) == 1) {
+                lastLeading = (uint8_t)getBits(5);
+                uint8_t width = (uint8_t)getBits(5) + 1;
+                lastTrailing = 32 - lastLeading - width;
+            }
+            uint8_t width = 32 - lastLeading - lastTrailing;
+            lastValue ^= getBits(width) << lastTrailing;
+        }
+
+        if (getBits(1) == 1) {
+            lastFlags = (uint8_t)getBits(8);
+        }
+    }
+
+    entry.timeMs = lastTime;
+    memcpy(&entry.value, &lastValue, sizeof(entry.value));
+    entry.channel = blockChannel;
+    entry.flags = lastFlags;
+    decoded++;
+    return true;
+}
+
+// Header block layout: magic(4) version(2) blocks(4) samples(4) firstMs(8) lastMs(8) checksum(4) crc(2)
+void encodeArchiveHeader(const ArchiveHeader& header, uint8_t* block) {
+    memset(block, 0, GORILLA_BLOCK_SIZE);
+    putLe(block, ARCHIVE_MAGIC, 4);
+    putLe(block + 4, ARCHIVE_VERSION, 2);
+    putLe(block + 6, header.blocks, 4);
+    putLe(block + 10, header.samples, 4);
+    putLe(block + 14, (uint64_t)header.firstMs, 8);
+    putLe(block + 22, (uint64_t)header.lastMs, 8);
+    putLe(block + 30, header.checksum, 4);
+    putLe(block + 34, recordCrc16(block, 34), 2);
+}
+
+bool decodeArchiveHeader(const uint8_t* block, ArchiveHeader& header) {
+    if (getLe(block, 4) != ARCHIVE_MAGIC || getLe(block + 4, 2) != ARCHIVE_VERSION
+        || getLe(block + 34, 2) != recordCrc16(block, 34)) {
+        return false;
+    }
+    header.blocks = (uint32_t)getLe(block + 6, 4);
+    header.samples = (uint32_t)getLe(block + 10, 4);
+    header.firstMs = (int64_t)getLe(block + 14, 8);
+    header.lastMs = (int64_t)getLe(block + 22, 8);
+    header.checksum = (uint32_t)getLe(block + 30, 4);
+    return true;
+}
+
+uint32_t archiveChecksum(const LogEntry& entry) {
+    uint8_t raw[RECORD_SIZE];
+    encodeLogEntry(entry, raw);
+    // The record CRC covers time, value, channel and flags; spread it with the time
+    return (uint32_t)getLe(raw + 14, 2) * 2654435761u ^ (uint32_t)entry.timeMs;
+}
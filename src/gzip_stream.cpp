@@ -0,0 +1,249 @@
+/**
+ * @file gzip_stream.cpp
+ * @brief Fixed-Huffman deflate encoder with a gzip wrapper.
+ */
+
+#include "gzip_stream.h"
+#include "record_log.h"
+#include <string.h>
+
+#define MIN_MATCH 3 /**< Shortest match deflate can encode. */
+#define MAX_MATCH 258 /**< Longest match deflate can encode. */
+#define MIN_LOOKAHEAD (MAX_MATCH + MIN_MATCH + 1) /**< Lookahead needed before a match search. */
+#define MAX_DISTANCE (DEFLATE_WINDOW_SIZE - MIN_LOOKAHEAD) /**< Farthest match kept valid across a slide. */
+#define NO_POSITION 0xFFFF /**< Empty hash chain entry. */
+#define INSERT_LIMIT 32 /**< Longer matches do not enter their inner positions into the hash. */
+
+static const uint16_t lengthBase[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t lengthExtra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t distanceBase[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint8_t distanceExtra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+/**
+ * @brief Reverse the lowest count bits, since Huffman codes are sent MSB first.
+ */
+static uint16_t reverseBits(uint16_t code, uint8_t count) {
+    uint16_t result = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        result = (result << 1) | (code & 1);
+        code >>= 1;
+    }
+    return result;
+}
+
+/**
+ * @brief Hash of the three bytes at p.
+ */
+static inline uint16_t hash3(const uint8_t* p) {
+    return (uint16_t)(((p[0] << 10) ^ (p[1] << 5) ^ p[2]) & ((1 << DEFLATE_HASH_BITS) - 1));
+}
+
+GzipStream::GzipStream() {
+    for (size_t i = 0; i < (1 << DEFLATE_HASH_BITS); i++) {
+        head[i] = NO_POSITION;
+    }
+
+    // gzip header: magic, deflate, no flags, no mtime, no extra flags, unknown OS
+    static const uint8_t header[10] = { 0x1F, 0x8B, 8, 0, 0, 0, 0, 0, 0, 0xFF };
+    for (size_t i = 0; i < sizeof(header); i++) {
+        putByte(header[i]);
+    }
+    // A single final block with fixed Huffman codes carries the whole stream
+    putBits(1, 1);
+    putBits(1, 2);
+}
+
+size_t GzipStream::outputFree() const {
+    return GZIP_OUTPUT_SIZE - 1 - (outputTail + GZIP_OUTPUT_SIZE - outputHead) % GZIP_OUTPUT_SIZE;
+}
+
+void GzipStream::putByte(uint8_t value) {
+    output[outputTail] = value;
+    outputTail = (outputTail + 1) % GZIP_OUTPUT_SIZE;
+}
+
+void GzipStream::putBits(uint32_t bits, uint8_t count) {
+    bitBuffer |= bits << bitCount;
+    bitCount += count;
+    while (bitCount >= 8) {
+        putByte((uint8_t)bitBuffer);
+        bitBuffer >>= 8;
+        bitCount -= 8;
+    }
+}
+
+void GzipStream::putSymbol(uint16_t symbol) {
+    if (symbol < 144) {
+        putBits(reverseBits(0x30 + symbol, 8), 8);
+    } else if (symbol < 256) {
+        putBits(reverseBits(0x190 + symbol - 144, 9), 9);
+    } else if (symbol < 280) {
+        putBits(reverseBits(symbol - 256, 7), 7);
+    } else {
+        putBits(reverseBits(0xC0 + symbol - 280, 8), 8);
+    }
+}
+
+void GzipStream::putLiteral(uint8_t value) {
+    putSymbol(value);
+}
+
+void GzipStream::putMatch(uint16_t length, uint16_t distance) {
+    uint8_t code = 28;
+    while (lengthBase[code] > length) {
+        code--;
+    }
+    putSymbol(257 + code);
+    putBits(length - lengthBase[code], lengthExtra[code]);
+
+    code = 29;
+    while (distanceBase[code] > distance) {
+        code--;
+    }
+    putBits(reverseBits(code, 5), 5);
+    putBits(distance - distanceBase[code], distanceExtra[code]);
+}
+
+size_t GzipStream::inputSpace() {
+    if (end == 2 * DEFLATE_WINDOW_SIZE && pos >= DEFLATE_WINDOW_SIZE + MAX_DISTANCE) {
+        // Slide the upper half down and rebase the hash chains
+        memcpy(window, window + DEFLATE_WINDOW_SIZE, DEFLATE_WINDOW_SIZE);
+        pos -= DEFLATE_WINDOW_SIZE;
+        end -= DEFLATE_WINDOW_SIZE;
+        for (size_t i = 0; i < (1 << DEFLATE_HASH_BITS); i++) {
+            head[i] = head[i] != NO_POSITION && head[i] >= DEFLATE_WINDOW_SIZE ? head[i] - DEFLATE_WINDOW_SIZE : NO_POSITION;
+        }
+        for (size_t i = 0; i < DEFLATE_WINDOW_SIZE; i++) {
+            prev[i] = prev[i] != NO_POSITION && prev[i] >= DEFLATE_WINDOW_SIZE ? prev[i] - DEFLATE_WINDOW_SIZE : NO_POSITION;
+        }
+    }
+    return inputDone ? 0 : 2 * DEFLATE_WINDOW_SIZE - end;
+}
+
+void GzipStream::feed(const uint8_t* data, size_t length) {
+    memcpy(window + end, data, length);
+    end += length;
+    crc = recordCrc32Update(crc, data, length);
+    inputSize += length;
+}
+
+void GzipStream::insert(uint16_t p) {
+    uint16_t h = hash3(window + p);
+    prev[p & (DEFLATE_WINDOW_SIZE - 1)] = head[h];
+    head[h] = p;
+}
+
+uint16_t GzipStream::findMatch(uint16_t& distance) {
+    uint16_t available = end - pos;
+    uint16_t limit = available < MAX_MATCH ? available : MAX_MATCH;
+    if (limit < MIN_MATCH) {
+        return 0;
+    }
+
+    const uint8_t* current = window + pos;
+    uint16_t best = 0;
+    uint16_t candidate = head[hash3(current)];
+    for (uint16_t chain = 0; chain < DEFLATE_MAX_CHAIN && candidate != NO_POSITION; chain++) {
+        if (candidate >= pos || pos - candidate > MAX_DISTANCE) {
+            break;
+        }
+        const uint8_t* earlier = window + candidate;
+        if (earlier[best] == current[best]) {
+            uint16_t length = 0;
+            while (length < limit && earlier[length] == current[length]) {
+                length++;
+            }
+            if (length > best) {
+                best = length;
+                distance = pos - candidate;
+                if (length == limit) {
+                    break;
+                }
+            }
+        }
+        uint16_t next = prev[candidate & (DEFLATE_WINDOW_SIZE - 1)];
+        if (next >= candidate) {
+            break; // entry reused by a newer position
+        }
+        candidate = next;
+    }
+    return best >= MIN_MATCH ? best : 0;
+}
+
+void GzipStream::compress() {
+    // A symbol takes at most 31 bits; keep room for the trailer too
+    while (outputFree() > 16) {
+        uint16_t lookahead = end - pos;
+        if (lookahead == 0 || (lookahead < MIN_LOOKAHEAD && !inputDone)) {
+            break;
+        }
+
+        uint16_t distance = 0;
+        uint16_t length = findMatch(distance);
+        if (lookahead >= MIN_MATCH) {
+            insert(pos);
+        }
+        if (length == 0) {
+            putLiteral(window[pos]);
+            pos++;
+            continue;
+        }
+
+        putMatch(length, distance);
+        if (length <= INSERT_LIMIT) {
+            for (uint16_t i = 1; i < length; i++) {
+                if (end - (pos + i) >= MIN_MATCH) {
+                    insert(pos + i);
+                }
+            }
+        }
+        pos += length;
+    }
+
+    if (inputDone && pos == end && !trailerWritten && outputFree() > 16) {
+        writeTrailer();
+    }
+}
+
+void GzipStream::writeTrailer() {
+    putSymbol(256);
+    if (bitCount > 0) {
+        putBits(0, 8 - bitCount);
+    }
+    uint32_t value = crc ^ 0xFFFFFFFF;
+    for (uint8_t i = 0; i < 4; i++) {
+        putByte((uint8_t)(value >> (8 * i)));
+    }
+    for (uint8_t i = 0; i < 4; i++) {
+        putByte((uint8_t)(inputSize >> (8 * i)));
+    }
+    trailerWritten = true;
+}
+
+size_t GzipStream::read(uint8_t* out, size_t maxLength) {
+    size_t length = 0;
+    while (length < maxLength) {
+        if (outputHead == outputTail) {
+            compress();
+            if (outputHead == outputTail) {
+                break;
+            }
+        }
+        out[length++] = output[outputHead];
+        outputHead = (outputHead + 1) % GZIP_OUTPUT_SIZE;
+    }
+    outputTotal += length;
+    return length;
+}
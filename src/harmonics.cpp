@@ -0,0 +1,119 @@
+/**
+ * @file harmonics.cpp
+ * @brief Harmonic analysis on top of the real FFT.
+ */
+
+#include "harmonics.h"
+#include "fft.h"
+#include <math.h>
+
+#define HANN_MEAN_SQUARE 0.375f /**< Mean of w^2 for the Hann window. */
+#define MIN_FUNDAMENTAL_HZ 40.0f /**< Lowest mains frequency searched. */
+#define MAX_FUNDAMENTAL_HZ 70.0f /**< Highest mains frequency searched. */
+
+HarmonicAnalyzer::HarmonicAnalyzer(size_t fftSize, uint32_t decimation, float sampleRateHz, float scale)
+    : n(fftSize > FFT_TABLE_SIZE ? FFT_TABLE_SIZE : fftSize),
+      decimation(decimation ? decimation : 1),
+      windowRateHz(sampleRateHz / (decimation ? decimation : 1)),
+      scale(scale) {
+}
+
+uint32_t HarmonicAnalyzer::windowMicros() const {
+    return (uint32_t)(n * 1e6f / windowRateHz);
+}
+
+void HarmonicAnalyzer::add(uint16_t sample) {
+    decimateSum += sample;
+    if (++decimateCount < decimation) {
+        return;
+    }
+    buffers[filling][fillCount++] = (float)decimateSum / decimation;
+    decimateSum = 0;
+    decimateCount = 0;
+
+    if (fillCount < n) {
+        return;
+    }
+    fillCount = 0;
+    if (readyBuffer.load(std::memory_order_acquire) < 0) {
+        readyBuffer.store(filling, std::memory_order_release);
+        filling ^= 1;
+    }
+    // Otherwise the previous window is still waiting and this one is overwritten
+}
+
+/**
+ * @brief Power summed over the Hann main lobe around a fractional bin.
+ */
+static float lobePower(const float* spectrum, size_t n, float bin) {
+    long centre = lroundf(bin);
+    float sum = 0;
+    for (long k = centre - 1; k <= centre + 1; k++) {
+        if (k <= 0 || k >= (long)(n / 2)) {
+            continue;
+        }
+        sum += spectrum[2 * k] * spectrum[2 * k] + spectrum[2 * k + 1] * spectrum[2 * k + 1];
+    }
+    return sum;
+}
+
+bool HarmonicAnalyzer::analyze(HarmonicResult& result) {
+    int index = readyBuffer.load(std::memory_order_acquire);
+    if (index < 0) {
+        return false;
+    }
+    float* data = buffers[index];
+
+    float mean = 0;
+    for (size_t i = 0; i < n; i++) {
+        mean += data[i];
+    }
+    mean /= n;
+    for (size_t i = 0; i < n; i++) {
+        data[i] -= mean;
+    }
+    applyHannWindow(data, n);
+    realFft(data, n);
+
+    // Fundamental: strongest bin in the mains band, refined by the lobe centroid
+    float binHz = windowRateHz / n;
+    size_t first = (size_t)(MIN_FUNDAMENTAL_HZ / binHz);
+    size_t last = (size_t)(MAX_FUNDAMENTAL_HZ / binHz) + 1;
+    size_t peak = first > 0 ? first : 1;
+    float peakPower = 0;
+    for (size_t k = peak; k <= last && k < n / 2; k++) {
+        float power = data[2 * k] * data[2 * k] + data[2 * k + 1] * data[2 * k + 1];
+        if (power > peakPower) {
+            peakPower = power;
+            peak = k;
+        }
+    }
+    float weighted = 0;
+    float total = 0;
+    for (size_t k = peak - 1; k <= peak + 1 && k < n / 2; k++) {
+        float magnitude = sqrtf(data[2 * k] * data[2 * k] + data[2 * k + 1] * data[2 * k + 1]);
+        weighted += magnitude * k;
+        total += magnitude;
+    }
+    float fundamentalBin = total > 0 ? weighted / total : peak;
+
+    // RMS from lobe power: sqrt(2 * sum|X|^2) / (n * sqrt(mean w^2))
+    float norm = 1.0f / (n * sqrtf(HANN_MEAN_SQUARE));
+    float fundamental = sqrtf(2 * lobePower(data, n, fundamentalBin)) * norm;
+    float distortion = 0;
+
+    result.fundamentalHz = fundamentalBin * binHz;
+    result.fundamentalRms = fundamental * scale;
+    for (int h = 0; h < HARMONIC_COUNT; h++) {
+        float bin = fundamentalBin * (h + 1);
+        float rms = bin + 1 < n / 2 ? sqrtf(2 * lobePower(data, n, bin)) * norm : 0;
+        result.magnitudes[h] = fundamental > 0 ? rms / fundamental : 0;
+        if (h > 0) {
+            distortion += rms * rms;
+        }
+    }
+    result.thd = fundamental > 0 ? sqrtf(distortion) / fundamental : 0;
+
+    readyBuffer.store(-1, std::memory_order_release);
+    return true;
+}
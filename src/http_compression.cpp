@@ -0,0 +1,139 @@
+/**
+ * @file http_compression.cpp
+ * @brief Streaming gzip for chunked web server responses.
+ */
+
+#include "http_compression.h"
+#include "gzip_stream.h"
+#include <memory>
+#include <new>
+
+#define GZIP_SOURCE_CHUNK 256 /**< Uncompressed bytes requested from the source at a time. */
+#define GZIP_SOURCE_CALLS 16 /**< Source calls per filler call, bounds the time spent on well compressing data. */
+
+HttpCompression httpCompression;
+
+/**
+ * @brief Per-response compressor state, freed with the response.
+ */
+struct GzipFillerState {
+    ~GzipFillerState() { httpCompression.streamEnded(); }
+
+    GzipStream stream; /**< Compressor. */
+    AwsResponseFiller source; /**< Uncompressed body. */
+    size_t sourceIndex = 0; /**< Uncompressed bytes produced so far. */
+    uint8_t plain[GZIP_SOURCE_CHUNK]; /**< Staging buffer for source output. */
+    size_t plainLength = 0; /**< Bytes in plain. */
+    size_t plainOffset = 0; /**< Bytes of plain already fed to the compressor. */
+};
+
+bool HttpCompression::accepts(AsyncWebServerRequest* request) const {
+#if HTTP_GZIP_ENABLED
+    if (!request->hasHeader("Accept-Encoding")) {
+        return false;
+    }
+    return request->getHeader("Accept-Encoding")->value().indexOf("gzip") >= 0;
+#else
+    return false;
+#endif
+}
+
+AwsResponseFiller HttpCompression::gzipFiller(AwsResponseFiller source) {
+    if (activeStreams >= HTTP_GZIP_MAX_STREAMS || ESP.getFreeHeap() < sizeof(GzipFillerState) + HTTP_GZIP_HEAP_RESERVE) {
+        return AwsResponseFiller();
+    }
+    GzipFillerState* allocated = new (std::nothrow) GzipFillerState;
+    if (allocated == nullptr) {
+        return AwsResponseFiller();
+    }
+    activeStreams++; // until the response, and with it the state, is freed
+    std::shared_ptr<GzipFillerState> state(allocated);
+    state->source = source;
+    streams++;
+
+    return [this, state](uint8_t* buffer, size_t maxLen, size_t index) -> size_t {
+        size_t length = 0;
+        bool waiting = false;
+        uint32_t spent = 0;
+        uint8_t calls = 0;
+
+        while (length < maxLen) {
+            unsigned long start = micros();
+            size_t compressed = state->stream.read(buffer + length, maxLen - length);
+            spent += micros() - start;
+            length += compressed;
+            if (compressed > 0) {
+                continue;
+            }
+            if (state->stream.complete()) {
+                break;
+            }
+
+            // Sources get a full staging buffer, the compressor takes what fits
+            if (state->plainOffset == state->plainLength) {
+                if (calls++ == GZIP_SOURCE_CALLS) {
+                    waiting = true;
+                    break;
+                }
+                size_t produced = state->source(state->plain, sizeof(state->plain), state->sourceIndex);
+                if (produced == RESPONSE_TRY_AGAIN) {
+                    waiting = true;
+                    break;
+                }
+                if (produced == 0) {
+                    state->stream.finish();
+                    continue;
+                }
+                state->plainLength = produced;
+                state->plainOffset = 0;
+                state->sourceIndex += produced;
+                bytesIn += produced;
+            }
+
+            start = micros();
+            size_t fed = min(state->stream.inputSpace(), state->plainLength - state->plainOffset);
+            state->stream.feed(state->plain + state->plainOffset, fed);
+            state->plainOffset += fed;
+            spent += micros() - start;
+        }
+
+        compressMicros += spent;
+        bytesOut += length;
+        if (length == 0 && waiting) {
+            return RESPONSE_TRY_AGAIN;
+        }
+        return length;
+    };
+}
+
+AsyncWebServerResponse* HttpCompression::beginResponse(AsyncWebServerRequest* request, const char* contentType, AwsResponseFiller source) {
+    if (!accepts(request)) {
+        return request->beginChunkedResponse(contentType, source);
+    }
+    AwsResponseFiller filler = gzipFiller(source);
+    if (!filler) {
+        fallbacks++;
+        return request->beginChunkedResponse(contentType, source);
+    }
+    AsyncWebServerResponse* response = request->beginChunkedResponse(contentType, filler);
+    response->addHeader("Content-Encoding", "gzip");
+    response->addHeader("Vary", "Accept-Encoding");
+    return response;
+}
+
+JSONVar HttpCompression::statusJson() const {
+    JSONVar status;
+    status["enabled"] = (bool)HTTP_GZIP_ENABLED;
+    status["windowBytes"] = DEFLATE_WINDOW_SIZE;
+    status["stateBytes"] = (double)sizeof(GzipFillerState);
+    status["streams"] = (double)streams;
+    status["activeStreams"] = activeStreams;
+    status["maxStreams"] = HTTP_GZIP_MAX_STREAMS;
+    status["fallbacks"] = (double)fallbacks;
+    status["bytesIn"] = (double)bytesIn;
+    status["bytesOut"] = (double)bytesOut;
+    status["ratio"] = bytesOut ? (double)bytesIn / bytesOut : 0.0;
+    // CPU cost of the compressor alone, log reading and CSV conversion excluded
+    status["usPerKB"] = bytesIn ? (double)compressMicros * 1024 / bytesIn : 0.0;
+    return status;
+}
@@ -0,0 +1,249 @@
+/**
+ * @file log_query.cpp
+ * @brief Segment-by-segment range reader.
+ */
+
+#include "log_query.h"
+#include "log_writer.h"
+
+LogQuery::LogQuery(int64_t from, int64_t to, int16_t channel) : fromMs(from), toMs(to), channelHint(channel) {}
+
+LogQuery::~LogQuery() {
+    closeSegment();
+}
+
+void LogQuery::closeSegment() {
+    if (file) {
+        file.close();
+    }
+    if (holding) {
+        logWriter.releaseSegment(heldDay);
+        holding = false;
+    }
+}
+
+bool LogQuery::openNextSegment() {
+    closeSegment();
+
+    SegmentInfo segment;
+    uint32_t retryDay = UINT32_MAX;
+    while (logWriter.findSegment(nextDay, fromMs, toMs, segment) && segment.day <= lastDay) {
+        if (!logWriter.acquireSegment(segment)) {
+            // Replaced or dropped since the lookup: look the day up once more, then move on
+            if (segment.day != retryDay) {
+                retryDay = segment.day;
+                continue;
+            }
+            nextDay = segment.day + 1;
+            continue;
+        }
+        holding = true;
+        heldDay = segment.day;
+        nextDay = segment.day + 1;
+        format = segment.format;
+        file = SD.open(logWriter.segmentPath(segment.day, segment.format), FILE_READ);
+        if (!file) {
+            closeSegment();
+            continue;
+        }
+
+        if (format == SEGMENT_ARCHIVE) {
+            ArchiveHeader header;
+            if (file.read(block, GORILLA_BLOCK_SIZE) != GORILLA_BLOCK_SIZE || !decodeArchiveHeader(block, header)) {
+                closeSegment();
+                continue;
+            }
+            blockCount = header.blocks;
+            blockIndex = 0;
+            decoding = false;
+        } else if (format == SEGMENT_COMPACT) {
+            RollupSegmentHeader header;
+            if (file.read(block, ROLLUP_RECORD_SIZE) != ROLLUP_RECORD_SIZE || !decodeRollupSegmentHeader(block, header)) {
+                closeSegment();
+                continue;
+            }
+            bucketCount = header.buckets;
+            position = 0;
+        } else {
+            if (!reader.open(readLogFile, &file, file.size())) {
+                closeSegment();
+                continue;
+            }
+            position = segment.firstMs >= fromMs ? 0 : reader.lowerBound(fromMs);
+        }
+        opened++;
+        return true;
+    }
+    done = true;
+    return false;
+}
+
+bool LogQuery::spend() {
+    if (budget == 0) {
+        return false;
+    }
+    if (budget != LOG_QUERY_UNLIMITED) {
+        budget--;
+    }
+    return true;
+}
+
+bool LogQuery::nextRaw(LogEntry& entry) {
+    while (position < reader.count()) {
+        if (!spend()) {
+            return false;
+        }
+        if (reader.read(position++, entry)) {
+            return true;
+        }
+        corrupt++;
+    }
+    return false;
+}
+
+bool LogQuery::loadNextBlock() {
+    uint8_t header[GORILLA_HEADER_SIZE];
+    while (blockIndex < blockCount) {
+        if (!spend()) {
+            return false;
+        }
+        uint64_t offset = (uint64_t)(blockIndex + 1) * GORILLA_BLOCK_SIZE;
+        blockIndex++;
+
+        uint8_t blockChannel;
+        int64_t firstTime;
+        uint16_t count;
+        if (readLogFile(&file, offset, header, sizeof(header)) != sizeof(header)
+            || !gorillaBlockInfo(header, blockChannel, firstTime, count)) {
+            corrupt++;
+            continue;
+        }
+        if ((channelHint != LOG_QUERY_ALL_CHANNELS && blockChannel != channelHint) || firstTime > toMs) {
+            continue;
+        }
+
+        // Blocks of a channel follow each other in time order, so a block whose
+        // successor starts before the range holds nothing of interest
+        uint8_t nextChannel;
+        int64_t nextFirstTime;
+        uint16_t nextCount;
+        if (blockIndex < blockCount
+            && readLogFile(&file, offset + GORILLA_BLOCK_SIZE, header, sizeof(header)) == sizeof(header)
+            && gorillaBlockInfo(header, nextChannel, nextFirstTime, nextCount)
+            && nextChannel == blockChannel && nextFirstTime < fromMs) {
+            continue;
+        }
+
+        if (readLogFile(&file, offset, block, GORILLA_BLOCK_SIZE) != GORILLA_BLOCK_SIZE || !decoder.open(block)) {
+            corrupt++;
+            continue;
+        }
+        return true;
+    }
+    return false;
+}
+
+bool LogQuery::nextArchived(LogEntry& entry) {
+    for (;;) {
+        if (decoding) {
+            if (!spend()) {
+                return false;
+            }
+            if (decoder.next(entry)) {
+                if (entry.timeMs > toMs) {
+                    decoding = false; // rest of the block is past the range
+                    continue;
+                }
+                return true;
+            }
+        }
+        decoding = loadNextBlock();
+        if (!decoding) {
+            return false;
+        }
+    }
+}
+
+bool LogQuery::nextCompact(LogEntry& entry) {
+    while (position < bucketCount) {
+        if (!spend()) {
+            return false;
+        }
+        size_t slot = (size_t)(position % LOG_QUERY_COMPACT_BUCKETS);
+        if (slot == 0) {
+            uint64_t remaining = bucketCount - position;
+            size_t length = (remaining < LOG_QUERY_COMPACT_BUCKETS ? (size_t)remaining : LOG_QUERY_COMPACT_BUCKETS) * ROLLUP_RECORD_SIZE;
+            if (readLogFile(&file, (position + 1) * ROLLUP_RECORD_SIZE, block, length) != length) {
+                corrupt += (uint32_t)remaining;
+                position = bucketCount;
+                return false;
+            }
+        }
+        position++;
+
+        RollupBucket bucket;
+        if (!decodeRollupBucket(block + slot * ROLLUP_RECORD_SIZE, bucket)) {
+            corrupt++;
+            continue;
+        }
+        if (channelHint != LOG_QUERY_ALL_CHANNELS && bucket.channel != channelHint) {
+            continue;
+        }
+        entry.timeMs = bucket.startMs;
+        entry.value = bucket.mean;
+        entry.channel = bucket.channel;
+        entry.flags = RECORD_FLAG_DOWNSAMPLED;
+        return true;
+    }
+    return false;
+}
+
+void LogQuery::limitDays(uint32_t firstDay, uint32_t last) {
+    nextDay = firstDay;
+    lastDay = last;
+}
+
+bool LogQuery::next(LogEntry& entry) {
+    uint32_t unlimited = LOG_QUERY_UNLIMITED;
+    return next(entry, unlimited);
+}
+
+bool LogQuery::next(LogEntry& entry, uint32_t& scanBudget) {
+    budget = scanBudget;
+    bool found = scan(entry);
+    scanBudget = budget;
+    return found;
+}
+
+bool LogQuery::scan(LogEntry& entry) {
+    while (!done) {
+        bool found = false;
+        if (file && format == SEGMENT_ARCHIVE) {
+            found = nextArchived(entry);
+        } else if (file && format == SEGMENT_COMPACT) {
+            found = nextCompact(entry);
+        } else if (file) {
+            found = nextRaw(entry);
+        }
+        if (!found) {
+            if (budget == 0) {
+                return false; // the segment is resumed on the next call
+            }
+            openNextSegment();
+            continue;
+        }
+
+        if (entry.timeMs < fromMs) {
+            continue;
+        }
+        if (entry.timeMs > toMs) {
+            if (format == SEGMENT_RAW) {
+                // Raw segments are in time order; the rest of this one is past the range
+                position = reader.count();
+            }
+            continue;
+        }
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,914 @@
+/**
+ * @file log_writer.cpp
+ * @brief Queue-fed SD log writer task and segment rotation.
+ */
+
+#include "log_writer.h"
+#include "record_log.h"
+#include "timestamp.h"
+#include "gorilla.h"
+#include "rollup_store.h"
+#include "flash_ring.h"
+#include <unistd.h>
+
+LogWriter logWriter;
+static RecordLogReader recoveryReader; // used by the writer with the lock held, kept off its stack
+
+size_t readLogFile(void* context, uint64_t offset, uint8_t* buffer, size_t length) {
+    File* file = (File*)context;
+    if (!file->seek(offset)) {
+        return 0;
+    }
+    return file->read(buffer, length);
+}
+
+bool LogWriter::begin(const char* directory) {
+    if (!SD.exists(directory) && !SD.mkdir(directory)) {
+        Serial.println("Failed to create the log directory on the SD card");
+        return false;
+    }
+    startTask();
+
+    xSemaphoreTakeRecursive(lock, portMAX_DELAY);
+    writeBuffer(false); // blocks collected so far belong to the flash ring
+    path = directory;
+    rebuildIndex();
+    onCard = true;
+    switchPending = true;
+    xSemaphoreGiveRecursive(lock);
+    return true;
+}
+
+bool LogWriter::beginFallback() {
+    startTask();
+    return flashRing.ready();
+}
+
+void LogWriter::startTask() {
+    if (queue != nullptr) {
+        return;
+    }
+    flashRing.begin();
+    nextSequence = flashRing.nextSequence();
+    journalId = 0; // flash ring blocks are not bound to a file
+    queue = xQueueCreate(LOG_QUEUE_DEPTH, sizeof(LogRecord));
+    lock = xSemaphoreCreateRecursiveMutex();
+    syncDone = xSemaphoreCreateBinary();
+    // The rollup replay runs a LogQuery of about 1.3 KB on this stack
+    xTaskCreatePinnedToCore(writerTask, "sdlog", 6144, this, 1, nullptr, 0);
+}
+
+void LogWriter::migrateFlash() {
+    static uint8_t block[RECORD_BLOCK_SIZE]; // only used with the lock held
+    uint8_t count;
+    while (flashRing.readOldest(block, count)) {
+        for (uint8_t slot = 0; slot < count; slot++) {
+            const uint8_t* raw = block + slot * RECORD_SIZE;
+            LogEntry entry;
+            if (!decodeLogEntry(raw, entry)) {
+                continue;
+            }
+            uint32_t day = segmentDay(entry.timeMs);
+            if (!file || day > fileDay) {
+                openSegment(writableDay(day));
+            }
+            extendSegment(entry.timeMs);
+            bufferEntry(raw);
+            migratedRecords++;
+        }
+    }
+    writeBuffer(false);
+    if (file) {
+        file.flush();
+    }
+    // A power loss before this point copies the blocks again
+    flashRing.markMigrated();
+}
+
+uint32_t LogWriter::writableDay(uint32_t day) const {
+    // Only past days are archived or compacted, so this ends at today at the latest
+    SegmentInfo segment;
+    while ((index.find(day, segment) && segment.format != SEGMENT_RAW) || clearing(day)) {
+        day++;
+    }
+    return day;
+}
+
+void LogWriter::finishSwitch() {
+    if (!switchPending) {
+        return;
+    }
+    switchPending = false;
+    if (flashRing.pending() > 0) {
+        migrateFlash();
+    }
+    // Restore the open rollup buckets before new records arrive at them; the
+    // lock is recursive because the replay reads the log through the segment index
+    int64_t newestDayMs = index.count() > 0 ? (int64_t)index.at(index.count() - 1).day * SEGMENT_DAY_MS : INT64_MAX;
+    rollupStore.replay(newestDayMs);
+}
+
+String LogWriter::segmentPath(uint32_t day, uint8_t format) const {
+    char name[SEGMENT_NAME_LENGTH];
+    segmentFileName(day, format, name);
+    return path + "/" + name;
+}
+
+void LogWriter::rebuildIndex() {
+    index.clear();
+    File dir = SD.open(path);
+    if (!dir) {
+        return;
+    }
+
+    // Only the header and the ends of each segment are read
+    for (File entry = dir.openNextFile(); entry; entry = dir.openNextFile()) {
+        uint32_t day;
+        uint8_t format;
+        if (entry.isDirectory() || !parseSegmentFileName(entry.name(), day, format)) {
+            String name = entry.name();
+            if (name.endsWith(".tmp")) {
+                String stale = path + "/" + name;
+                String target = stale.substring(0, stale.length() - 4);
+                entry.close();
+                if (parseSegmentFileName(name.substring(0, name.length() - 4).c_str(), day, format)
+                    && format == SEGMENT_RAW && !SD.exists(target)) {
+                    // Complete conversion whose swap was interrupted
+                    SD.rename(stale, target);
+                    rebuildIndex();
+                    return;
+                }
+                // Unfinished archive or conversion from an interrupted run
+                SD.remove(stale);
+            }
+            continue;
+        }
+
+        if (format != SEGMENT_COMPACT && SD.exists(segmentPath(day, SEGMENT_COMPACT))) {
+            // Compacted but not yet removed when power was lost
+            entry.close();
+            SD.remove(segmentPath(day, format));
+            continue;
+        }
+        if (format == SEGMENT_COMPACT) {
+            uint8_t raw[ROLLUP_RECORD_SIZE];
+            RollupSegmentHeader header;
+            if (entry.read(raw, sizeof(raw)) == sizeof(raw) && decodeRollupSegmentHeader(raw, header)) {
+                SegmentInfo segment = { day, header.firstMs, header.lastMs, SEGMENT_COMPACT };
+                addSegment(segment);
+            }
+            continue;
+        }
+        if (format == SEGMENT_ARCHIVE) {
+            uint8_t block[GORILLA_BLOCK_SIZE];
+            ArchiveHeader header;
+            if (entry.read(block, sizeof(block)) == sizeof(block) && decodeArchiveHeader(block, header)) {
+                SegmentInfo segment = { day, header.firstMs, header.lastMs, SEGMENT_ARCHIVE };
+                addSegment(segment);
+            }
+            continue;
+        }
+        if (SD.exists(segmentPath(day, SEGMENT_ARCHIVE))) {
+            // Archived but not yet removed when power was lost
+            entry.close();
+            SD.remove(segmentPath(day));
+            continue;
+        }
+
+        RecordLogReader reader;
+        if (!reader.open(readLogFile, &entry, entry.size())) {
+            continue;
+        }
+
+        SegmentInfo segment = { day, 0, 0, SEGMENT_RAW };
+        LogEntry first;
+        LogEntry last;
+        uint64_t i = 0;
+        while (i < reader.count() && !reader.read(i, first)) {
+            i++;
+        }
+        uint64_t j = reader.count();
+        while (j > i && !reader.read(j - 1, last)) {
+            j--;
+        }
+        if (j <= i) {
+            continue;
+        }
+        segment.firstMs = first.timeMs < last.timeMs ? first.timeMs : last.timeMs;
+        segment.lastMs = first.timeMs < last.timeMs ? last.timeMs : first.timeMs;
+        addSegment(segment);
+    }
+    Serial.printf("Log: %u segment(s) in %s\n", (unsigned)index.count(), path.c_str());
+}
+
+bool LogWriter::append(const char* data, size_t length, int64_t timeMs) {
+    if (queue == nullptr || length > LOG_RECORD_MAX) {
+        dropped++;
+        return false;
+    }
+
+    static LogRecord record; // only the loop task produces records
+    record.timeMs = timeMs;
+    record.length = length;
+    memcpy(record.data, data, length);
+
+#if LOG_OVERFLOW_POLICY == LOG_OVERFLOW_BLOCK
+    if (xQueueSend(queue, &record, pdMS_TO_TICKS(LOG_BLOCK_TIMEOUT_MS)) != pdTRUE) {
+        dropped++;
+        return false;
+    }
+#else
+    while (xQueueSend(queue, &record, 0) != pdTRUE) {
+        static LogRecord discarded;
+        if (xQueueReceive(queue, &discarded, 0) == pdTRUE && discarded.length != LOG_SYNC_REQUEST) {
+            dropped++;
+        }
+    }
+#endif
+
+    records++;
+    maxQueueDepth = max(maxQueueDepth, (uint32_t)uxQueueMessagesWaiting(queue));
+    return true;
+}
+
+bool extendLogFile(File& file, uint64_t size) {
+    // Seeking past the end of a file open for writing makes FatFS allocate
+    // the clusters; only the last byte is written, the rest keeps whatever
+    // the card held, which journal readers reject
+    uint8_t last = 0xFF;
+    if (!file.seek(size - 1) || file.write(&last, 1) != 1) {
+        return false;
+    }
+    file.flush();
+    return true;
+}
+
+void LogWriter::startJournal() {
+    uint8_t* block = buffer; // the buffer is empty whenever a segment is opened
+    memset(block, 0, LOG_SECTOR_SIZE);
+    journalId = esp_random();
+    encodeLogHeader(makeLogHeader(timestampService.nowEpochMs(), RECORD_BLOCK_SIZE, journalId), block);
+    file.write(block, LOG_SECTOR_SIZE);
+    file.flush();
+    nextSequence = 0;
+    logicalEnd = LOG_SECTOR_SIZE;
+    allocatedEnd = LOG_SECTOR_SIZE;
+}
+
+void LogWriter::convertSegment(File& flat, const String& segment) {
+    String temp = segment + ".tmp";
+    file = SD.open(temp, "w+");
+    if (!file || !recoveryReader.open(readLogFile, &flat, flat.size())) {
+        flat.close();
+        return;
+    }
+    startJournal();
+
+    // Unreadable records are dropped; they would never be served anyway
+    LogEntry entry;
+    uint8_t raw[RECORD_SIZE];
+    for (uint64_t i = 0; i < recoveryReader.count(); i++) {
+        if (recoveryReader.read(i, entry)) {
+            encodeLogEntry(entry, raw);
+            bufferEntry(raw);
+        }
+    }
+    writeBuffer(false);
+    file.close();
+    flat.close();
+
+    // An interrupted swap is finished by rebuildIndex()
+    SD.remove(segment);
+    SD.rename(temp, segment);
+    file = SD.open(segment, LOG_OPEN_UPDATE);
+    convertedSegments++;
+}
+
+void LogWriter::prepareSegment() {
+    unsigned long start = micros();
+    String segment = segmentPath(fileDay);
+    File existing = SD.exists(segment) ? SD.open(segment, LOG_OPEN_UPDATE) : File();
+    size_t size = existing ? existing.size() : 0;
+    uint8_t* block = buffer; // the buffer is empty whenever a segment is opened
+
+    LogHeader header;
+    bool readable = existing && existing.read(block, RECORD_LOG_HEADER_SIZE) == RECORD_LOG_HEADER_SIZE
+        && decodeLogHeader(block, header);
+    if (readable && header.version == RECORD_LOG_VERSION_JOURNAL && size < LOG_SECTOR_SIZE) {
+        readable = false; // header block cut short on creation
+    }
+    if (readable && header.version == RECORD_LOG_VERSION_FLAT) {
+        // Written by an older firmware; appending needs the journal layout
+        convertSegment(existing, segment);
+        return;
+    }
+    if (existing && !readable) {
+        // Either a header cut short on creation or a foreign file, which is kept aside
+        existing.close();
+        if (size > LOG_SECTOR_SIZE) {
+            SD.rename(segment, segment + ".bad");
+        } else {
+            SD.remove(segment);
+        }
+    }
+
+    if (readable) {
+        // The reader finds the logical end by binary search; writing resumes
+        // there, over a torn block or into the preallocated space
+        recoveryReader.open(readLogFile, &existing, size);
+        file = existing;
+        journalId = header.journalId;
+        nextSequence = recoveryReader.count() / RECORD_BLOCK_SLOTS;
+        logicalEnd = LOG_SECTOR_SIZE + (uint64_t)nextSequence * LOG_SECTOR_SIZE;
+        allocatedEnd = size;
+
+        // A partly filled last block becomes the open block again and keeps filling in place
+        uint8_t count;
+        if (nextSequence > 0
+            && readLogFile(&file, logicalEnd - LOG_SECTOR_SIZE, block, LOG_SECTOR_SIZE) == LOG_SECTOR_SIZE
+            && checkLogBlock(block, nextSequence - 1, journalId, count) && count < RECORD_BLOCK_SLOTS) {
+            nextSequence--;
+            logicalEnd -= LOG_SECTOR_SIZE;
+            blockFill = count;
+            flushedFill = count;
+        }
+    } else {
+        file = SD.open(segment, "w+");
+        if (!file) {
+            return;
+        }
+        startJournal();
+    }
+
+    lastRecoveryMicros = micros() - start;
+    maxRecoveryMicros = max(maxRecoveryMicros, lastRecoveryMicros);
+}
+
+void LogWriter::closeSegment() {
+    writeBuffer(false);
+    if (buffered() > 0) {
+        // Blocks the card refused cannot follow into another segment
+        dropped += sealed / LOG_SECTOR_SIZE * RECORD_BLOCK_SLOTS + blockFill - flushedFill;
+    }
+    // A partly filled block on the card ends the segment; the next one starts its own
+    uint64_t end = logicalEnd + (flushedFill > 0 ? LOG_SECTOR_SIZE : 0);
+    sealed = 0;
+    blockFill = 0;
+    flushedFill = 0;
+    if (!file) {
+        return;
+    }
+    file.close();
+    if (allocatedEnd > end) {
+        // Give back the unused part of the last extent
+        String vfsPath = String(LOG_SD_MOUNT) + segmentPath(fileDay);
+        if (truncate(vfsPath.c_str(), (off_t)end) == 0) {
+            trims++;
+        }
+    }
+}
+
+void LogWriter::reserve(uint64_t end) {
+    if (end <= allocatedEnd) {
+        return;
+    }
+    // Whole extents, so the cluster allocation happens rarely and in one go
+    uint64_t target = (end + LOG_PREALLOC_BYTES - 1) / LOG_PREALLOC_BYTES * LOG_PREALLOC_BYTES;
+    unsigned long start = micros();
+    if (extendLogFile(file, target)) {
+        allocatedEnd = target;
+        preallocations++;
+    }
+    lastPreallocMicros = micros() - start;
+    maxPreallocMicros = max(maxPreallocMicros, lastPreallocMicros);
+}
+
+void LogWriter::openSegment(uint32_t day) {
+    closeSegment();
+    fileDay = day;
+    prepareSegment();
+    if (!file) {
+        Serial.println("Failed to open file on SD card for writing");
+        return;
+    }
+    rotations++;
+}
+
+bool LogWriter::writeBuffer(bool wholeSectorsOnly) {
+    size_t open = 0;
+    if (!wholeSectorsOnly && blockFill > flushedFill) {
+        if (onCard) {
+            // The open block goes out under its own sequence number and is
+            // rewritten at the same offset as it fills; sealing only touches
+            // its unused slots and trailer, which later records overwrite
+            sealLogBlock(buffer + sealed, nextSequence, blockFill, journalId);
+            open = LOG_SECTOR_SIZE;
+        } else {
+            // Flash ring sectors are never rewritten; the next record starts a new block
+            sealLogBlock(buffer + sealed, nextSequence++, blockFill, journalId);
+            sealed += LOG_SECTOR_SIZE;
+            blockFill = 0;
+        }
+    }
+    size_t length = sealed + open;
+    if (length == 0) {
+        return true;
+    }
+
+    unsigned long start = micros();
+    size_t written = 0;
+    if (onCard) {
+        // Whole blocks at block-aligned offsets, so FatFS writes the sectors
+        // straight from buffer without reading them first
+        if (file) {
+            reserve(logicalEnd + length);
+            written = file.seek(logicalEnd) ? file.write(buffer, length) : 0;
+        }
+    } else {
+        for (size_t offset = 0; offset < length; offset += LOG_SECTOR_SIZE) {
+            written += flashRing.append(buffer + offset) ? LOG_SECTOR_SIZE : 0;
+        }
+    }
+    uint32_t spent = micros() - start;
+    bool ok = written == length;
+    if (!ok) {
+        writeErrors++;
+    }
+    bytesWritten += written;
+    lastWriteMicros = spent;
+    maxWriteMicros = max(maxWriteMicros, spent);
+    totalWriteMicros += spent;
+    writes++;
+    if (!ok && onCard) {
+        // Everything stays buffered and goes to the same offset with the
+        // next write-out, so the journal never gets a hole
+        return false;
+    }
+
+    logicalEnd += sealed;
+    memmove(buffer, buffer + sealed, blockFill * RECORD_SIZE);
+    sealed = 0;
+    if (open > 0) {
+        flushedFill = blockFill;
+    }
+    if (buffered() > 0) {
+        oldestMillis = millis();
+    }
+    return ok;
+}
+
+void LogWriter::bufferEntry(const uint8_t* raw) {
+    if (sealed + LOG_SECTOR_SIZE > LOG_BUFFER_SIZE) {
+        writeBuffer(true);
+        if (sealed + LOG_SECTOR_SIZE > LOG_BUFFER_SIZE) {
+            // The card keeps refusing the buffered blocks; newer records give way
+            dropped++;
+            return;
+        }
+    }
+    if (buffered() == 0) {
+        oldestMillis = millis();
+    }
+    memcpy(buffer + sealed + blockFill * RECORD_SIZE, raw, RECORD_SIZE);
+    if (++blockFill == RECORD_BLOCK_SLOTS) {
+        sealLogBlock(buffer + sealed, nextSequence++, blockFill, journalId);
+        sealed += LOG_SECTOR_SIZE;
+        blockFill = 0;
+        flushedFill = 0;
+    }
+}
+
+void LogWriter::bufferRecord(const LogRecord& record) {
+    if (record.length == LOG_SYNC_REQUEST) {
+        // Everything queued before the request is buffered by now
+        flush();
+        syncCompleted = (uint32_t)record.timeMs;
+        xSemaphoreGive(syncDone);
+        return;
+    }
+    if (onCard) {
+        // Records held back until time sync may be older; they stay in the open segment
+        uint32_t day = segmentDay(record.timeMs);
+        if (!file || day > fileDay) {
+            openSegment(writableDay(day));
+        }
+        extendSegment(record.timeMs);
+    }
+
+    // Records are whole log entries; on the card each one also updates the rollups
+    for (size_t offset = 0; offset + RECORD_SIZE <= record.length; offset += RECORD_SIZE) {
+        const uint8_t* raw = (const uint8_t*)record.data + offset;
+        LogEntry entry;
+        if (onCard && decodeLogEntry(raw, entry)) {
+            rollupStore.add(entry);
+        }
+        bufferEntry(raw);
+    }
+    if (sealed > 0) {
+        writeBuffer(true);
+    }
+}
+
+void LogWriter::drainQueue() {
+    static LogRecord record; // only used with the lock held
+    while (xQueueReceive(queue, &record, 0) == pdTRUE) {
+        bufferRecord(record);
+    }
+}
+
+void LogWriter::writerTask(void* param) {
+    LogWriter* self = (LogWriter*)param;
+    static LogRecord record;
+    for (;;) {
+        // Wake on the next record, or at least once a second to honour the flush age
+        bool received = xQueueReceive(self->queue, &record, pdMS_TO_TICKS(1000)) == pdTRUE;
+
+        xSemaphoreTakeRecursive(self->lock, portMAX_DELAY);
+        self->finishSwitch();
+        if (received) {
+            self->bufferRecord(record);
+        }
+        self->drainQueue();
+        if (self->buffered() > 0 && millis() - self->oldestMillis >= LOG_FLUSH_AGE_MS) {
+            self->flush();
+        }
+        xSemaphoreGiveRecursive(self->lock);
+    }
+}
+
+void LogWriter::flush() {
+    writeBuffer(false);
+    if (file) {
+        file.flush();
+    }
+    if (onCard) {
+        rollupStore.flush();
+    }
+}
+
+void LogWriter::sync() {
+    if (queue == nullptr) {
+        return;
+    }
+    xSemaphoreTakeRecursive(lock, portMAX_DELAY);
+    finishSwitch();
+    drainQueue();
+    flush();
+    xSemaphoreGiveRecursive(lock);
+}
+
+bool LogWriter::requestSync(uint32_t timeoutMs) {
+    if (queue == nullptr) {
+        return false;
+    }
+    static LogRecord request; // only the web server task requests syncs
+    uint32_t ticket = ++syncRequested;
+    request.timeMs = ticket;
+    request.length = LOG_SYNC_REQUEST;
+    if (xQueueSend(queue, &request, 0) != pdTRUE) {
+        syncTimeouts++;
+        return false;
+    }
+
+    // A give left over from an earlier, timed out request only repeats the check
+    unsigned long start = millis();
+    while ((int32_t)(syncCompleted - ticket) < 0) {
+        unsigned long waited = millis() - start;
+        if (waited >= timeoutMs || xSemaphoreTake(syncDone, pdMS_TO_TICKS(timeoutMs - waited)) != pdTRUE) {
+            syncTimeouts++;
+            return false;
+        }
+    }
+    return true;
+}
+
+void LogWriter::clear() {
+    if (queue != nullptr) {
+        xSemaphoreTakeRecursive(lock, portMAX_DELAY);
+        xQueueReset(queue);
+        sealed = 0;
+        blockFill = 0;
+        flushedFill = 0;
+        if (file) {
+            file.close();
+        }
+    }
+    flashRing.clear();
+
+    File dir = onCard ? SD.open(path) : File();
+    if (dir) {
+        for (File entry = dir.openNextFile(); entry; entry = dir.openNextFile()) {
+            String name = entry.name();
+            bool leftover = name.endsWith(".tmp") || name.endsWith(".bad");
+            uint32_t day;
+            uint8_t format;
+            if (entry.isDirectory()
+                || !parseSegmentFileName((leftover ? name.substring(0, name.length() - 4) : name).c_str(), day, format)) {
+                continue;
+            }
+            entry.close();
+            if (readers(day) == 0) {
+                SD.remove(path + "/" + name);
+                continue;
+            }
+            // An archive or compaction in progress removes its own .tmp once the source is gone
+            for (size_t i = 0; i < LOG_MAX_READER_DAYS && !leftover; i++) {
+                if (readerCounts[i] > 0 && readerDays[i] == day && !readerCleared[i]) {
+                    readerCleared[i] = true;
+                    readerDeferrals++;
+                }
+            }
+        }
+    }
+    index.clear();
+    if (onCard) {
+        rollupStore.clear();
+    }
+
+    if (queue != nullptr) {
+        xSemaphoreGiveRecursive(lock);
+    }
+}
+
+bool LogWriter::finishClear() {
+    if (lock == nullptr) {
+        return true;
+    }
+    xSemaphoreTakeRecursive(lock, portMAX_DELAY);
+    bool done = true;
+    for (size_t i = 0; i < LOG_MAX_READER_DAYS; i++) {
+        if (readerCleared[i] && readerCounts[i] == 0) {
+            removeSegmentFiles(readerDays[i]);
+            readerCleared[i] = false;
+        }
+        done = done && !readerCleared[i];
+    }
+    xSemaphoreGiveRecursive(lock);
+    return done;
+}
+
+bool LogWriter::clearing(uint32_t day) const {
+    for (size_t i = 0; i < LOG_MAX_READER_DAYS; i++) {
+        if (readerCleared[i] && readerDays[i] == day) {
+            return true;
+        }
+    }
+    return false;
+}
+
+uint64_t LogWriter::removeSegmentFiles(uint32_t day) {
+    // Two formats may exist while an archive is being installed
+    uint64_t freed = 0;
+    for (uint8_t format = SEGMENT_RAW; format <= SEGMENT_COMPACT; format++) {
+        String segment = segmentPath(day, format);
+        File existing = SD.exists(segment) ? SD.open(segment, FILE_READ) : File();
+        if (existing) {
+            freed += existing.size();
+            existing.close();
+            SD.remove(segment);
+        }
+    }
+    return freed;
+}
+
+void LogWriter::addSegment(const SegmentInfo& segment) {
+    uint32_t evicted;
+    if (index.add(segment, evicted)) {
+        evictDay(evicted);
+    }
+}
+
+void LogWriter::extendSegment(int64_t timeMs) {
+    uint32_t evicted;
+    if (index.update(fileDay, timeMs, evicted)) {
+        evictDay(evicted);
+    }
+}
+
+void LogWriter::evictDay(uint32_t day) {
+    if (file && day == fileDay) {
+        return; // only after the clock was set back; the index takes it again with its next record
+    }
+    evictedSegments++;
+    if (readers(day) == 0) {
+        removeSegmentFiles(day);
+        return;
+    }
+    for (size_t i = 0; i < LOG_MAX_READER_DAYS; i++) {
+        if (readerCounts[i] > 0 && readerDays[i] == day && !readerCleared[i]) {
+            readerCleared[i] = true;
+            readerDeferrals++;
+        }
+    }
+}
+
+bool LogWriter::findSegment(uint32_t minDay, int64_t fromMs, int64_t toMs, SegmentInfo& segment) {
+    if (lock == nullptr) {
+        return false;
+    }
+    xSemaphoreTakeRecursive(lock, portMAX_DELAY);
+    bool found = index.findOverlapping(minDay, fromMs, toMs, segment);
+    xSemaphoreGiveRecursive(lock);
+    return found;
+}
+
+bool LogWriter::findArchiveCandidate(SegmentInfo& segment) {
+    if (lock == nullptr || !timestampService.synced()) {
+        return false;
+    }
+    xSemaphoreTakeRecursive(lock, portMAX_DELAY);
+    // Neither the open segment nor today's may still receive records, nor
+    // any day while the flash ring is migrated
+    uint32_t beforeDay = segmentDay(timestampService.nowEpochMs());
+    if (file && fileDay < beforeDay) {
+        beforeDay = fileDay;
+    }
+    bool found = !switchPending && index.findBefore(beforeDay, SEGMENT_RAW, segment);
+    xSemaphoreGiveRecursive(lock);
+    return found;
+}
+
+bool LogWriter::findCompactCandidate(uint32_t beforeDay, uint8_t format, SegmentInfo& segment) {
+    if (lock == nullptr) {
+        return false;
+    }
+    xSemaphoreTakeRecursive(lock, portMAX_DELAY);
+    if (file && fileDay < beforeDay) {
+        beforeDay = fileDay;
+    }
+    bool found = !switchPending && index.findBefore(beforeDay, format, segment);
+    xSemaphoreGiveRecursive(lock);
+    return found;
+}
+
+bool LogWriter::acquireSegment(const SegmentInfo& segment) {
+    if (lock == nullptr) {
+        return false;
+    }
+    xSemaphoreTakeRecursive(lock, portMAX_DELAY);
+    SegmentInfo current;
+    bool present = index.find(segment.day, current) && current.format == segment.format;
+    size_t slot = LOG_MAX_READER_DAYS;
+    for (size_t i = 0; i < LOG_MAX_READER_DAYS && present; i++) {
+        if (readerCounts[i] > 0 && readerDays[i] == segment.day) {
+            slot = i;
+            break;
+        }
+        if (readerCounts[i] == 0 && !readerCleared[i] && slot == LOG_MAX_READER_DAYS) {
+            slot = i;
+        }
+    }
+    bool held = present && slot < LOG_MAX_READER_DAYS;
+    if (held) {
+        readerDays[slot] = segment.day;
+        readerCounts[slot]++;
+    } else if (present) {
+        readerOverflows++;
+    }
+    xSemaphoreGiveRecursive(lock);
+    return held;
+}
+
+void LogWriter::releaseSegment(uint32_t day) {
+    xSemaphoreTakeRecursive(lock, portMAX_DELAY);
+    for (size_t i = 0; i < LOG_MAX_READER_DAYS; i++) {
+        if (readerCounts[i] > 0 && readerDays[i] == day) {
+            readerCounts[i]--;
+            break;
+        }
+    }
+    xSemaphoreGiveRecursive(lock);
+}
+
+uint8_t LogWriter::readers(uint32_t day) const {
+    for (size_t i = 0; i < LOG_MAX_READER_DAYS; i++) {
+        if (readerCounts[i] > 0 && readerDays[i] == day) {
+            return readerCounts[i];
+        }
+    }
+    return 0;
+}
+
+bool LogWriter::installArchive(const SegmentInfo& segment, const String& archivePath, uint8_t sourceFormat) {
+    unsigned long start = millis();
+    xSemaphoreTakeRecursive(lock, portMAX_DELAY);
+    // Downloads of the day finish on the file they started on
+    if (readers(segment.day) > 0) {
+        readerDeferrals++;
+    }
+    while (readers(segment.day) > 0) {
+        xSemaphoreGiveRecursive(lock);
+        if (millis() - start >= LOG_READER_WAIT_MS) {
+            return false;
+        }
+        vTaskDelay(pdMS_TO_TICKS(100));
+        xSemaphoreTakeRecursive(lock, portMAX_DELAY);
+    }
+    // The log may have been cleared, or the day dropped, while the archive was built
+    bool installed = SD.exists(segmentPath(segment.day, sourceFormat))
+        && SD.rename(archivePath, segmentPath(segment.day, segment.format));
+    if (installed) {
+        // From here on the archive is the segment; a leftover source file is removed at boot
+        addSegment(segment);
+        SD.remove(segmentPath(segment.day, sourceFormat));
+    }
+    xSemaphoreGiveRecursive(lock);
+    return installed;
+}
+
+bool LogWriter::findOldestSegment(SegmentInfo& segment) {
+    if (lock == nullptr) {
+        return false;
+    }
+    xSemaphoreTakeRecursive(lock, portMAX_DELAY);
+    bool found = index.count() > 0 && (!file || index.at(0).day < fileDay);
+    if (found) {
+        segment = index.at(0);
+    }
+    xSemaphoreGiveRecursive(lock);
+    return found;
+}
+
+bool LogWriter::dropSegment(uint32_t day, uint64_t& freed) {
+    freed = 0;
+    xSemaphoreTakeRecursive(lock, portMAX_DELAY);
+    bool open = file && day == fileDay;
+    bool read = !open && readers(day) > 0;
+    if (read) {
+        readerDeferrals++; // retried at the next policy run
+    }
+    if (!open && !read) {
+        freed = removeSegmentFiles(day);
+        index.remove(day);
+    }
+    xSemaphoreGiveRecursive(lock);
+    return !open && !read;
+}
+
+uint64_t LogWriter::storedBytes() {
+    uint64_t total = 0;
+    File dir = onCard ? SD.open(path) : File();
+    if (dir) {
+        for (File entry = dir.openNextFile(); entry; entry = dir.openNextFile()) {
+            uint32_t day;
+            uint8_t format;
+            if (!entry.isDirectory() && parseSegmentFileName(entry.name(), day, format)) {
+                total += entry.size();
+            }
+        }
+    }
+    return onCard ? total + rollupStore.storedBytes() : total;
+}
+
+bool LogWriter::rotateRollups(int64_t nowMs) {
+    if (lock == nullptr || !onCard) {
+        return false;
+    }
+    // The writer task appends to the tier files with the lock held
+    xSemaphoreTakeRecursive(lock, portMAX_DELAY);
+    bool rotated = rollupStore.rotateFine(nowMs);
+    xSemaphoreGiveRecursive(lock);
+    return rotated;
+}
+
+JSONVar LogWriter::statusJson() const {
+    JSONVar status;
+    status["storage"] = onCard ? "sd" : "flash";
+    status["open"] = (bool)file;
+    status["segments"] = (double)index.count();
+    status["rotations"] = (double)rotations;
+    status["convertedSegments"] = (double)convertedSegments;
+    status["migratedRecords"] = (double)migratedRecords;
+    status["lastRecoveryUs"] = (double)lastRecoveryMicros;
+    status["maxRecoveryUs"] = (double)maxRecoveryMicros;
+    status["preallocBytes"] = LOG_PREALLOC_BYTES;
+    status["logicalEnd"] = (double)logicalEnd;
+    status["allocatedEnd"] = (double)allocatedEnd;
+    status["preallocations"] = (double)preallocations;
+    status["lastPreallocUs"] = (double)lastPreallocMicros;
+    status["maxPreallocUs"] = (double)maxPreallocMicros;
+    status["trims"] = (double)trims;
+    status["bufferSize"] = LOG_BUFFER_SIZE;
+    status["flushAgeMs"] = LOG_FLUSH_AGE_MS;
+    // Worst case on power loss: the whole queue plus a full buffer, or LOG_FLUSH_AGE_MS of records
+    status["maxLossBytes"] = LOG_BUFFER_SIZE + LOG_QUEUE_DEPTH * LOG_RECORD_MAX;
+    status["maxLossMs"] = LOG_FLUSH_AGE_MS;
+    status["overflowPolicy"] = LOG_OVERFLOW_POLICY == LOG_OVERFLOW_BLOCK ? "block" : "dropOldest";
+    status["queueDepth"] = queue ? (double)uxQueueMessagesWaiting(queue) : 0.0;
+    status["maxQueueDepth"] = (double)maxQueueDepth;
+    status["syncTimeouts"] = (double)syncTimeouts;
+    status["readerDeferrals"] = (double)readerDeferrals;
+    status["readerOverflows"] = (double)readerOverflows;
+    status["evictedSegments"] = (double)evictedSegments;
+    status["buffered"] = (double)buffered();
+    status["records"] = (double)records;
+    status["dropped"] = (double)dropped;
+    status["writes"] = (double)writes;
+    status["writeErrors"] = (double)writeErrors;
+    status["lastWriteUs"] = (double)lastWriteMicros;
+    status["maxWriteUs"] = (double)maxWriteMicros;
+    status["meanWriteUs"] = writes ? (double)totalWriteMicros / writes : 0.0;
+    status["bytesWritten"] = (double)bytesWritten;
+    status["writeKBps"] = totalWriteMicros ? bytesWritten * 1e6 / 1024.0 / totalWriteMicros : 0.0;
+    return status;
+}
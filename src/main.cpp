@@ -10,22 +10,50 @@
 #include <ESPAsyncWebServer.h>
 #include "SPIFFS.h"
 #include <Arduino_JSON.h>
-#include <OneWire.h>
-#include <DallasTemperature.h>
 #include <SD.h>
 #include <ESPmDNS.h>
 #include <time.h>
+#include <HTTPClient.h>
+#include <esp_timer.h>
+#include "temperature_buses.h"
+#include "pulse_input.h"
+#include "power_monitor.h"
+#include "modbus_meters.h"
+#include "sample_scheduler.h"
+#include "power_management.h"
+#include "store_and_burst.h"
+#include "energy_store.h"
+#include "timestamp.h"
+#include "time_sync.h"
+#include "log_writer.h"
+#include "record_channels.h"
+#include "log_query.h"
+#include "csv_export.h"
+#include "http_compression.h"
+#include "segment_archiver.h"
+#include "segment_compactor.h"
+#include "rollup_store.h"
+#include "flash_ring.h"
+#include "storage_bench.h"
+#include "retention_manager.h"
+#include <memory>
 
-#define TEMP_SENSOR_PIN 4 /**< GPIO pin number for the temperature sensor. */
 #define SD_CS_PIN 5 /**< GPIO pin number for the SD card Chip Select. */
-
-OneWire oneWire(TEMP_SENSOR_PIN); /**< OneWire protocol instance for communication with temperature sensors. */
-DallasTemperature temperatureSensors(&oneWire); /**< Instance to control Dallas Temperature sensors. */
+#define SD_RETRY_INTERVAL_MS 60000 /**< How often a missing SD card is looked for again. */
+#define LOG_DIR "/data/log" /**< Directory of the daily binary log segments on the SD card. */
+#define ROLLUP_DIR "/data/rollup" /**< Directory of the 1m/1h/1d rollup files on the SD card. */
+#define HISTORY_TARGET_POINTS 500 /**< Rows /history aims for when no resolution is given. */
+#define HISTORY_DEFAULT_SPAN_MS 86400000LL /**< Range /history covers when from is omitted. */
+#define READINGS_REQUEST_DEPTH 8 /**< WebSocket getReadings requests waiting for loop(). */
 
 AsyncWebServer server(80); /**< Instance of the web server running on port 80. */
 AsyncWebSocket webSocket("/ws"); /**< Web socket server running on path /ws. */
 JSONVar sensorData; /**< JSON variable to store sensor data. */
-unsigned long previousMillis = 0; /**< Store the last time readings were sent. */
+int64_t sampleEpochMs = 0; /**< Wall-clock time of the sample in sensorData. */
+String lastReadings; /**< Last record sent by loop(); only touched by loop(). */
+QueueHandle_t readingsRequests = nullptr; /**< Ids of WebSocket clients waiting for lastReadings. */
+bool sdCardReady = false; /**< Whether the log is on the SD card rather than in internal flash. */
+unsigned long lastCardCheck = 0; /**< millis() of the last attempt to mount the SD card. */
 const unsigned long updateInterval = 3000; /**< Interval to send data in milliseconds. */
 
 const char* ssidPath = "/ssid.txt"; /**< Path to SSID storage on SPIFFS. */
@@ -45,40 +73,155 @@ void setupTemperatureSensor();
 void setupFileSystem();
 void setupWebSocket();
 void broadcastReadings(String data);
+void serveReadingsRequests();
 String fetchSensorData();
-void setupSDCard();
-void logDataToSD(String data);
+String formatRecord(JSONVar& record, int64_t epochMs);
+void runStoreAndBurst();
+String fetchStatus();
+bool setupSDCard();
+void logDataToSD(JSONVar& record, int64_t epochMs, uint8_t flags);
+void sendLogRange(AsyncWebServerRequest* request, int64_t fromMs, int64_t toMs);
+void sendCsvRange(AsyncWebServerRequest* request, int64_t fromMs, int64_t toMs, uint8_t channel);
+void sendHistory(AsyncWebServerRequest* request, int64_t fromMs, int64_t toMs, uint8_t channel, int64_t resolutionMs);
 void startAccessPoint();
 void printLocalTime();
-void syncTime();
 
 /**
- * @brief Set up the temperature sensor.
+ * @brief Set up the temperature sensors on all configured OneWire buses.
  */
 void setupTemperatureSensor() {
-    pinMode(TEMP_SENSOR_PIN, INPUT_PULLUP);
-    temperatureSensors.begin();
+    temperatureBuses.begin();
 }
 
 /**
  * @brief Fetch sensor data and format it as a JSON string.
+ *
+ * Pulse energy is accounted by loop() on every tick before this is called.
  * @return String formatted as JSON.
  */
 String fetchSensorData() {
-    temperatureSensors.requestTemperatures();
-    sensorData["temp"] = String(temperatureSensors.getTempCByIndex(0));
+    temperatureBuses.startConversions();
+    temperatureBuses.collectReadings();
+
+    size_t probes = temperatureBuses.probeCount();
+    sensorData["temp"] = String(probes > 0 ? temperatureBuses.probe(0).celsius : DEVICE_DISCONNECTED_C);
+    if (probes > 1) {
+        JSONVar temps;
+        for (size_t i = 0; i < probes; i++) {
+            temps[(int)i] = String(temperatureBuses.probe(i).celsius);
+        }
+        sensorData["temps"] = temps;
+    }
 
-    struct tm timeinfo;
-    if (!getLocalTime(&timeinfo)) {
-        Serial.println("Failed to obtain time");
-        sensorData["time"] = "N/A";
-    } else {
-        char timeStringBuff[50];
-        strftime(timeStringBuff, sizeof(timeStringBuff), "%FT%T%z", &timeinfo);
-        sensorData["time"] = String(timeStringBuff);
+    pulseInput.addToRecord(sensorData);
+    powerMonitor.addToRecord(sensorData);
+    modbusMeters.addToRecord(sensorData);
+
+    if (!timestampService.synced()) {
+        // Until NTP answers, stamp with the monotonic clock; the log entry is fixed up later
+        sensorData["time"] = undefined;
+        sensorData["uptimeMs"] = (double)TimeSync::monotonicMs();
+        return JSON.stringify(sensorData) + "\n";
+    }
+    sensorData["uptimeMs"] = undefined;
+    sampleEpochMs = timestampService.nowEpochMs();
+    return formatRecord(sensorData, sampleEpochMs);
+}
+
+/**
+ * @brief Stamp a record with a time and serialize it as one JSON line.
+ * @param record Record to stamp; its "time" field is overwritten.
+ * @param epochMs Time of the sample in epoch milliseconds.
+ * @return String formatted as JSON, terminated by a newline.
+ */
+String formatRecord(JSONVar& record, int64_t epochMs) {
+    timestampService.stamp(record, epochMs);
+    return JSON.stringify(record) + "\n";
+}
+
+/**
+ * @brief Take one sample in store-and-burst mode, upload if due, and deep sleep.
+ *
+ * Samples are kept in RTC memory. When a burst is due, WiFi is brought up
+ * once, the clock is resynchronized and all buffered records are posted in
+ * a single request. This function does not return.
+ */
+void runStoreAndBurst() {
+    temperatureBuses.startConversions();
+    temperatureBuses.collectReadings();
+    float celsius = temperatureBuses.probeCount() > 0 ? temperatureBuses.probe(0).celsius : DEVICE_DISCONNECTED_C;
+    storeAndBurst.store(time(nullptr), celsius);
+
+    if (storeAndBurst.burstDue(time(nullptr))) {
+        int64_t radioStart = esp_timer_get_time();
+        size_t sent = 0;
+        if (connectToWiFi()) {
+            // Samples taken before the first sync carry the unset RTC clock: shift them by the sync step
+            time_t unsynced = time(nullptr);
+            int64_t unsyncedMs = TimeSync::monotonicMs();
+            configTime(gmtOffset_sec, daylightOffset_sec, ntpServer);
+            struct tm timeinfo;
+            if (unsynced <= EPOCH_VALID_AFTER && getLocalTime(&timeinfo, 5000)) {
+                time_t expected = unsynced + (time_t)((TimeSync::monotonicMs() - unsyncedMs) / 1000);
+                storeAndBurst.fixUpTimes(time(nullptr) - expected);
+            }
+
+            String batch;
+            JSONVar record;
+            size_t count = storeAndBurst.pending();
+            for (size_t i = 0; i < count; i++) {
+                const BurstSample& sample = storeAndBurst.sample(i);
+                record["temp"] = String(sample.centiCelsius / 100.0f);
+                batch += formatRecord(record, (int64_t)sample.time * 1000);
+            }
+
+            HTTPClient http;
+            http.begin(BURST_UPLOAD_URL);
+            http.addHeader("Content-Type", "application/x-ndjson");
+            http.addHeader("X-Energy-Per-Sample-mJ", String(storeAndBurst.energyPerSampleMj()));
+            int code = http.POST(batch);
+            http.end();
+            if (code >= 200 && code < 300) {
+                sent = count;
+            } else {
+                Serial.printf("Burst upload failed: %d\n", code);
+            }
+        }
+        WiFi.disconnect(true);
+        WiFi.mode(WIFI_OFF);
+        storeAndBurst.completeBurst(time(nullptr), sent, esp_timer_get_time() - radioStart);
     }
 
-    return JSON.stringify(sensorData) + "\n";
+    storeAndBurst.sleep();
+}
+
+/**
+ * @brief Collect device health and statistics as a JSON string.
+ * @return String formatted as JSON.
+ */
+String fetchStatus() {
+    JSONVar status;
+    status["uptimeMs"] = (double)millis();
+    status["freeHeap"] = (double)ESP.getFreeHeap();
+    status["oneWire"] = temperatureBuses.statusJson();
+    status["pulse"] = pulseInput.statusJson();
+    status["power"] = powerMonitor.statusJson();
+    status["modbus"] = modbusMeters.statusJson();
+    status["sampling"] = sampleScheduler.statusJson();
+    status["powerSave"] = powerManagement.statusJson();
+    status["energyStore"] = energyStore.statusJson();
+    status["timeSync"] = timeSync.statusJson();
+    JSONVar logStatus = logWriter.statusJson();
+    logStatus["unmappedFields"] = (double)unmappedRecordFields();
+    status["log"] = logStatus;
+    status["archive"] = segmentArchiver.statusJson();
+    status["compaction"] = segmentCompactor.statusJson();
+    status["rollups"] = rollupStore.statusJson();
+    status["flashLog"] = flashRing.statusJson();
+    status["storageBench"] = storageBench.statusJson();
+    status["retention"] = retentionManager.statusJson();
+    status["http"] = httpCompression.statusJson();
+    return JSON.stringify(status);
 }
 
 /**
@@ -86,8 +229,29 @@ String fetchSensorData() {
  * @param data String data to be sent and logged.
  */
 void broadcastReadings(String data) {
+    lastReadings = data;
     webSocket.textAll(data.c_str());
-    logDataToSD(data);
+    if (timestampService.synced()) {
+        logDataToSD(sensorData, sampleEpochMs, 0);
+    } else {
+        timeSync.hold(data);
+    }
+}
+
+/**
+ * @brief Answer queued getReadings requests with the last sampled record.
+ *
+ * Runs in loop(), the only task that samples: pulse accounting, the power
+ * window and sensorData must not be touched from the async_tcp task.
+ */
+void serveReadingsRequests() {
+    if (readingsRequests == nullptr || lastReadings.isEmpty()) {
+        return; // answered once the first sample is taken
+    }
+    uint32_t clientId;
+    while (xQueueReceive(readingsRequests, &clientId, 0) == pdTRUE) {
+        webSocket.text(clientId, lastReadings);
+    }
 }
 
 /**
@@ -130,8 +294,9 @@ void handleWebSocketData(AsyncWebSocketClient* client, void* arg, uint8_t* data,
         String msg = (char*)data;
         Serial.printf("WebSocket message received: %s\n", msg.c_str());
         if (msg == "getReadings") {
-            String sensorData = fetchSensorData();
-            client->text(sensorData);
+            // Served by loop() from its last sample, at the latest after POWER_WAKE_MS or the next tick
+            uint32_t clientId = client->id();
+            xQueueSend(readingsRequests, &clientId, 0);
         }
     }
 }
@@ -140,6 +305,7 @@ void handleWebSocketData(AsyncWebSocketClient* client, void* arg, uint8_t* data,
  * @brief Set up the WebSocket communication.
  */
 void setupWebSocket() {
+    readingsRequests = xQueueCreate(READINGS_REQUEST_DEPTH, sizeof(uint32_t));
     webSocket.onEvent(handleWebSocketEvent);
     server.addHandler(&webSocket);
 }
@@ -157,36 +323,129 @@ void setupFileSystem() {
 
 /**
  * @brief Set up the SD card for data logging.
+ *
+ * Also called from loop() while no card is present; the log writer then
+ * moves from internal flash to the card.
+ * @return true if the card is mounted.
  */
-void setupSDCard() {
+bool setupSDCard() {
+    lastCardCheck = millis();
     if (!SD.begin(SD_CS_PIN)) {
-        Serial.println("SD Card Mount Failed");
-        return;
+        return false;
     }
     Serial.println("SD Card initialized.");
 
     if (!SD.exists("/data")) {
         SD.mkdir("/data");
     }
+    // Rollups first, the writer task replays the log into them when it starts
+    rollupStore.begin(ROLLUP_DIR);
+    if (logWriter.begin(LOG_DIR)) {
+        segmentArchiver.begin();
+        segmentCompactor.begin();
+    }
+    sdCardReady = true;
+    return true;
 }
 
 /**
- * @brief Log data to an SD card.
- * @param data String data to be logged.
+ * @brief Log a record to the SD card as binary log entries.
+ * @param record Sensor record to log.
+ * @param epochMs Wall-clock time of the sample.
+ * @param flags RECORD_FLAG_* bits for all entries.
  */
-void logDataToSD(String data) {
-    String filePath = "/data/sensorData.log";
-    File file = SD.open(filePath, FILE_APPEND);
-    if (!file) {
-        Serial.println("Failed to open file on SD card for writing");
-        return;
-    }
-    if (file.println(data)) {
-        Serial.println("Data logged to SD");
-    } else {
-        Serial.println("Failed to write data to SD");
+void logDataToSD(JSONVar& record, int64_t epochMs, uint8_t flags) {
+    static LogEntry entries[MAX_RECORD_ENTRIES];
+    static uint8_t encoded[LOG_RECORD_MAX];
+    size_t count = recordToEntries(record, epochMs, flags, entries);
+
+    size_t used = 0;
+    for (size_t i = 0; i < count; i++) {
+        encodeLogEntry(entries[i], encoded + used);
+        used += RECORD_SIZE;
+        if (used + RECORD_SIZE > sizeof(encoded) || i + 1 == count) {
+            logWriter.append((const char*)encoded, used, epochMs);
+            used = 0;
+        }
     }
-    file.close();
+}
+
+/**
+ * @brief Stream the logged records in a time range as a binary log.
+ *
+ * The response is a complete log file (header and records) that
+ * tools/logdump can read. Records are read from the card while sending.
+ * @param request Request to answer.
+ * @param fromMs Start of the range in epoch milliseconds, inclusive.
+ * @param toMs End of the range in epoch milliseconds, inclusive.
+ */
+void sendLogRange(AsyncWebServerRequest* request, int64_t fromMs, int64_t toMs) {
+    // Runs on the async_tcp task: give the writer a short while to flush, never wait for the card
+    logWriter.requestSync();
+    std::shared_ptr<LogQuery> query = std::make_shared<LogQuery>(fromMs, toMs);
+    AsyncWebServerResponse* response = httpCompression.beginResponse(request, "application/octet-stream",
+        [query](uint8_t* buffer, size_t maxLen, size_t index) -> size_t {
+            size_t length = 0;
+            if (index == 0) {
+                encodeLogHeader(makeLogHeader(timestampService.nowEpochMs()), buffer);
+                length = RECORD_LOG_HEADER_SIZE;
+            }
+            // Same scan budget as CsvExport, so one call never holds the async_tcp task for long
+            LogEntry entry;
+            uint32_t budget = CSV_SCAN_BUDGET;
+            while (length + RECORD_SIZE <= maxLen && budget > 0) {
+                if (!query->next(entry, budget)) {
+                    if (query->finished()) {
+                        return length;
+                    }
+                    break;
+                }
+                encodeLogEntry(entry, buffer + length);
+                length += RECORD_SIZE;
+            }
+            return length == 0 ? RESPONSE_TRY_AGAIN : length;
+        });
+    response->addHeader("Content-Disposition", "attachment; filename=\"sensorData.bin\"");
+    request->send(response);
+}
+
+/**
+ * @brief Stream one channel of the log in a time range as CSV.
+ * @param request Request to answer.
+ * @param fromMs Start of the range in epoch milliseconds, inclusive.
+ * @param toMs End of the range in epoch milliseconds, inclusive.
+ * @param channel Channel to export.
+ */
+void sendCsvRange(AsyncWebServerRequest* request, int64_t fromMs, int64_t toMs, uint8_t channel) {
+    logWriter.requestSync();
+    std::shared_ptr<CsvExport> csv = std::make_shared<CsvExport>(fromMs, toMs, channel);
+    AsyncWebServerResponse* response = httpCompression.beginResponse(request, "text/csv",
+        [csv](uint8_t* buffer, size_t maxLen, size_t index) -> size_t {
+            size_t length = csv->fill(buffer, maxLen);
+            return length == CSV_TRY_AGAIN ? RESPONSE_TRY_AGAIN : length;
+        });
+    response->addHeader("Content-Disposition", "attachment; filename=\"sensorData.csv\"");
+    request->send(response);
+}
+
+/**
+ * @brief Stream min/max/mean/count/last of one channel at a given resolution as CSV.
+ * @param request Request to answer.
+ * @param fromMs Start of the range in epoch milliseconds, inclusive.
+ * @param toMs End of the range in epoch milliseconds, inclusive.
+ * @param channel Channel to export.
+ * @param resolutionMs Coarsest acceptable row spacing; selects the rollup tier.
+ */
+void sendHistory(AsyncWebServerRequest* request, int64_t fromMs, int64_t toMs, uint8_t channel, int64_t resolutionMs) {
+    logWriter.requestSync();
+    std::shared_ptr<HistoryExport> history = std::make_shared<HistoryExport>(fromMs, toMs, channel, resolutionMs);
+    AsyncWebServerResponse* response = httpCompression.beginResponse(request, "text/csv",
+        [history](uint8_t* buffer, size_t maxLen, size_t index) -> size_t {
+            size_t length = history->fill(buffer, maxLen);
+            return length == CSV_TRY_AGAIN ? RESPONSE_TRY_AGAIN : length;
+        });
+    response->addHeader("X-History-Source", history->source());
+    request->send(response);
 }
 
 /**
@@ -312,6 +571,8 @@ void startAccessPoint() {
             }
         }
         request->send(200, "text/plain", "Network settings saved. Restarting...");
+        energyStore.checkpoint();
+        logWriter.sync();
         delay(3000);
         ESP.restart();
     });
@@ -328,17 +589,31 @@ void startAccessPoint() {
 void setup() {
     Serial.begin(115200);
     setupTemperatureSensor();
+#if STORE_AND_BURST_MODE
+    // Every wake-up only samples, uploads when due and goes back to deep sleep;
+    // the file system holds the WiFi credentials for the burst
+    setupFileSystem();
+    runStoreAndBurst();
+#endif
+    energyStore.begin();
+    pulseInput.begin();
+    powerMonitor.begin();
+    modbusMeters.begin();
+    sampleScheduler.begin(updateInterval);
     setupFileSystem();
     setupWebSocket();
-    setupSDCard();
+    if (!setupSDCard()) {
+        Serial.println("SD Card Mount Failed, logging to internal flash");
+        logWriter.beginFallback();
+    }
+    retentionManager.begin();
 
     if (!connectToWiFi()) {
         startAccessPoint();
     } else {
-        // NTP time synchronization
-        configTime(gmtOffset_sec, daylightOffset_sec, ntpServer);
-        syncTime();
-        printLocalTime();
+        // NTP time synchronization runs in the background
+        timeSync.begin(gmtOffset_sec, daylightOffset_sec, ntpServer, logDataToSD);
+        powerManagement.begin();
 
         // Define server routes for the main application
         server.on("/", HTTP_GET, [](AsyncWebServerRequest* request) {
@@ -350,12 +625,64 @@ void setup() {
         server.on("/script.js", HTTP_GET, [](AsyncWebServerRequest* request) {
             request->send(SPIFFS, "/script.js", "application/javascript");
         });
+        server.on("/status", HTTP_GET, [](AsyncWebServerRequest* request) {
+            request->send(200, "application/json", fetchStatus());
+        });
         server.on("/downloadcsv", HTTP_GET, [](AsyncWebServerRequest* request) {
-            request->send(SD, "/data/sensorData.log", "text/csv", true);
+            // Optional from/to in epoch milliseconds and a channel name, "temp" by default
+            int64_t from = request->hasParam("from") ? atoll(request->getParam("from")->value().c_str()) : 0;
+            int64_t to = request->hasParam("to") ? atoll(request->getParam("to")->value().c_str()) : INT64_MAX;
+            uint8_t channel = CHANNEL_TEMP_BASE;
+            if (request->hasParam("channel") && !channelFromName(request->getParam("channel")->value().c_str(), channel)) {
+                request->send(400, "text/plain", "unknown channel");
+                return;
+            }
+            sendCsvRange(request, from, to, channel);
+        });
+        server.on("/history", HTTP_GET, [](AsyncWebServerRequest* request) {
+            // from/to/resolution in milliseconds; by default the last day in about HISTORY_TARGET_POINTS rows
+            int64_t to = request->hasParam("to") ? atoll(request->getParam("to")->value().c_str()) : timestampService.nowEpochMs();
+            int64_t from = request->hasParam("from") ? atoll(request->getParam("from")->value().c_str()) : to - HISTORY_DEFAULT_SPAN_MS;
+            if (from > to) {
+                request->send(400, "text/plain", "from must not be after to");
+                return;
+            }
+            int64_t resolution = request->hasParam("resolution") ? atoll(request->getParam("resolution")->value().c_str())
+                                                                 : (to - from) / HISTORY_TARGET_POINTS;
+            uint8_t channel = CHANNEL_TEMP_BASE;
+            if (request->hasParam("channel") && !channelFromName(request->getParam("channel")->value().c_str(), channel)) {
+                request->send(400, "text/plain", "unknown channel");
+                return;
+            }
+            sendHistory(request, from, to, channel, resolution);
+        });
+        server.on("/log", HTTP_GET, [](AsyncWebServerRequest* request) {
+            // from/to in epoch milliseconds; the default is everything up to now
+            int64_t from = request->hasParam("from") ? atoll(request->getParam("from")->value().c_str()) : 0;
+            int64_t to = request->hasParam("to") ? atoll(request->getParam("to")->value().c_str()) : INT64_MAX;
+            if (from > to) {
+                request->send(400, "text/plain", "from must not be after to");
+                return;
+            }
+            sendLogRange(request, from, to);
+        });
+        server.on("/sdbench", HTTP_GET, [](AsyncWebServerRequest* request) {
+            // kb of data per write path; results appear under storageBench in /status
+            if (!sdCardReady) {
+                request->send(503, "text/plain", "no SD card");
+                return;
+            }
+            uint32_t kb = request->hasParam("kb") ? atoi(request->getParam("kb")->value().c_str()) : BENCH_DEFAULT_KB;
+            if (!storageBench.start(kb)) {
+                request->send(409, "text/plain", "benchmark already running");
+                return;
+            }
+            request->send(202, "text/plain", "started");
         });
         server.on("/clearcsv", HTTP_GET, [](AsyncWebServerRequest* request) {
-            SD.remove("/data/sensorData.log");
-            request->send(200, "text/plain", "CSV data cleared.");
+            // Deleting segments may take a while; the retention task does it and /status reports progress
+            retentionManager.requestClear();
+            request->send(202, "application/json", JSON.stringify(retentionManager.clearJobJson()));
         });
 
         server.begin();
@@ -365,15 +692,29 @@ void setup() {
 /**
  * @brief Main loop function that continuously checks and handles WiFi connectivity and data broadcasting.
  *
- * This function checks if the device is connected to WiFi and sends sensor data at predefined intervals.
+ * This function accounts energy on every tick of the sample scheduler and sends sensor data
+ * while connected to WiFi.
  */
 void loop() {
-    if (WiFi.status() == WL_CONNECTED && (millis() - previousMillis) > updateInterval) {
-        String sensorData = fetchSensorData();
-        Serial.print(sensorData);
-        broadcastReadings(sensorData);
-        previousMillis = millis();
+    pulseInput.poll();
+    if (timeSync.poll()) {
+        printLocalTime();
+    }
+    if (!sdCardReady && millis() - lastCardCheck >= SD_RETRY_INTERVAL_MS) {
+        setupSDCard();
     }
+    if (sampleScheduler.takeTick()) {
+        // Energy is accounted and checkpointed offline too, so a reset without WiFi loses no pulses
+        pulseInput.account();
+        if (WiFi.status() == WL_CONNECTED) {
+            String sensorData = fetchSensorData();
+            Serial.print(sensorData);
+            broadcastReadings(sensorData);
+        }
+        energyStore.maintain();
+    }
+    serveReadingsRequests();
+    powerManagement.waitForWork();
 }
 
 /**
@@ -389,17 +730,3 @@ void printLocalTime() {
     }
     Serial.println(&timeinfo, "%A, %B %d %Y %H:%M:%S");
 }
-
-/**
- * @brief Synchronizes system time with NTP server.
- *
- * This function waits until the system time has been successfully synchronized with the NTP server.
- */
-void syncTime() {
-    struct tm timeinfo;
-    while (!getLocalTime(&timeinfo)) {
-        Serial.println("Waiting for time synchronization...");
-        delay(1000);
-    }
-    Serial.println("Time synchronized");
-}
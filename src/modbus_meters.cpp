@@ -0,0 +1,191 @@
+/**
+ * @file modbus_meters.cpp
+ * @brief UART side of the Modbus RTU master.
+ */
+
+#include "modbus_meters.h"
+
+#define MODBUS_FUNCTION MODBUS_READ_INPUT /**< Function code used for the register map. */
+
+/**
+ * @brief Register map, sorted by register (Eastron SDM style input registers).
+ */
+static const ModbusPoint meterPoints[] = {
+    { "voltage", 0x0000, MODBUS_FLOAT32, 1.0f },
+    { "current", 0x0006, MODBUS_FLOAT32, 1.0f },
+    { "activePower", 0x000C, MODBUS_FLOAT32, 1.0f },
+    { "powerFactor", 0x001E, MODBUS_FLOAT32, 1.0f },
+    { "frequency", 0x0046, MODBUS_FLOAT32, 1.0f },
+    { "importEnergy", 0x0048, MODBUS_FLOAT32, 1000.0f }, // kWh to Wh
+};
+static const size_t meterPointCount = sizeof(meterPoints) / sizeof(meterPoints[0]);
+static_assert(sizeof(meterPoints) / sizeof(meterPoints[0]) <= MAX_MODBUS_POINTS, "Too many Modbus points");
+
+static const uint8_t meterAddresses[] = { MODBUS_METER_ADDRESSES }; /**< Configured slave addresses. */
+static portMUX_TYPE meterMux = portMUX_INITIALIZER_UNLOCKED; /**< Guards meter values shared with the record path. */
+
+ModbusMeters modbusMeters;
+
+void ModbusMeters::begin() {
+    if (!enabled()) {
+        return;
+    }
+
+    meterCount = min(sizeof(meterAddresses), (size_t)MAX_MODBUS_METERS);
+    for (size_t i = 0; i < meterCount; i++) {
+        meters[i] = ModbusMeter();
+        meters[i].address = meterAddresses[i];
+    }
+    spanCount = modbusPlanSpans(meterPoints, meterPointCount, MODBUS_MAX_GAP, spans, MAX_MODBUS_SPANS);
+    frameGapUs = modbusFrameGapMicros(MODBUS_BAUD);
+
+    Serial2.begin(MODBUS_BAUD, SERIAL_8N1, MODBUS_RX_PIN, MODBUS_TX_PIN);
+    Serial2.setPins(MODBUS_RX_PIN, MODBUS_TX_PIN, -1, MODBUS_DE_PIN);
+    Serial2.setMode(UART_MODE_RS485_HALF_DUPLEX);
+    Serial2.setTimeout(MODBUS_RESPONSE_TIMEOUT_MS);
+
+    xTaskCreatePinnedToCore(pollTask, "modbus", 4096, this, 2, nullptr, 0);
+    Serial.printf("Modbus polling %u meter(s) with %u request(s) each\n", (unsigned)meterCount, (unsigned)spanCount);
+}
+
+bool ModbusMeters::readSpan(ModbusMeter& meter, const ModbusSpan& span, uint16_t* registers) {
+    uint8_t request[MODBUS_REQUEST_LENGTH];
+    uint8_t response[5 + 2 * MODBUS_MAX_READ_REGISTERS];
+    modbusBuildReadRequest(request, meter.address, MODBUS_FUNCTION, span.start, span.count);
+
+    // Keep the bus silent for t3.5 after the previous frame, but no longer
+    uint32_t idle = micros() - lastFrameEndUs;
+    if (idle < frameGapUs) {
+        delayMicroseconds(frameGapUs - idle);
+    }
+    while (Serial2.available()) {
+        Serial2.read(); // discard late bytes from a previous timeout
+    }
+    Serial2.write(request, sizeof(request));
+    Serial2.flush();
+    requests++;
+
+    // Read the exception-sized head first, then the rest of a normal answer
+    size_t expected = modbusReadResponseLength(span.count);
+    size_t length = Serial2.readBytes(response, MODBUS_EXCEPTION_LENGTH);
+    if (length == MODBUS_EXCEPTION_LENGTH && response[1] == MODBUS_FUNCTION) {
+        length += Serial2.readBytes(response + length, expected - length);
+    }
+    lastFrameEndUs = micros();
+
+    uint8_t exceptionCode = 0;
+    ModbusStatus status = modbusParseReadResponse(response, length, meter.address, MODBUS_FUNCTION,
+                                                  span.count, registers, &exceptionCode);
+    switch (status) {
+        case MODBUS_OK:
+            registersRead += span.count;
+            return true;
+        case MODBUS_CRC_ERROR:
+            meter.crcErrors++;
+            break;
+        case MODBUS_BAD_FRAME:
+            meter.badFrames++;
+            break;
+        case MODBUS_EXCEPTION:
+            meter.exceptions++;
+            break;
+        case MODBUS_TIMEOUT:
+            meter.timeouts++;
+            break;
+    }
+    return false;
+}
+
+void ModbusMeters::pollTask(void* param) {
+    ModbusMeters* self = (ModbusMeters*)param;
+    uint16_t registers[MODBUS_MAX_READ_REGISTERS];
+
+    for (;;) {
+        uint32_t roundStart = micros();
+        uint32_t registersBefore = self->registersRead;
+
+        for (size_t m = 0; m < self->meterCount; m++) {
+            ModbusMeter& meter = self->meters[m];
+            float values[MAX_MODBUS_POINTS];
+            bool valid = true;
+
+            for (size_t s = 0; s < self->spanCount; s++) {
+                const ModbusSpan& span = self->spans[s];
+                if (!self->readSpan(meter, span, registers)) {
+                    valid = false;
+                    continue;
+                }
+                for (size_t p = 0; p < meterPointCount; p++) {
+                    const ModbusPoint& point = meterPoints[p];
+                    if (point.reg >= span.start && point.reg + modbusTypeWidth(point.type) <= span.start + span.count) {
+                        values[p] = modbusDecode(&registers[point.reg - span.start], point);
+                    }
+                }
+            }
+
+            portENTER_CRITICAL(&meterMux);
+            if (valid) {
+                memcpy(meter.values, values, sizeof(values));
+            }
+            meter.valid = valid;
+            portEXIT_CRITICAL(&meterMux);
+        }
+
+        self->roundMicros = micros() - roundStart;
+        self->roundRegisters = self->registersRead - registersBefore;
+        vTaskDelay(MODBUS_POLL_INTERVAL_MS > 0 ? pdMS_TO_TICKS(MODBUS_POLL_INTERVAL_MS) : 1);
+    }
+}
+
+void ModbusMeters::addToRecord(JSONVar& record) const {
+    if (!enabled()) {
+        return;
+    }
+
+    JSONVar list = JSON.parse("[]");
+    int index = 0;
+    for (size_t m = 0; m < meterCount; m++) {
+        portENTER_CRITICAL(&meterMux);
+        ModbusMeter meter = meters[m];
+        portEXIT_CRITICAL(&meterMux);
+        if (!meter.valid) {
+            continue;
+        }
+
+        JSONVar entry;
+        entry["addr"] = meter.address;
+        entry["index"] = (int)m; // keeps the log channel when earlier meters are missing
+        for (size_t p = 0; p < meterPointCount; p++) {
+            entry[meterPoints[p].name] = String(meter.values[p]);
+        }
+        list[index++] = entry;
+    }
+    record["meters"] = list;
+}
+
+JSONVar ModbusMeters::statusJson() const {
+    JSONVar status;
+    status["enabled"] = enabled();
+    if (enabled()) {
+        status["baud"] = MODBUS_BAUD;
+        status["requestsPerMeter"] = (double)spanCount;
+        status["requests"] = (double)requests;
+        status["registersRead"] = (double)registersRead;
+        status["roundMs"] = roundMicros / 1000.0;
+        status["registersPerSecond"] = roundMicros ? roundRegisters * 1e6 / roundMicros : 0.0;
+
+        JSONVar list = JSON.parse("[]");
+        for (size_t m = 0; m < meterCount; m++) {
+            JSONVar entry;
+            entry["addr"] = meters[m].address;
+            entry["valid"] = meters[m].valid;
+            entry["timeouts"] = (double)meters[m].timeouts;
+            entry["crcErrors"] = (double)meters[m].crcErrors;
+            entry["badFrames"] = (double)meters[m].badFrames;
+            entry["exceptions"] = (double)meters[m].exceptions;
+            list[(int)m] = entry;
+        }
+        status["meters"] = list;
+    }
+    return status;
+}
@@ -0,0 +1,130 @@
+/**
+ * @file modbus_rtu.cpp
+ * @brief Modbus RTU framing and decoding.
+ */
+
+#include "modbus_rtu.h"
+#include <string.h>
+
+uint16_t modbusCrc16(const uint8_t* data, size_t length) {
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+        }
+    }
+    return crc;
+}
+
+uint8_t modbusTypeWidth(ModbusType type) {
+    return (type == MODBUS_U16 || type == MODBUS_S16) ? 1 : 2;
+}
+
+size_t modbusBuildReadRequest(uint8_t* frame, uint8_t address, uint8_t function, uint16_t start, uint16_t count) {
+    frame[0] = address;
+    frame[1] = function;
+    frame[2] = start >> 8;
+    frame[3] = start & 0xFF;
+    frame[4] = count >> 8;
+    frame[5] = count & 0xFF;
+    uint16_t crc = modbusCrc16(frame, 6);
+    frame[6] = crc & 0xFF; // CRC is sent low byte first
+    frame[7] = crc >> 8;
+    return MODBUS_REQUEST_LENGTH;
+}
+
+/**
+ * @brief Check the trailing CRC of a frame.
+ */
+static bool frameCrcValid(const uint8_t* frame, size_t length) {
+    uint16_t crc = modbusCrc16(frame, length - 2);
+    return frame[length - 2] == (crc & 0xFF) && frame[length - 1] == (crc >> 8);
+}
+
+ModbusStatus modbusParseReadResponse(const uint8_t* frame, size_t length, uint8_t address, uint8_t function,
+                                     uint16_t count, uint16_t* registers, uint8_t* exceptionCode) {
+    if (length >= MODBUS_EXCEPTION_LENGTH && frame[1] == (function | 0x80)) {
+        if (!frameCrcValid(frame, MODBUS_EXCEPTION_LENGTH)) {
+            return MODBUS_CRC_ERROR;
+        }
+        if (exceptionCode) {
+            *exceptionCode = frame[2];
+        }
+        return frame[0] == address ? MODBUS_EXCEPTION : MODBUS_BAD_FRAME;
+    }
+
+    size_t expected = modbusReadResponseLength(count);
+    if (length < expected) {
+        return MODBUS_TIMEOUT;
+    }
+    if (!frameCrcValid(frame, expected)) {
+        return MODBUS_CRC_ERROR;
+    }
+    if (frame[0] != address || frame[1] != function || frame[2] != 2 * count) {
+        return MODBUS_BAD_FRAME;
+    }
+
+    for (uint16_t i = 0; i < count; i++) {
+        registers[i] = (frame[3 + 2 * i] << 8) | frame[4 + 2 * i];
+    }
+    return MODBUS_OK;
+}
+
+size_t modbusPlanSpans(const ModbusPoint* points, size_t pointCount, uint16_t maxGap, ModbusSpan* spans, size_t maxSpans) {
+    size_t spanCount = 0;
+    for (size_t i = 0; i < pointCount; i++) {
+        uint16_t start = points[i].reg;
+        uint16_t end = start + modbusTypeWidth(points[i].type); // exclusive
+
+        if (spanCount > 0) {
+            ModbusSpan& span = spans[spanCount - 1];
+            uint16_t spanEnd = span.start + span.count;
+            if (start <= spanEnd + maxGap && end - span.start <= MODBUS_MAX_READ_REGISTERS) {
+                if (end > spanEnd) {
+                    span.count = end - span.start;
+                }
+                continue;
+            }
+        }
+        if (spanCount == maxSpans) {
+            break;
+        }
+        spans[spanCount].start = start;
+        spans[spanCount].count = end - start;
+        spanCount++;
+    }
+    return spanCount;
+}
+
+float modbusDecode(const uint16_t* registers, const ModbusPoint& point) {
+    uint32_t wide = ((uint32_t)registers[0] << 16) | (modbusTypeWidth(point.type) > 1 ? registers[1] : 0);
+    float value;
+    switch (point.type) {
+        case MODBUS_U16:
+            value = registers[0];
+            break;
+        case MODBUS_S16:
+            value = (int16_t)registers[0];
+            break;
+        case MODBUS_U32:
+            value = wide;
+            break;
+        case MODBUS_S32:
+            value = (int32_t)wide;
+            break;
+        case MODBUS_FLOAT32:
+        default:
+            memcpy(&value, &wide, sizeof(value));
+            break;
+    }
+    return value * point.scale;
+}
+
+uint32_t modbusFrameGapMicros(uint32_t baud) {
+    // 3.5 characters of 11 bits; fixed at 1750 us above 19200 baud
+    if (baud > 19200) {
+        return 1750;
+    }
+    return (uint32_t)(3.5 * 11 * 1000000UL / baud);
+}
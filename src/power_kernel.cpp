@@ -0,0 +1,111 @@
+/**
+ * @file power_kernel.cpp
+ * @brief Fixed-point RMS and real power kernel.
+ */
+
+#include "power_kernel.h"
+
+#define OFFSET_SHIFT 13 /**< DC tracking time constant, 2^13 samples. */
+#define CROSSING_HYSTERESIS_Q4 (4 << 4) /**< Voltage must drop 4 counts below the bias to re-arm. */
+#define ADC_MIDSCALE 2048 /**< Bias assumed before the tracker settles. */
+
+void PowerWindow::add(const PowerCycle& cycle) {
+    cycles++;
+    samples += cycle.samples;
+    sumV2 += (uint64_t)cycle.vRmsQ4 * cycle.vRmsQ4 * cycle.samples;
+    sumI2 += (uint64_t)cycle.iRmsQ4 * cycle.iRmsQ4 * cycle.samples;
+    sumP += cycle.powerQ8 * (int64_t)cycle.samples;
+}
+
+uint32_t isqrt64(uint64_t value) {
+    uint64_t result = 0;
+    uint64_t bit = (uint64_t)1 << 62;
+    while (bit > value) {
+        bit >>= 2;
+    }
+    while (bit != 0) {
+        if (value >= result + bit) {
+            value -= result + bit;
+            result = (result >> 1) + bit;
+        } else {
+            result >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t)result;
+}
+
+PowerKernel::PowerKernel(uint32_t minCycleSamples, uint32_t maxCycleSamples)
+    : minSamples(minCycleSamples), maxSamples(maxCycleSamples) {
+    reset();
+}
+
+void PowerKernel::reset() {
+    vOffsetQ16 = ADC_MIDSCALE << 16;
+    iOffsetQ16 = ADC_MIDSCALE << 16;
+    armed = false;
+    synced = false;
+    samples = 0;
+    sumV2 = sumI2 = 0;
+    sumP = 0;
+}
+
+void PowerKernel::closeCycle(PowerCycle& result) {
+    result.samples = samples;
+    result.vRmsQ4 = isqrt64(sumV2 / samples);
+    result.iRmsQ4 = isqrt64(sumI2 / samples);
+    result.powerQ8 = sumP / (int64_t)samples;
+
+    int64_t apparent = (int64_t)result.vRmsQ4 * result.iRmsQ4;
+    int64_t pf = apparent > 0 ? (result.powerQ8 << 15) / apparent : 0;
+    if (pf > 32767) {
+        pf = 32767;
+    } else if (pf < -32767) {
+        pf = -32767;
+    }
+    result.pfQ15 = (int16_t)pf;
+
+    samples = 0;
+    sumV2 = sumI2 = 0;
+    sumP = 0;
+}
+
+size_t PowerKernel::process(const uint16_t* voltage, const uint16_t* current, size_t count, PowerCycle* cycles, size_t maxCycles) {
+    size_t produced = 0;
+
+    for (size_t n = 0; n < count; n++) {
+        int32_t rawV = voltage[n];
+        int32_t rawI = current[n];
+        vOffsetQ16 += ((rawV << 16) - vOffsetQ16) >> OFFSET_SHIFT;
+        iOffsetQ16 += ((rawI << 16) - iOffsetQ16) >> OFFSET_SHIFT;
+        int32_t v = (rawV << 4) - (vOffsetQ16 >> 12);
+        int32_t i = (rawI << 4) - (iOffsetQ16 >> 12);
+
+        if (v < -CROSSING_HYSTERESIS_Q4) {
+            armed = true;
+        } else if (armed && v >= 0) {
+            armed = false;
+            if (!synced) {
+                // Start integrating at the first crossing so cycles are whole
+                synced = true;
+                samples = 0;
+                sumV2 = sumI2 = 0;
+                sumP = 0;
+            } else if (samples >= minSamples && produced < maxCycles) {
+                closeCycle(cycles[produced++]);
+            }
+        }
+
+        sumV2 += (uint64_t)((int64_t)v * v);
+        sumI2 += (uint64_t)((int64_t)i * i);
+        sumP += (int64_t)v * i;
+        samples++;
+
+        if (samples >= maxSamples && produced < maxCycles) {
+            // No voltage crossings: keep reporting current on a fixed period
+            synced = false;
+            closeCycle(cycles[produced++]);
+        }
+    }
+    return produced;
+}
@@ -0,0 +1,161 @@
+/**
+ * @file power_management.cpp
+ * @brief Frequency scaling, light sleep and modem sleep setup.
+ */
+
+#include "power_management.h"
+#include "pulse_input.h"
+#include "sample_scheduler.h"
+#include <WiFi.h>
+#include <esp_pm.h>
+#include <esp_wifi.h>
+#include <stdio.h>
+
+#define BEACON_INTERVAL_MS 102 /**< Typical access point beacon interval (100 TU). */
+
+PowerManagement powerManagement;
+
+static portMUX_TYPE sleepMux = portMUX_INITIALIZER_UNLOCKED; /**< Guards the light sleep counters against the idle task. */
+
+#if POWER_SLEEP_TRACE
+extern "C" esp_err_t __real_esp_light_sleep_start();
+
+/**
+ * @brief Times each light sleep that esp_pm enters from the idle task.
+ *
+ * Linked in place of esp_light_sleep_start() by -Wl,--wrap. esp_timer is
+ * corrected for the sleep, so the difference is the time spent asleep.
+ */
+extern "C" esp_err_t IRAM_ATTR __wrap_esp_light_sleep_start() {
+    int64_t start = esp_timer_get_time();
+    esp_err_t result = __real_esp_light_sleep_start();
+    powerManagement.noteLightSleep(esp_timer_get_time() - start, result == ESP_OK);
+    return result;
+}
+#endif
+
+#if CONFIG_PM_PROFILING
+/**
+ * @brief Milliseconds per esp_pm mode, parsed from the esp_pm_dump_locks() mode table.
+ *
+ * Table rows read "CPU_MAX   240M       123456      12%".
+ */
+static JSONVar pmModeResidency() {
+    JSONVar modes;
+    char* text = nullptr;
+    size_t length = 0;
+    FILE* out = open_memstream(&text, &length);
+    if (out == nullptr) {
+        return modes;
+    }
+    esp_pm_dump_locks(out);
+    fclose(out);
+
+    char* table = strstr(text, "Mode stats:");
+    char* context = nullptr;
+    for (char* line = table ? strtok_r(table, "\n", &context) : nullptr; line; line = strtok_r(nullptr, "\n", &context)) {
+        char mode[16];
+        int mhz;
+        long long timeUs;
+        // The title and the column header do not match and are skipped
+        if (sscanf(line, "%15s %dM %lld", mode, &mhz, &timeUs) == 3) {
+            modes[mode] = (double)(timeUs / 1000);
+        }
+    }
+    free(text);
+    return modes;
+}
+#endif
+
+void PowerManagement::begin() {
+    if (!enabled()) {
+        return;
+    }
+
+    // Edge interrupts are not serviced in light sleep, so a pulse input keeps the CPU awake
+    lightSleep = !pulseInput.enabled();
+
+    esp_pm_config_esp32_t config = {};
+    config.max_freq_mhz = getCpuFrequencyMhz();
+    config.min_freq_mhz = POWER_MIN_CPU_MHZ;
+    config.light_sleep_enable = lightSleep;
+    esp_err_t result = esp_pm_configure(&config);
+    pmConfigured = result == ESP_OK;
+    if (!pmConfigured) {
+        Serial.printf("Power management unavailable (%s), using modem sleep only\n", esp_err_to_name(result));
+    }
+
+    // The station wakes every listenInterval beacons, which bounds the receive latency
+    listenInterval = max(1, POWER_MAX_LATENCY_MS / BEACON_INTERVAL_MS);
+    wifi_config_t wifiConfig;
+    if (esp_wifi_get_config(WIFI_IF_STA, &wifiConfig) == ESP_OK) {
+        wifiConfig.sta.listen_interval = listenInterval;
+        esp_wifi_set_config(WIFI_IF_STA, &wifiConfig);
+    }
+    esp_wifi_set_ps(listenInterval > 1 ? WIFI_PS_MAX_MODEM : WIFI_PS_MIN_MODEM);
+    // The listen interval is announced on association
+    WiFi.reconnect();
+
+    lastChangeUs = esp_timer_get_time();
+    Serial.printf("Power save mode: light sleep %s, listen interval %u\n", pmConfigured && lightSleep ? "on" : "off", listenInterval);
+}
+
+void PowerManagement::waitForWork() {
+    if (!enabled()) {
+        return;
+    }
+
+    int64_t now = esp_timer_get_time();
+    stateUs[POWER_ACTIVE] += now - lastChangeUs;
+
+    sampleScheduler.waitForTick(POWER_WAKE_MS);
+
+    lastChangeUs = esp_timer_get_time();
+    stateUs[POWER_IDLE] += lastChangeUs - now;
+}
+
+void IRAM_ATTR PowerManagement::noteLightSleep(int64_t sleptUs, bool woke) {
+    // esp_pm calls this inside its own critical section
+    portENTER_CRITICAL_SAFE(&sleepMux);
+    if (woke) {
+        lightSleepUs += sleptUs;
+        lightSleeps++;
+    } else {
+        lightSleepRejects++;
+    }
+    portEXIT_CRITICAL_SAFE(&sleepMux);
+}
+
+JSONVar PowerManagement::statusJson() const {
+    JSONVar status;
+    status["enabled"] = enabled();
+    if (enabled()) {
+        status["pmConfigured"] = pmConfigured;
+        status["lightSleep"] = pmConfigured && lightSleep;
+        status["minCpuMhz"] = POWER_MIN_CPU_MHZ;
+        status["listenInterval"] = listenInterval;
+        status["maxLatencyMs"] = POWER_MAX_LATENCY_MS;
+        status["activeMs"] = (double)(stateUs[POWER_ACTIVE] / 1000);
+        status["idleMs"] = (double)(stateUs[POWER_IDLE] / 1000);
+        int64_t total = stateUs[POWER_ACTIVE] + stateUs[POWER_IDLE];
+        status["activeRatio"] = total > 0 ? (double)stateUs[POWER_ACTIVE] / total : 1.0;
+
+        portENTER_CRITICAL(&sleepMux);
+        int64_t sleptUs = lightSleepUs;
+        uint32_t sleeps = lightSleeps;
+        uint32_t rejects = lightSleepRejects;
+        portEXIT_CRITICAL(&sleepMux);
+        status["sleepTrace"] = POWER_SLEEP_TRACE != 0;
+        if (POWER_SLEEP_TRACE) {
+            int64_t uptimeUs = esp_timer_get_time();
+            status["lightSleepMs"] = (double)(sleptUs / 1000);
+            status["lightSleeps"] = (double)sleeps;
+            status["lightSleepRejects"] = (double)rejects;
+            status["lightSleepRatio"] = uptimeUs > 0 ? (double)sleptUs / uptimeUs : 0.0;
+        }
+#if CONFIG_PM_PROFILING
+        status["modeMs"] = pmModeResidency();
+#endif
+    }
+    return status;
+}
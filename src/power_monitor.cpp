@@ -0,0 +1,254 @@
+/**
+ * @file power_monitor.cpp
+ * @brief Continuous ADC capture and per-cycle power processing.
+ */
+
+#include "power_monitor.h"
+#include <driver/adc.h>
+#include <esp_timer.h>
+
+#define ADC_READ_BYTES 1024 /**< Bytes fetched from the ADC driver per read. */
+#define MAX_CYCLES_PER_BLOCK 16 /**< Upper bound of mains cycles in one block. */
+
+static portMUX_TYPE windowMux = portMUX_INITIALIZER_UNLOCKED; /**< Guards the window shared with the record path. */
+
+PowerMonitor powerMonitor;
+
+PowerMonitor::PowerMonitor()
+    // Accept 40-70 Hz mains; without voltage, close a cycle every 50 ms
+    : kernel(POWER_CHANNEL_RATE_HZ / 70, POWER_CHANNEL_RATE_HZ / 20),
+      voltageHarmonics(HARMONICS_FFT_SIZE, HARMONICS_DECIMATION, POWER_CHANNEL_RATE_HZ, POWER_VOLTS_PER_COUNT),
+      currentHarmonics(HARMONICS_FFT_SIZE, HARMONICS_DECIMATION, POWER_CHANNEL_RATE_HZ, POWER_AMPS_PER_COUNT) {
+}
+
+void PowerMonitor::begin() {
+    if (!enabled()) {
+        return;
+    }
+
+    adc_digi_init_config_t init = {};
+    init.max_store_buf_size = 4 * ADC_READ_BYTES;
+    init.conv_num_each_intr = ADC_READ_BYTES;
+    init.adc1_chan_mask = BIT(POWER_VOLTAGE_CHANNEL) | BIT(POWER_CURRENT_CHANNEL);
+    init.adc2_chan_mask = 0;
+    if (adc_digi_initialize(&init) != ESP_OK) {
+        Serial.println("Failed to initialise continuous ADC");
+        return;
+    }
+
+    adc_digi_pattern_config_t pattern[2] = {};
+    const uint8_t channels[2] = { POWER_VOLTAGE_CHANNEL, POWER_CURRENT_CHANNEL };
+    for (int i = 0; i < 2; i++) {
+        pattern[i].atten = ADC_ATTEN_DB_11;
+        pattern[i].channel = channels[i];
+        pattern[i].unit = 0; // ADC1
+        pattern[i].bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+    }
+
+    adc_digi_configuration_t config = {};
+    config.conv_limit_en = true;
+    config.conv_limit_num = 250;
+    config.pattern_num = 2;
+    config.adc_pattern = pattern;
+    config.sample_freq_hz = POWER_SAMPLE_RATE_HZ;
+    config.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+    config.format = ADC_DIGI_OUTPUT_FORMAT_TYPE1;
+    if (adc_digi_controller_configure(&config) != ESP_OK || adc_digi_start() != ESP_OK) {
+        Serial.println("Failed to start continuous ADC");
+        return;
+    }
+
+    xTaskCreatePinnedToCore(processTask, "power", 4096, this, 3, &processHandle, 1);
+    xTaskCreatePinnedToCore(captureTask, "adc", 4096, this, 4, nullptr, 1);
+    xTaskCreatePinnedToCore(harmonicsTask, "harmonics", 4096, this, 1, nullptr, 1);
+    Serial.printf("Power monitor sampling at %d Hz per channel\n", POWER_CHANNEL_RATE_HZ);
+}
+
+void PowerMonitor::captureTask(void* param) {
+    PowerMonitor* self = (PowerMonitor*)param;
+    static uint8_t raw[ADC_READ_BYTES];
+    int fill = 0;
+    size_t voltageCount = 0;
+    size_t currentCount = 0;
+    bool dropping = false;
+
+    for (;;) {
+        uint32_t length = 0;
+        if (adc_digi_read_bytes(raw, sizeof(raw), &length, ADC_MAX_DELAY) != ESP_OK) {
+            continue;
+        }
+
+        for (uint32_t offset = 0; offset + sizeof(adc_digi_output_data_t) <= length; offset += sizeof(adc_digi_output_data_t)) {
+            if (dropping) {
+                if (self->blockBusy[fill]) {
+                    continue;
+                }
+                dropping = false;
+            }
+
+            const adc_digi_output_data_t* sample = (const adc_digi_output_data_t*)&raw[offset];
+            uint16_t value = sample->type1.data;
+            if (sample->type1.channel == POWER_VOLTAGE_CHANNEL && voltageCount < POWER_BLOCK_SAMPLES) {
+                self->voltageBlocks[fill][voltageCount++] = value;
+            } else if (sample->type1.channel == POWER_CURRENT_CHANNEL && currentCount < POWER_BLOCK_SAMPLES) {
+                self->currentBlocks[fill][currentCount++] = value;
+            }
+
+            if (voltageCount == POWER_BLOCK_SAMPLES && currentCount == POWER_BLOCK_SAMPLES) {
+                self->blockBusy[fill] = true;
+                xTaskNotify(self->processHandle, fill, eSetValueWithOverwrite);
+                fill ^= 1;
+                voltageCount = currentCount = 0;
+                if (self->blockBusy[fill]) {
+                    // Processing still owns the other block: skip samples until it is released
+                    self->overruns++;
+                    dropping = true;
+                }
+            }
+        }
+    }
+}
+
+void PowerMonitor::processTask(void* param) {
+    PowerMonitor* self = (PowerMonitor*)param;
+    PowerCycle cycles[MAX_CYCLES_PER_BLOCK];
+
+    for (;;) {
+        uint32_t block;
+        xTaskNotifyWait(0, 0, &block, portMAX_DELAY);
+
+        uint32_t start = ESP.getCycleCount();
+        size_t count = self->kernel.process(self->voltageBlocks[block], self->currentBlocks[block],
+                                            POWER_BLOCK_SAMPLES, cycles, MAX_CYCLES_PER_BLOCK);
+        uint32_t spent = ESP.getCycleCount() - start;
+        for (size_t i = 0; i < POWER_BLOCK_SAMPLES; i++) {
+            self->voltageHarmonics.add(self->voltageBlocks[block][i]);
+            self->currentHarmonics.add(self->currentBlocks[block][i]);
+        }
+        self->blockBusy[block] = false;
+
+        portENTER_CRITICAL(&windowMux);
+        for (size_t i = 0; i < count; i++) {
+            self->window.add(cycles[i]);
+        }
+        if (count > 0) {
+            self->lastCycle = cycles[count - 1];
+        }
+        self->blocks++;
+        self->kernelCycles += spent;
+        self->kernelSamples += POWER_BLOCK_SAMPLES;
+        portEXIT_CRITICAL(&windowMux);
+    }
+}
+
+void PowerMonitor::harmonicsTask(void* param) {
+    PowerMonitor* self = (PowerMonitor*)param;
+    TickType_t lastWake = xTaskGetTickCount();
+
+    for (;;) {
+        vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(HARMONICS_INTERVAL_MS));
+        if (!self->voltageHarmonics.ready() || !self->currentHarmonics.ready()) {
+            continue;
+        }
+
+        HarmonicResult voltage;
+        HarmonicResult current;
+        int64_t start = esp_timer_get_time();
+        self->voltageHarmonics.analyze(voltage);
+        self->currentHarmonics.analyze(current);
+        uint32_t spent = (uint32_t)(esp_timer_get_time() - start);
+
+        portENTER_CRITICAL(&windowMux);
+        self->voltageResult = voltage;
+        self->currentResult = current;
+        self->analyses++;
+        self->analysisMicros = spent;
+        self->maxAnalysisMicros = max(self->maxAnalysisMicros, spent);
+        if (spent > self->voltageHarmonics.windowMicros()) {
+            self->overBudget++;
+        }
+        portEXIT_CRITICAL(&windowMux);
+    }
+}
+
+/**
+ * @brief Harmonic results of one channel as JSON.
+ */
+static JSONVar harmonicsJson(const HarmonicResult& result) {
+    JSONVar json;
+    json["fundamentalHz"] = result.fundamentalHz;
+    json["fundamentalRms"] = result.fundamentalRms;
+    json["thd"] = result.thd;
+    JSONVar magnitudes = JSON.parse("[]");
+    for (int h = 0; h < HARMONIC_COUNT; h++) {
+        magnitudes[h] = result.magnitudes[h];
+    }
+    json["harmonics"] = magnitudes;
+    return json;
+}
+
+void PowerMonitor::addToRecord(JSONVar& record) {
+    if (!enabled()) {
+        return;
+    }
+
+    portENTER_CRITICAL(&windowMux);
+    PowerWindow closed = window;
+    window = PowerWindow();
+    portEXIT_CRITICAL(&windowMux);
+
+    if (closed.samples == 0) {
+        return;
+    }
+
+    // Q4 counts to counts, then to physical units
+    float vRms = sqrtf((float)closed.sumV2 / closed.samples) / 16.0f * POWER_VOLTS_PER_COUNT;
+    float iRms = sqrtf((float)closed.sumI2 / closed.samples) / 16.0f * POWER_AMPS_PER_COUNT;
+    float power = (float)closed.sumP / closed.samples / 256.0f * POWER_VOLTS_PER_COUNT * POWER_AMPS_PER_COUNT;
+    float apparent = vRms * iRms;
+
+    record["vrms"] = String(vRms);
+    record["irms"] = String(iRms, 3);
+    record["realPower"] = String(power);
+    record["pf"] = String(apparent > 0 ? power / apparent : 0.0f, 3);
+    record["freq"] = String((float)POWER_CHANNEL_RATE_HZ * closed.cycles / closed.samples);
+}
+
+JSONVar PowerMonitor::statusJson() const {
+    JSONVar status;
+    status["enabled"] = enabled();
+    if (enabled()) {
+        portENTER_CRITICAL(&windowMux);
+        uint32_t blockCount = blocks;
+        uint64_t cycles = kernelCycles;
+        uint64_t samples = kernelSamples;
+        PowerCycle last = lastCycle;
+        HarmonicResult voltage = voltageResult;
+        HarmonicResult current = currentResult;
+        uint32_t analysisCount = analyses;
+        uint32_t lastMicros = analysisMicros;
+        uint32_t worstMicros = maxAnalysisMicros;
+        uint32_t late = overBudget;
+        portEXIT_CRITICAL(&windowMux);
+
+        status["channelRateHz"] = POWER_CHANNEL_RATE_HZ;
+        status["blocks"] = (double)blockCount;
+        status["overruns"] = (double)overruns;
+        status["cyclesPerSample"] = samples ? (double)cycles / samples : 0.0;
+        status["lastCycleSamples"] = (double)last.samples;
+        status["lastPf"] = last.pfQ15 / 32768.0;
+
+        JSONVar harmonics;
+        harmonics["fftSize"] = HARMONICS_FFT_SIZE;
+        harmonics["intervalMs"] = HARMONICS_INTERVAL_MS;
+        harmonics["analyses"] = (double)analysisCount;
+        harmonics["lastUs"] = (double)lastMicros;
+        harmonics["maxUs"] = (double)worstMicros;
+        harmonics["budgetUs"] = (double)voltageHarmonics.windowMicros();
+        harmonics["overBudget"] = (double)late;
+        harmonics["voltage"] = harmonicsJson(voltage);
+        harmonics["current"] = harmonicsJson(current);
+        status["harmonics"] = harmonics;
+    }
+    return status;
+}
@@ -0,0 +1,94 @@
+/**
+ * @file pulse_input.cpp
+ * @brief GPIO interrupt and ring draining for the pulse input channel.
+ */
+
+#include "pulse_input.h"
+#include "energy_store.h"
+
+static PulseRing<uint32_t, PULSE_RING_SIZE> pulseRing; /**< Pulse timestamps from the interrupt. */
+static volatile uint32_t pulseTotal = 0; /**< Accepted pulses since boot. */
+static volatile uint32_t lastPulseUs = 0; /**< Timestamp of the last accepted pulse. */
+static volatile uint32_t rejectedPulses = 0; /**< Pulses ignored as bounce. */
+static portMUX_TYPE pulseMux = portMUX_INITIALIZER_UNLOCKED; /**< Guards the counters against the interrupt. */
+
+PulseInput pulseInput;
+
+void IRAM_ATTR PulseInput::handlePulse() {
+    uint32_t now = micros();
+    portENTER_CRITICAL_ISR(&pulseMux);
+    if (pulseTotal != 0 && now - lastPulseUs < PULSE_MIN_INTERVAL_US) {
+        rejectedPulses++;
+        portEXIT_CRITICAL_ISR(&pulseMux);
+        return;
+    }
+    pulseTotal++;
+    lastPulseUs = now;
+    portEXIT_CRITICAL_ISR(&pulseMux);
+    // A full ring only costs the per-pulse timestamp, the count above is kept
+    pulseRing.push(now);
+}
+
+void PulseInput::begin() {
+    if (!enabled()) {
+        return;
+    }
+    pinMode(PULSE_INPUT_PIN, INPUT_PULLUP);
+    meter.reset(snapshot());
+    meter.setEnergyWh(energyStore.get(ENERGY_PULSE));
+    attachInterrupt(digitalPinToInterrupt(PULSE_INPUT_PIN), handlePulse, FALLING);
+    Serial.printf("Pulse input on GPIO %d, %.0f imp/kWh\n", PULSE_INPUT_PIN, PULSES_PER_KWH);
+}
+
+PulseSnapshot PulseInput::snapshot() const {
+    PulseSnapshot snap;
+    portENTER_CRITICAL(&pulseMux);
+    snap.total = pulseTotal;
+    snap.lastPulseUs = lastPulseUs;
+    portEXIT_CRITICAL(&pulseMux);
+    return snap;
+}
+
+void PulseInput::poll() {
+    if (!enabled()) {
+        return;
+    }
+    uint32_t timestamp;
+    while (pulseRing.pop(timestamp)) {
+        meter.consume(timestamp);
+    }
+}
+
+void PulseInput::account() {
+    if (!enabled()) {
+        return;
+    }
+    poll();
+    meter.account(snapshot(), micros());
+    energyStore.set(ENERGY_PULSE, meter.energyWh());
+}
+
+void PulseInput::addToRecord(JSONVar& record) const {
+    if (!enabled()) {
+        return;
+    }
+    record["power"] = String(meter.powerW());
+    record["energy"] = String(meter.energyWh(), 3);
+}
+
+JSONVar PulseInput::statusJson() const {
+    JSONVar status;
+    status["enabled"] = enabled();
+    if (enabled()) {
+        PulseSnapshot snap = snapshot();
+        status["pulses"] = (double)snap.total;
+        status["rejected"] = (double)rejectedPulses;
+        status["ringDropped"] = (double)pulseRing.droppedCount();
+        status["ringDepth"] = (double)pulseRing.size();
+        status["powerW"] = meter.powerW();
+        status["instantPowerW"] = meter.instantPowerW();
+        status["peakPowerW"] = meter.peakPowerW();
+        status["energyWh"] = meter.energyWh();
+    }
+    return status;
+}
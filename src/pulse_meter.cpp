@@ -0,0 +1,69 @@
+/**
+ * @file pulse_meter.cpp
+ * @brief Pulse to energy and power conversion.
+ */
+
+#include "pulse_meter.h"
+
+PulseMeter::PulseMeter(float pulsesPerKWh)
+    : whPerPulse(pulsesPerKWh > 0 ? 1000.0 / pulsesPerKWh : 0.0) {
+}
+
+float PulseMeter::powerFor(uint32_t pulses, uint32_t intervalUs) const {
+    if (intervalUs == 0) {
+        return 0;
+    }
+    // Wh per microsecond to W: * 3600 s/h * 1e6 us/s
+    return (float)(pulses * whPerPulse * 3600e6 / intervalUs);
+}
+
+void PulseMeter::consume(uint32_t timestampUs) {
+    if (haveTimestamp) {
+        instantPower = powerFor(1, timestampUs - previousTimestamp);
+        if (instantPower > windowPeak) {
+            windowPeak = instantPower;
+        }
+    }
+    if (!haveTimestamp) {
+        firstTimestamp = timestampUs;
+    }
+    previousTimestamp = timestampUs;
+    haveTimestamp = true;
+}
+
+void PulseMeter::account(const PulseSnapshot& snapshot, uint32_t nowUs) {
+    uint32_t pulses = snapshot.total - lastTotal;
+    energy += pulses * whPerPulse;
+    windowPulses = pulses;
+
+    if (pulses > 0 && havePulse) {
+        meanPower = powerFor(pulses, snapshot.lastPulseUs - lastPulseUs);
+    } else if (pulses > 1 && haveTimestamp) {
+        // First window after reset: measure from the first timestamp seen
+        meanPower = powerFor(pulses - 1, snapshot.lastPulseUs - firstTimestamp);
+    } else if (havePulse) {
+        // No pulse this window: the power is at most one pulse since the last one
+        float bound = powerFor(1, nowUs - lastPulseUs);
+        if (bound < meanPower) {
+            meanPower = bound;
+        }
+        instantPower = meanPower;
+    }
+
+    if (pulses > 0) {
+        lastPulseUs = snapshot.lastPulseUs;
+        havePulse = true;
+    }
+    lastTotal = snapshot.total;
+    peakPower = windowPeak;
+    windowPeak = 0;
+}
+
+void PulseMeter::reset(const PulseSnapshot& snapshot) {
+    lastTotal = snapshot.total;
+    lastPulseUs = snapshot.lastPulseUs;
+    havePulse = snapshot.total != 0;
+    haveTimestamp = false;
+    meanPower = instantPower = peakPower = windowPeak = 0;
+    windowPulses = 0;
+}
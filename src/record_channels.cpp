@@ -0,0 +1,142 @@
+/**
+ * @file record_channels.cpp
+ * @brief Mapping of record fields to binary log channels.
+ */
+
+#include "record_channels.h"
+#include <DallasTemperature.h>
+
+/**
+ * @brief Scalar record fields with a fixed channel.
+ */
+static const struct {
+    const char* key;
+    uint8_t channel;
+} scalarFields[] = {
+    { "power", CHANNEL_PULSE_POWER },
+    { "energy", CHANNEL_PULSE_ENERGY },
+    { "vrms", CHANNEL_MAINS_VRMS },
+    { "irms", CHANNEL_MAINS_IRMS },
+    { "realPower", CHANNEL_MAINS_POWER },
+    { "pf", CHANNEL_MAINS_PF },
+    { "freq", CHANNEL_MAINS_FREQ },
+};
+static_assert(sizeof(scalarFields) / sizeof(scalarFields[0]) <= CHANNEL_SCALAR_COUNT, "Raise CHANNEL_SCALAR_COUNT");
+
+static uint32_t unmappedFields = 0; /**< Fields without a channel, see unmappedRecordFields(). */
+
+/**
+ * @brief Numeric value of a record field, which may be a number or a numeric string.
+ */
+static float fieldValue(JSONVar value) {
+    if (JSON.typeof_(value) == "string") {
+        return atof((const char*)value);
+    }
+    return (float)(double)value;
+}
+
+/**
+ * @brief Append one entry, marking failed temperature reads as invalid.
+ */
+static void addEntry(LogEntry* entries, size_t& count, int64_t timeMs, uint8_t channel, float value, uint8_t flags) {
+    if (count >= MAX_RECORD_ENTRIES) {
+        unmappedFields++;
+        return;
+    }
+    LogEntry& entry = entries[count++];
+    entry.timeMs = timeMs;
+    entry.channel = channel;
+    entry.value = value;
+    entry.flags = flags;
+    if (channel < CHANNEL_TEMP_BASE + CHANNEL_TEMP_COUNT && value == DEVICE_DISCONNECTED_C) {
+        entry.flags |= RECORD_FLAG_INVALID;
+    }
+}
+
+size_t recordToEntries(JSONVar& record, int64_t timeMs, uint8_t flags, LogEntry* entries) {
+    size_t count = 0;
+
+    if (record.hasOwnProperty("temps")) {
+        JSONVar temps = record["temps"];
+        for (int i = 0; i < temps.length(); i++) {
+            if (i >= CHANNEL_TEMP_COUNT) {
+                unmappedFields++;
+                continue;
+            }
+            addEntry(entries, count, timeMs, CHANNEL_TEMP_BASE + i, fieldValue(temps[i]), flags);
+        }
+    } else if (record.hasOwnProperty("temp")) {
+        addEntry(entries, count, timeMs, CHANNEL_TEMP_BASE, fieldValue(record["temp"]), flags);
+    }
+
+    for (size_t i = 0; i < sizeof(scalarFields) / sizeof(scalarFields[0]); i++) {
+        if (record.hasOwnProperty(scalarFields[i].key)) {
+            addEntry(entries, count, timeMs, scalarFields[i].channel, fieldValue(record[scalarFields[i].key]), flags);
+        }
+    }
+
+    if (record.hasOwnProperty("meters")) {
+        JSONVar meters = record["meters"];
+        for (int m = 0; m < meters.length(); m++) {
+            JSONVar meter = meters[m];
+            // Meters without valid values are left out of the list, so the
+            // channel follows the configured index rather than the position
+            int index = meter.hasOwnProperty("index") ? (int)meter["index"] : m;
+            JSONVar keys = meter.keys();
+            int point = 0;
+            for (int k = 0; k < keys.length(); k++) {
+                String key = (const char*)keys[k];
+                if (key == "addr" || key == "index") {
+                    continue;
+                }
+                if (index < 0 || index >= CHANNEL_MODBUS_METERS || point >= CHANNEL_MODBUS_POINTS) {
+                    unmappedFields++;
+                    continue;
+                }
+                addEntry(entries, count, timeMs, CHANNEL_MODBUS_BASE + CHANNEL_MODBUS_POINTS * index + point,
+                         fieldValue(meter[key]), flags);
+                point++;
+            }
+        }
+    }
+    return count;
+}
+
+uint32_t unmappedRecordFields() {
+    return unmappedFields;
+}
+
+void channelName(uint8_t channel, char* out) {
+    if (channel < CHANNEL_TEMP_BASE + CHANNEL_TEMP_COUNT) {
+        if (channel == CHANNEL_TEMP_BASE) {
+            strcpy(out, "temp");
+        } else {
+            sprintf(out, "temp%u", channel - CHANNEL_TEMP_BASE + 1);
+        }
+        return;
+    }
+    for (size_t i = 0; i < sizeof(scalarFields) / sizeof(scalarFields[0]); i++) {
+        if (scalarFields[i].channel == channel) {
+            strcpy(out, scalarFields[i].key);
+            return;
+        }
+    }
+    if (channel >= CHANNEL_MODBUS_BASE && channel < CHANNEL_MODBUS_BASE + CHANNEL_MODBUS_POINTS * CHANNEL_MODBUS_METERS) {
+        unsigned offset = channel - CHANNEL_MODBUS_BASE;
+        sprintf(out, "meter%u.%u", offset / CHANNEL_MODBUS_POINTS, offset % CHANNEL_MODBUS_POINTS);
+        return;
+    }
+    sprintf(out, "ch%u", channel);
+}
+
+bool channelFromName(const char* name, uint8_t& channel) {
+    char candidate[CHANNEL_NAME_LENGTH];
+    for (unsigned c = 0; c < 256; c++) {
+        channelName((uint8_t)c, candidate);
+        if (strcmp(candidate, name) == 0) {
+            channel = (uint8_t)c;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,246 @@
+/**
+ * @file record_log.cpp
+ * @brief Binary record log encoding and reading.
+ */
+
+#include "record_log.h"
+#include <string.h>
+
+void putLe(uint8_t* out, uint64_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; i++) {
+        out[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+uint64_t getLe(const uint8_t* in, size_t bytes) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; i++) {
+        value |= (uint64_t)in[i] << (8 * i);
+    }
+    return value;
+}
+
+uint16_t recordCrc16(const uint8_t* data, size_t length) {
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+uint32_t recordCrc32Update(uint32_t crc, const uint8_t* data, size_t length) {
+    // Half-byte table: 64 bytes of constants instead of 1 KB
+    static const uint32_t table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+    };
+    for (size_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+    }
+    return crc;
+}
+
+uint32_t recordCrc32(const uint8_t* data, size_t length) {
+    return ~recordCrc32Update(0xFFFFFFFF, data, length);
+}
+
+LogHeader makeLogHeader(int64_t createdMs, uint16_t blockSize, uint32_t journalId) {
+    LogHeader header;
+    header.magic = RECORD_LOG_MAGIC;
+    header.version = blockSize ? RECORD_LOG_VERSION_JOURNAL : RECORD_LOG_VERSION_FLAT;
+    header.headerSize = blockSize ? blockSize : RECORD_LOG_HEADER_SIZE;
+    header.recordSize = RECORD_SIZE;
+    header.blockSize = blockSize;
+    header.journalId = journalId;
+    header.createdMs = createdMs;
+    return header;
+}
+
+// Header layout: magic(4) version(2) headerSize(2) recordSize(2) blockSize(2) reserved(2) createdMs(8) journalId(4) reserved(4) crc(2)
+void encodeLogHeader(const LogHeader& header, uint8_t* out) {
+    memset(out, 0, RECORD_LOG_HEADER_SIZE);
+    putLe(out, header.magic, 4);
+    putLe(out + 4, header.version, 2);
+    putLe(out + 6, header.headerSize, 2);
+    putLe(out + 8, header.recordSize, 2);
+    putLe(out + 10, header.blockSize, 2);
+    putLe(out + 14, (uint64_t)header.createdMs, 8);
+    putLe(out + 22, header.journalId, 4);
+    putLe(out + 30, recordCrc16(out, 30), 2);
+}
+
+bool decodeLogHeader(const uint8_t* in, LogHeader& header) {
+    if (getLe(in + 30, 2) != recordCrc16(in, 30)) {
+        return false;
+    }
+    header.magic = (uint32_t)getLe(in, 4);
+    header.version = (uint16_t)getLe(in + 4, 2);
+    header.headerSize = (uint16_t)getLe(in + 6, 2);
+    header.recordSize = (uint16_t)getLe(in + 8, 2);
+    header.blockSize = (uint16_t)getLe(in + 10, 2);
+    header.createdMs = (int64_t)getLe(in + 14, 8);
+    header.journalId = (uint32_t)getLe(in + 22, 4);
+    if (header.magic != RECORD_LOG_MAGIC || header.recordSize != RECORD_SIZE) {
+        return false;
+    }
+    if (header.version == RECORD_LOG_VERSION_JOURNAL) {
+        return header.blockSize == RECORD_BLOCK_SIZE && header.headerSize == RECORD_BLOCK_SIZE;
+    }
+    return header.version == RECORD_LOG_VERSION_FLAT && header.blockSize == 0
+        && header.headerSize >= RECORD_LOG_HEADER_SIZE;
+}
+
+// Record layout: timeMs(8) value(4) channel(1) flags(1) crc(2)
+void encodeLogEntry(const LogEntry& entry, uint8_t* out) {
+    uint32_t valueBits;
+    memcpy(&valueBits, &entry.value, sizeof(valueBits));
+    putLe(out, (uint64_t)entry.timeMs, 8);
+    putLe(out + 8, valueBits, 4);
+    out[12] = entry.channel;
+    out[13] = entry.flags;
+    putLe(out + 14, recordCrc16(out, 14), 2);
+}
+
+bool decodeLogEntry(const uint8_t* in, LogEntry& entry) {
+    if (getLe(in + 14, 2) != recordCrc16(in, 14)) {
+        return false;
+    }
+    uint32_t valueBits = (uint32_t)getLe(in + 8, 4);
+    entry.timeMs = (int64_t)getLe(in, 8);
+    memcpy(&entry.value, &valueBits, sizeof(entry.value));
+    entry.channel = in[12];
+    entry.flags = in[13];
+    return true;
+}
+
+// Trailer layout, in the last slot: magic(4) sequence(4) count(1) reserved(3) crc32(4) xor journalId
+void sealLogBlock(uint8_t* block, uint32_t sequence, uint8_t count, uint32_t journalId) {
+    uint8_t* trailer = block + RECORD_BLOCK_SLOTS * RECORD_SIZE;
+    // Unused slots are erased-looking and fail the record checksum
+    memset(block + count * RECORD_SIZE, 0xFF, (RECORD_BLOCK_SLOTS - count) * RECORD_SIZE);
+    memset(trailer, 0, RECORD_SIZE);
+    putLe(trailer, RECORD_BLOCK_MAGIC, 4);
+    putLe(trailer + 4, sequence, 4);
+    trailer[8] = count;
+    putLe(trailer + 12, recordCrc32(block, RECORD_BLOCK_SIZE - 4) ^ journalId, 4);
+}
+
+bool checkLogBlock(const uint8_t* block, uint32_t sequence, uint32_t journalId, uint8_t& count) {
+    const uint8_t* trailer = block + RECORD_BLOCK_SLOTS * RECORD_SIZE;
+    if (getLe(trailer, 4) != RECORD_BLOCK_MAGIC || getLe(trailer + 4, 4) != sequence
+        || trailer[8] > RECORD_BLOCK_SLOTS) {
+        return false;
+    }
+    if (getLe(trailer + 12, 4) != (recordCrc32(block, RECORD_BLOCK_SIZE - 4) ^ journalId)) {
+        return false;
+    }
+    count = trailer[8];
+    return true;
+}
+
+uint32_t logBlockSequence(const uint8_t* block) {
+    return (uint32_t)getLe(block + RECORD_BLOCK_SLOTS * RECORD_SIZE + 4, 4);
+}
+
+bool RecordLogReader::open(ReadFunction read, void* context, uint64_t size) {
+    source = read;
+    sourceContext = context;
+    records = 0;
+
+    uint8_t raw[RECORD_LOG_HEADER_SIZE];
+    if (size < RECORD_LOG_HEADER_SIZE || read(context, 0, raw, sizeof(raw)) != sizeof(raw)) {
+        return false;
+    }
+    if (!decodeLogHeader(raw, fileHeader) || size < fileHeader.headerSize) {
+        return false;
+    }
+    this->size = size;
+    cachedBlock = UINT64_MAX;
+    if (fileHeader.version == RECORD_LOG_VERSION_JOURNAL) {
+        // A partly written last block is incomplete and not counted
+        perBlock = RECORD_BLOCK_SLOTS;
+        records = committedBlocks((size - fileHeader.headerSize) / RECORD_BLOCK_SIZE) * RECORD_BLOCK_SLOTS;
+    } else {
+        perBlock = RECORD_BLOCK_SIZE / RECORD_SIZE;
+        records = (size - fileHeader.headerSize) / RECORD_SIZE;
+    }
+    return true;
+}
+
+bool RecordLogReader::loadBlock(uint64_t block) {
+    cachedBlock = block;
+    cachedCount = 0;
+    uint64_t offset = fileHeader.headerSize + block * RECORD_BLOCK_SIZE;
+    size_t wanted = size - offset < RECORD_BLOCK_SIZE ? (size_t)(size - offset) : RECORD_BLOCK_SIZE;
+    size_t length = source(sourceContext, offset, cache, wanted);
+
+    if (fileHeader.version != RECORD_LOG_VERSION_JOURNAL) {
+        cachedCount = (uint8_t)(length / RECORD_SIZE);
+    } else if (length != RECORD_BLOCK_SIZE
+        || !checkLogBlock(cache, (uint32_t)block, fileHeader.journalId, cachedCount)) {
+        cachedCount = 0;
+        rejected++;
+        return false;
+    }
+    return true;
+}
+
+uint64_t RecordLogReader::committedBlocks(uint64_t blocks) {
+    // Committed blocks form a prefix; past it come a torn block and
+    // preallocated space. A single failing block followed by a good one is
+    // a damaged block inside the prefix, not its end.
+    uint64_t low = 0;
+    uint64_t high = blocks;
+    while (low < high) {
+        uint64_t mid = low + (high - low) / 2;
+        if (loadBlock(mid) || (mid + 1 < blocks && loadBlock(mid + 1))) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    rejected = 0;
+    return low;
+}
+
+bool RecordLogReader::read(uint64_t index, LogEntry& entry) {
+    if (index >= records) {
+        return false;
+    }
+    uint64_t block = index / perBlock;
+    if (block != cachedBlock) {
+        loadBlock(block);
+    }
+    size_t slot = (size_t)(index % perBlock);
+    if (slot >= cachedCount) {
+        return false;
+    }
+    return decodeLogEntry(cache + slot * RECORD_SIZE, entry);
+}
+
+uint64_t RecordLogReader::lowerBound(int64_t timeMs) {
+    uint64_t low = 0;
+    uint64_t high = records;
+    while (low < high) {
+        uint64_t mid = low + (high - low) / 2;
+        LogEntry entry;
+        uint64_t probe = mid;
+        // Step over corrupt records to the next readable one
+        while (probe < high && !read(probe, entry)) {
+            probe++;
+        }
+        if (probe == high) {
+            high = mid;
+        } else if (entry.timeMs < timeMs) {
+            low = probe + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
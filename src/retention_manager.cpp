@@ -0,0 +1,136 @@
+/**
+ * @file retention_manager.cpp
+ * @brief Retention policies and queued clear jobs.
+ */
+
+#include "retention_manager.h"
+#include <SD.h>
+#include "log_writer.h"
+#include "rollup_store.h"
+#include "segment_index.h"
+#include "timestamp.h"
+
+RetentionManager retentionManager;
+
+static const char* const jobStateNames[] = { "none", "queued", "running", "done" };
+
+void RetentionManager::begin() {
+    if (task == nullptr) {
+        xTaskCreatePinnedToCore(retentionTask, "retention", 4096, this, 0, &task, 0);
+    }
+}
+
+uint32_t RetentionManager::requestClear() {
+    if (jobState != RETENTION_JOB_QUEUED) {
+        jobId = jobId + 1;
+        jobState = RETENTION_JOB_QUEUED;
+    }
+    uint32_t id = jobId;
+    if (task != nullptr) {
+        xTaskNotifyGive(task);
+    }
+    return id;
+}
+
+void RetentionManager::retentionTask(void* param) {
+    RetentionManager* self = (RetentionManager*)param;
+    for (;;) {
+        // Woken early by clear requests
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(RETENTION_CHECK_INTERVAL_MS));
+        if (self->jobState == RETENTION_JOB_QUEUED) {
+            self->runClear();
+        } else if (logWriter.usingCard()) {
+            self->enforce();
+        }
+    }
+}
+
+void RetentionManager::runClear() {
+    unsigned long start = millis();
+    jobState = RETENTION_JOB_RUNNING;
+    logWriter.clear();
+    // Segments still being downloaded go once their readers are done
+    while (!logWriter.finishClear()) {
+        vTaskDelay(pdMS_TO_TICKS(RETENTION_CLEAR_POLL_MS));
+    }
+    jobMillis = millis() - start;
+    jobState = RETENTION_JOB_DONE;
+    storedBytes = 0;
+}
+
+bool RetentionManager::overLimit(uint32_t day, uint64_t stored) const {
+    if (RETENTION_MAX_AGE_DAYS > 0 && timestampService.synced()
+        && day + RETENTION_MAX_AGE_DAYS < segmentDay(timestampService.nowEpochMs())) {
+        return true;
+    }
+    return overSpace(stored);
+}
+
+bool RetentionManager::overSpace(uint64_t stored) const {
+    if (RETENTION_MAX_BYTES > 0 && stored > RETENTION_MAX_BYTES) {
+        return true;
+    }
+#if RETENTION_MIN_FREE_PERCENT > 0
+    uint64_t total = SD.totalBytes();
+    if (total > 0 && (total - SD.usedBytes()) * 100 < total * RETENTION_MIN_FREE_PERCENT) {
+        return true;
+    }
+#endif
+    return false;
+}
+
+void RetentionManager::enforce() {
+    unsigned long start = millis();
+    if (timestampService.synced()) {
+        logWriter.rotateRollups(timestampService.nowEpochMs());
+    }
+    // Days evicted from a full index while being read
+    logWriter.finishClear();
+    storedBytes = logWriter.storedBytes();
+
+    // Oldest first, one segment per lock hold, so the writer task is never kept waiting long
+    SegmentInfo segment;
+    while (jobState != RETENTION_JOB_QUEUED && logWriter.findOldestSegment(segment)
+        && overLimit(segment.day, storedBytes)) {
+        uint64_t freed;
+        if (!logWriter.dropSegment(segment.day, freed)) {
+            break;
+        }
+        dropped++;
+        freedBytes += freed;
+        storedBytes -= min(freed, storedBytes);
+        Serial.printf("Retention: dropped log segment of day %u\n", (unsigned)segment.day);
+        vTaskDelay(1);
+    }
+    // Only the open segment is left; the previous 1-minute generation goes next
+    if (jobState != RETENTION_JOB_QUEUED && overSpace(storedBytes)) {
+        uint64_t freed = rollupStore.dropOldFine();
+        freedBytes += freed;
+        storedBytes -= min(freed, storedBytes);
+    }
+    checks++;
+    lastCheckMillis = millis() - start;
+}
+
+JSONVar RetentionManager::clearJobJson() const {
+    JSONVar job;
+    job["job"] = (double)jobId;
+    job["state"] = jobStateNames[jobState];
+    job["ms"] = (double)jobMillis;
+    return job;
+}
+
+JSONVar RetentionManager::statusJson() const {
+    JSONVar status;
+    status["maxAgeDays"] = RETENTION_MAX_AGE_DAYS;
+    status["maxBytes"] = (double)RETENTION_MAX_BYTES;
+    status["minFreePercent"] = RETENTION_MIN_FREE_PERCENT;
+    status["checks"] = (double)checks;
+    status["droppedSegments"] = (double)dropped;
+    status["freedBytes"] = (double)freedBytes;
+    status["storedBytes"] = (double)storedBytes;
+    status["lastCheckMs"] = (double)lastCheckMillis;
+    JSONVar job = clearJobJson();
+    status["clear"] = job;
+    return status;
+}
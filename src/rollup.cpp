@@ -0,0 +1,174 @@
+/**
+ * @file rollup.cpp
+ * @brief O(1) rollup maintenance and bucket encoding.
+ */
+
+#include "rollup.h"
+#include "record_log.h"
+#include <string.h>
+
+const int64_t rollupWidthMs[ROLLUP_TIERS] = { 60000LL, 3600000LL, 86400000LL };
+const char* const rollupTierName[ROLLUP_TIERS] = { "1m", "1h", "1d" };
+
+static void putFloat(uint8_t* out, float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    putLe(out, bits, 4);
+}
+
+static float getFloat(const uint8_t* in) {
+    uint32_t bits = (uint32_t)getLe(in, 4);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Bucket layout: startMs(8) min(4) max(4) mean(4) last(4) count(4) channel(1) tier(1) crc(2)
+void encodeRollupBucket(const RollupBucket& bucket, uint8_t* out) {
+    putLe(out, (uint64_t)bucket.startMs, 8);
+    putFloat(out + 8, bucket.min);
+    putFloat(out + 12, bucket.max);
+    putFloat(out + 16, bucket.mean);
+    putFloat(out + 20, bucket.last);
+    putLe(out + 24, bucket.count, 4);
+    out[28] = bucket.channel;
+    out[29] = bucket.tier;
+    putLe(out + 30, recordCrc16(out, 30), 2);
+}
+
+bool decodeRollupBucket(const uint8_t* in, RollupBucket& bucket) {
+    if (getLe(in + 30, 2) != recordCrc16(in, 30)) {
+        return false;
+    }
+    bucket.startMs = (int64_t)getLe(in, 8);
+    bucket.min = getFloat(in + 8);
+    bucket.max = getFloat(in + 12);
+    bucket.mean = getFloat(in + 16);
+    bucket.last = getFloat(in + 20);
+    bucket.count = (uint32_t)getLe(in + 24, 4);
+    bucket.channel = in[28];
+    bucket.tier = in[29];
+    return true;
+}
+
+// Header layout: magic(4) buckets(4) samples(4) firstMs(8) lastMs(8) reserved(2) crc(2)
+void encodeRollupSegmentHeader(const RollupSegmentHeader& header, uint8_t* out) {
+    memset(out, 0, ROLLUP_RECORD_SIZE);
+    putLe(out, ROLLUP_SEGMENT_MAGIC, 4);
+    putLe(out + 4, header.buckets, 4);
+    putLe(out + 8, header.samples, 4);
+    putLe(out + 12, (uint64_t)header.firstMs, 8);
+    putLe(out + 20, (uint64_t)header.lastMs, 8);
+    putLe(out + 30, recordCrc16(out, 30), 2);
+}
+
+bool decodeRollupSegmentHeader(const uint8_t* in, RollupSegmentHeader& header) {
+    if (getLe(in, 4) != ROLLUP_SEGMENT_MAGIC || getLe(in + 30, 2) != recordCrc16(in, 30)) {
+        return false;
+    }
+    header.buckets = (uint32_t)getLe(in + 4, 4);
+    header.samples = (uint32_t)getLe(in + 8, 4);
+    header.firstMs = (int64_t)getLe(in + 12, 8);
+    header.lastMs = (int64_t)getLe(in + 20, 8);
+    return true;
+}
+
+int rollupTierFor(int64_t resolutionMs) {
+    for (int tier = ROLLUP_TIERS - 1; tier >= 0; tier--) {
+        if (rollupWidthMs[tier] <= resolutionMs) {
+            return tier;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Start of the bucket of width widthMs that contains timeMs.
+ */
+static inline int64_t bucketStart(int64_t timeMs, int64_t widthMs) {
+    int64_t start = timeMs - timeMs % widthMs;
+    return timeMs < 0 && timeMs % widthMs ? start - widthMs : start;
+}
+
+void RollupAggregator::begin(RollupSink bucketSink, void* context) {
+    sink = bucketSink;
+    sinkContext = context;
+    memset(slotOf, 0xFF, sizeof(slotOf));
+    slots = 0;
+    for (uint8_t tier = 0; tier < ROLLUP_TIERS; tier++) {
+        persistedUntil[tier] = INT64_MIN;
+    }
+}
+
+void RollupAggregator::close(uint8_t tier, uint8_t channel, const OpenBucket& bucket) {
+    if (bucket.count == 0 || bucket.startMs <= persistedUntil[tier]) {
+        return;
+    }
+    RollupBucket result;
+    result.startMs = bucket.startMs;
+    result.min = bucket.min;
+    result.max = bucket.max;
+    result.mean = (float)(bucket.sum / bucket.count);
+    result.last = bucket.last;
+    result.count = bucket.count;
+    result.channel = channel;
+    result.tier = tier;
+    closed++;
+    if (sink) {
+        sink(sinkContext, result);
+    }
+}
+
+void RollupAggregator::add(uint8_t channel, int64_t timeMs, float value) {
+    uint8_t slot = slotOf[channel];
+    if (slot == 0xFF) {
+        if (slots == ROLLUP_MAX_CHANNELS) {
+            return;
+        }
+        slot = slotOf[channel] = slots++;
+        for (uint8_t tier = 0; tier < ROLLUP_TIERS; tier++) {
+            open[slot][tier].startMs = INT64_MIN;
+            open[slot][tier].count = 0;
+        }
+    }
+
+    for (uint8_t tier = 0; tier < ROLLUP_TIERS; tier++) {
+        OpenBucket& bucket = open[slot][tier];
+        int64_t start = bucketStart(timeMs, rollupWidthMs[tier]);
+        if (start < bucket.startMs) {
+            late++;
+            continue;
+        }
+        if (start != bucket.startMs) {
+            close(tier, channel, bucket);
+            bucket.startMs = start;
+            bucket.min = value;
+            bucket.max = value;
+            bucket.sum = 0;
+            bucket.count = 0;
+        }
+        if (value < bucket.min) {
+            bucket.min = value;
+        }
+        if (value > bucket.max) {
+            bucket.max = value;
+        }
+        bucket.last = value;
+        bucket.sum += value;
+        bucket.count++;
+    }
+}
+
+void RollupAggregator::closeAll() {
+    for (uint16_t channel = 0; channel < 256; channel++) {
+        uint8_t slot = slotOf[channel];
+        if (slot == 0xFF) {
+            continue;
+        }
+        for (uint8_t tier = 0; tier < ROLLUP_TIERS; tier++) {
+            close(tier, (uint8_t)channel, open[slot][tier]);
+        }
+    }
+    memset(slotOf, 0xFF, sizeof(slotOf));
+    slots = 0;
+}
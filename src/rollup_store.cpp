@@ -0,0 +1,331 @@
+/**
+ * @file rollup_store.cpp
+ * @brief Rollup persistence, restart replay and tier queries.
+ */
+
+#include "rollup_store.h"
+#include "log_query.h"
+#include "log_writer.h"
+
+#define NEWEST_SCAN_BUCKETS 64 /**< Trailing buckets inspected for the newest start. */
+
+RollupStore rollupStore;
+static portMUX_TYPE fineMux = portMUX_INITIALIZER_UNLOCKED; /**< Guards the 1-minute reader count. */
+
+String RollupStore::tierPath(uint8_t tier) const {
+    return path + "/" + rollupTierName[tier] + ".bin";
+}
+
+String RollupStore::fineOldPath() const {
+    return path + "/" + rollupTierName[0] + ".old";
+}
+
+int64_t RollupStore::prepareTier(uint8_t tier) {
+    File& file = files[tier];
+    size_t size = file.size();
+    size_t torn = size % ROLLUP_RECORD_SIZE;
+    if (torn > 0) {
+        uint8_t padding[ROLLUP_RECORD_SIZE];
+        memset(padding, 0xFF, sizeof(padding));
+        file.write(padding, ROLLUP_RECORD_SIZE - torn);
+        file.flush();
+        size += ROLLUP_RECORD_SIZE - torn;
+    }
+
+    // A channel that resumes after a gap closes an older bucket last, so look a little further back
+    File reader = SD.open(tierPath(tier), FILE_READ);
+    int64_t newest = INT64_MIN;
+    size_t buckets = size / ROLLUP_RECORD_SIZE;
+    for (size_t i = buckets > NEWEST_SCAN_BUCKETS ? buckets - NEWEST_SCAN_BUCKETS : 0; reader && i < buckets; i++) {
+        uint8_t raw[ROLLUP_RECORD_SIZE];
+        RollupBucket bucket;
+        if (readLogFile(&reader, (uint64_t)i * ROLLUP_RECORD_SIZE, raw, sizeof(raw)) == sizeof(raw)
+            && decodeRollupBucket(raw, bucket) && bucket.startMs > newest) {
+            newest = bucket.startMs;
+        }
+    }
+    return newest;
+}
+
+bool RollupStore::begin(const char* directory) {
+    path = directory;
+    if (!SD.exists(path) && !SD.mkdir(path)) {
+        Serial.println("Failed to create the rollup directory on the SD card");
+        return false;
+    }
+
+    aggregator.begin(storeBucket, this);
+    for (uint8_t tier = 0; tier < ROLLUP_TIERS; tier++) {
+        files[tier] = SD.open(tierPath(tier), FILE_APPEND);
+        if (!files[tier]) {
+            Serial.println("Failed to open a rollup file on the SD card");
+            return false;
+        }
+        newestStored[tier] = prepareTier(tier);
+        aggregator.setPersistedUntil(tier, newestStored[tier]);
+    }
+    ready = true;
+    return true;
+}
+
+void RollupStore::replay(int64_t newestDayMs) {
+    if (!ready) {
+        return;
+    }
+    // The open day bucket starts after the newest stored one. Without any, or
+    // after a long gap, only the newest day is replayed: the whole log would
+    // keep the writer task, and everyone waiting for it, busy for minutes
+    int64_t dayWidth = rollupWidthMs[ROLLUP_TIERS - 1];
+    int64_t from = newestStored[ROLLUP_TIERS - 1] == INT64_MIN ? INT64_MIN : newestStored[ROLLUP_TIERS - 1] + dayWidth;
+    from = max(from, newestDayMs);
+
+    unsigned long start = millis();
+    LogQuery query(from, INT64_MAX);
+    LogEntry entry;
+    while (query.next(entry)) {
+        add(entry);
+        replayed++;
+        if (replayed % 4096 == 0) {
+            vTaskDelay(1);
+        }
+    }
+    flush();
+    replayMillis = millis() - start;
+}
+
+void RollupStore::add(const LogEntry& entry) {
+    if (ready && !(entry.flags & RECORD_FLAG_INVALID)) {
+        aggregator.add(entry.channel, entry.timeMs, entry.value);
+    }
+}
+
+void RollupStore::storeBucket(void* context, const RollupBucket& bucket) {
+    RollupStore* self = (RollupStore*)context;
+    uint8_t raw[ROLLUP_RECORD_SIZE];
+    encodeRollupBucket(bucket, raw);
+    if (self->files[bucket.tier].write(raw, sizeof(raw)) != sizeof(raw)) {
+        self->writeErrors++;
+    }
+    self->written[bucket.tier]++;
+}
+
+void RollupStore::flush() {
+    for (uint8_t tier = 0; tier < ROLLUP_TIERS; tier++) {
+        if (files[tier]) {
+            files[tier].flush();
+        }
+    }
+}
+
+void RollupStore::clear() {
+    if (!ready) {
+        return;
+    }
+    aggregator.begin(storeBucket, this);
+    for (uint8_t tier = 0; tier < ROLLUP_TIERS; tier++) {
+        files[tier].close();
+        SD.remove(tierPath(tier));
+        files[tier] = SD.open(tierPath(tier), FILE_APPEND);
+        newestStored[tier] = INT64_MIN;
+    }
+    // A query still reading the previous generation leaves it to the next rotation
+    if (beginFineChange()) {
+        SD.remove(fineOldPath());
+        endFineChange();
+    }
+}
+
+bool RollupStore::acquireFine() {
+    portENTER_CRITICAL(&fineMux);
+    bool held = !fineBusy;
+    if (held) {
+        fineReaders++;
+    }
+    portEXIT_CRITICAL(&fineMux);
+    return held;
+}
+
+void RollupStore::releaseFine() {
+    portENTER_CRITICAL(&fineMux);
+    fineReaders--;
+    portEXIT_CRITICAL(&fineMux);
+}
+
+bool RollupStore::beginFineChange() {
+    portENTER_CRITICAL(&fineMux);
+    bool claimed = fineReaders == 0 && !fineBusy;
+    if (claimed) {
+        fineBusy = true;
+    }
+    portEXIT_CRITICAL(&fineMux);
+    return claimed;
+}
+
+void RollupStore::endFineChange() {
+    portENTER_CRITICAL(&fineMux);
+    fineBusy = false;
+    portEXIT_CRITICAL(&fineMux);
+}
+
+bool RollupStore::rotateFine(int64_t nowMs) {
+    if (!ready) {
+        return false;
+    }
+    // The first readable bucket; a torn one is padded and skipped
+    File reader = SD.open(tierPath(0), FILE_READ);
+    int64_t firstMs = INT64_MAX;
+    for (size_t i = 0; reader && i < NEWEST_SCAN_BUCKETS && firstMs == INT64_MAX; i++) {
+        uint8_t raw[ROLLUP_RECORD_SIZE];
+        RollupBucket bucket;
+        if (reader.read(raw, sizeof(raw)) != sizeof(raw)) {
+            break;
+        }
+        if (decodeRollupBucket(raw, bucket)) {
+            firstMs = bucket.startMs;
+        }
+    }
+    reader.close();
+    int64_t keepMs = (int64_t)ROLLUP_FINE_KEEP_DAYS * rollupWidthMs[ROLLUP_TIERS - 1];
+    if (firstMs == INT64_MAX || nowMs - firstMs < keepMs || !beginFineChange()) {
+        return false;
+    }
+
+    files[0].close();
+    SD.remove(fineOldPath());
+    bool rotated = SD.rename(tierPath(0), fineOldPath());
+    files[0] = SD.open(tierPath(0), FILE_APPEND);
+    endFineChange();
+    if (rotated) {
+        fineRotations++;
+    }
+    return rotated;
+}
+
+uint64_t RollupStore::dropOldFine() {
+    File old = SD.exists(fineOldPath()) ? SD.open(fineOldPath(), FILE_READ) : File();
+    if (!old) {
+        return 0;
+    }
+    uint64_t size = old.size();
+    old.close();
+    if (!beginFineChange()) {
+        return 0;
+    }
+    SD.remove(fineOldPath());
+    endFineChange();
+    fineDrops++;
+    return size;
+}
+
+uint64_t RollupStore::storedBytes() {
+    uint64_t total = 0;
+    for (uint8_t tier = 0; ready && tier <= ROLLUP_TIERS; tier++) {
+        String file = tier < ROLLUP_TIERS ? tierPath(tier) : fineOldPath();
+        File entry = SD.exists(file) ? SD.open(file, FILE_READ) : File();
+        if (entry) {
+            total += entry.size();
+            entry.close();
+        }
+    }
+    return total;
+}
+
+JSONVar RollupStore::statusJson() const {
+    JSONVar status;
+    status["ready"] = ready;
+    JSONVar buckets;
+    for (uint8_t tier = 0; tier < ROLLUP_TIERS; tier++) {
+        buckets[rollupTierName[tier]] = (double)written[tier];
+    }
+    status["written"] = buckets;
+    status["writeErrors"] = (double)writeErrors;
+    status["lateSamples"] = (double)aggregator.lateSamples();
+    status["replayed"] = (double)replayed;
+    status["replayMs"] = (double)replayMillis;
+    status["fineKeepDays"] = ROLLUP_FINE_KEEP_DAYS;
+    status["fineRotations"] = (double)fineRotations;
+    status["fineDrops"] = (double)fineDrops;
+    return status;
+}
+
+RollupQuery::RollupQuery(uint8_t queryTier, int64_t from, int64_t to, uint8_t queryChannel)
+    : tier(queryTier), fromMs(from), toMs(to), channel(queryChannel) {}
+
+RollupQuery::~RollupQuery() {
+    if (holding) {
+        rollupStore.releaseFine();
+    }
+}
+
+bool RollupQuery::readBucket(uint32_t index, RollupBucket& bucket) {
+    if (index < bufferStart || index >= bufferStart + bufferCount) {
+        // The previous generation comes first; a read never crosses into the next file
+        bool old = index < oldCount;
+        uint32_t wanted = min((uint32_t)ROLLUP_READ_BUCKETS, (old ? oldCount : count) - index);
+        uint64_t offset = (uint64_t)(old ? index : index - oldCount) * ROLLUP_RECORD_SIZE;
+        bufferStart = index;
+        bufferCount = readLogFile(old ? &oldFile : &file, offset, buffer, wanted * ROLLUP_RECORD_SIZE) / ROLLUP_RECORD_SIZE;
+        if (bufferCount == 0) {
+            return false;
+        }
+    }
+    return decodeRollupBucket(buffer + (index - bufferStart) * ROLLUP_RECORD_SIZE, bucket);
+}
+
+uint32_t RollupQuery::lowerBound(int64_t startMs) {
+    uint32_t low = 0;
+    uint32_t high = count;
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        RollupBucket bucket;
+        uint32_t probe = mid;
+        while (probe < high && !readBucket(probe, bucket)) {
+            probe++;
+        }
+        if (probe == high) {
+            high = mid;
+        } else if (bucket.startMs < startMs) {
+            low = probe + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+bool RollupQuery::next(RollupBucket& bucket) {
+    if (!started) {
+        started = true;
+        if (tier == 0) {
+            holding = rollupStore.acquireFine();
+            if (!holding) {
+                return false; // a generation is being rotated
+            }
+            String oldPath = rollupStore.fineOldPath();
+            oldFile = SD.exists(oldPath) ? SD.open(oldPath, FILE_READ) : File();
+            oldCount = oldFile ? oldFile.size() / ROLLUP_RECORD_SIZE : 0;
+        }
+        file = SD.open(rollupStore.tierPath(tier), FILE_READ);
+        if (!file) {
+            return false;
+        }
+        count = oldCount + file.size() / ROLLUP_RECORD_SIZE;
+        // A bucket overlaps the range if it starts less than one width before it;
+        // channels that resumed after a gap may have written a little out of order
+        int64_t width = rollupWidthMs[tier];
+        position = lowerBound(fromMs > INT64_MIN + 2 * width ? fromMs - 2 * width : INT64_MIN);
+    }
+
+    while (file && position < count) {
+        if (!readBucket(position++, bucket)) {
+            continue;
+        }
+        if (bucket.startMs > toMs) {
+            return false;
+        }
+        if (bucket.channel == channel && bucket.startMs + rollupWidthMs[tier] > fromMs) {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,88 @@
+/**
+ * @file sample_scheduler.cpp
+ * @brief Timer driven sample ticks and jitter histogram.
+ */
+
+#include "sample_scheduler.h"
+
+SampleScheduler sampleScheduler;
+
+void SampleScheduler::onTimer(void* arg) {
+    SampleScheduler* self = (SampleScheduler*)arg;
+    self->fired++;
+    TaskHandle_t task = self->waiter;
+    if (task != nullptr) {
+        xTaskNotifyGive(task);
+    }
+}
+
+void SampleScheduler::waitForTick(uint32_t timeoutMs) {
+    waiter = xTaskGetCurrentTaskHandle();
+    if (fired == consumed) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeoutMs));
+    }
+    waiter = nullptr;
+}
+
+void SampleScheduler::begin(unsigned long intervalMs) {
+    intervalUs = (int64_t)intervalMs * 1000;
+
+    esp_timer_create_args_t args = {};
+    args.callback = onTimer;
+    args.arg = this;
+    args.dispatch_method = ESP_TIMER_TASK;
+    args.name = "sample";
+    if (esp_timer_create(&args, &timer) != ESP_OK) {
+        Serial.println("Failed to create sample timer");
+        return;
+    }
+
+    // The periodic timer re-arms from its own alarm time, so ticks never drift
+    firstTickUs = esp_timer_get_time() + intervalUs;
+    esp_timer_start_periodic(timer, intervalUs);
+}
+
+bool SampleScheduler::takeTick() {
+    uint32_t pending = fired - consumed;
+    if (pending == 0) {
+        return false;
+    }
+    if (pending > 1) {
+        // Run the newest tick only; older ones are counted as missed
+        missed += pending - 1;
+        consumed += pending - 1;
+    }
+
+    lastScheduled = firstTickUs + (int64_t)consumed * intervalUs;
+    consumed++;
+
+    int64_t delay = esp_timer_get_time() - lastScheduled;
+    lastJitterUs = delay > 0 ? (uint32_t)delay : 0;
+    maxJitterUs = max(maxJitterUs, lastJitterUs);
+
+    uint32_t bound = 100;
+    int bucket = 0;
+    while (bucket < JITTER_BUCKETS - 1 && lastJitterUs >= bound) {
+        bound *= 10;
+        bucket++;
+    }
+    histogram[bucket]++;
+    return true;
+}
+
+JSONVar SampleScheduler::statusJson() const {
+    JSONVar status;
+    status["intervalMs"] = (double)(intervalUs / 1000);
+    status["ticks"] = (double)consumed;
+    status["missed"] = (double)missed;
+    status["lastJitterUs"] = (double)lastJitterUs;
+    status["maxJitterUs"] = (double)maxJitterUs;
+
+    static const char* const labels[JITTER_BUCKETS] = { "<100us", "<1ms", "<10ms", "<100ms", "<1s", "<10s", ">=10s" };
+    JSONVar buckets;
+    for (int i = 0; i < JITTER_BUCKETS; i++) {
+        buckets[labels[i]] = (double)histogram[i];
+    }
+    status["jitterHistogram"] = buckets;
+    return status;
+}
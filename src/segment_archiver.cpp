@@ -0,0 +1,164 @@
+/**
+ * @file segment_archiver.cpp
+ * @brief Raw to Gorilla segment conversion task.
+ */
+
+#include "segment_archiver.h"
+#include "log_writer.h"
+
+SegmentArchiver segmentArchiver;
+
+void SegmentArchiver::begin() {
+#if ARCHIVE_ENABLED
+    xTaskCreatePinnedToCore(archiverTask, "archiver", 4096, this, 0, nullptr, 0);
+#endif
+}
+
+void SegmentArchiver::archiverTask(void* param) {
+    SegmentArchiver* self = (SegmentArchiver*)param;
+    for (;;) {
+        SegmentInfo segment;
+        while (logWriter.findArchiveCandidate(segment)) {
+            if (!self->archive(segment)) {
+                break; // retried at the next check
+            }
+        }
+        vTaskDelay(pdMS_TO_TICKS(ARCHIVE_CHECK_INTERVAL_MS));
+    }
+}
+
+bool SegmentArchiver::verify(File& archive, const ArchiveHeader& expected) {
+    ArchiveHeader header;
+    if (archive.read(block, GORILLA_BLOCK_SIZE) != GORILLA_BLOCK_SIZE
+        || !decodeArchiveHeader(block, header)) {
+        return false;
+    }
+
+    uint32_t samples = 0;
+    uint32_t checksum = 0;
+    for (uint32_t b = 0; b < header.blocks; b++) {
+        GorillaDecoder decoder;
+        if (archive.read(block, GORILLA_BLOCK_SIZE) != GORILLA_BLOCK_SIZE || !decoder.open(block)) {
+            return false;
+        }
+        LogEntry entry;
+        while (decoder.next(entry)) {
+            checksum += archiveChecksum(entry);
+            samples++;
+        }
+    }
+    return samples == expected.samples && checksum == expected.checksum && header.blocks == expected.blocks;
+}
+
+bool SegmentArchiver::archive(const SegmentInfo& segment) {
+    unsigned long start = millis();
+    if (!logWriter.acquireSegment(segment)) {
+        return false; // dropped meanwhile, or retried at the next check
+    }
+    raw = SD.open(logWriter.segmentPath(segment.day, SEGMENT_RAW), FILE_READ);
+    if (!raw || !reader.open(readLogFile, &raw, raw.size())) {
+        raw.close();
+        logWriter.releaseSegment(segment.day);
+        failures++;
+        return false;
+    }
+    rawRecords = reader.count();
+
+    // First pass: which channels are present, and the totals the archive must reproduce
+    ArchiveHeader expected = { 0, 0, INT64_MAX, INT64_MIN, 0 };
+    uint32_t channels[8] = {};
+    for (uint64_t i = 0; i < rawRecords; i++) {
+        LogEntry entry;
+        if (!reader.read(i, entry)) {
+            continue; // unused slots and corrupt records are dropped
+        }
+        channels[entry.channel / 32] |= 1UL << (entry.channel % 32);
+        expected.samples++;
+        expected.checksum += archiveChecksum(entry);
+        expected.firstMs = min(expected.firstMs, entry.timeMs);
+        expected.lastMs = max(expected.lastMs, entry.timeMs);
+    }
+
+    String tempPath = logWriter.segmentPath(segment.day, SEGMENT_ARCHIVE) + ".tmp";
+    File archive = SD.open(tempPath, FILE_WRITE);
+    if (!archive) {
+        raw.close();
+        logWriter.releaseSegment(segment.day);
+        failures++;
+        return false;
+    }
+
+    // Header block is rewritten once the block count is known
+    memset(block, 0, GORILLA_BLOCK_SIZE);
+    bool ok = archive.write(block, GORILLA_BLOCK_SIZE) == GORILLA_BLOCK_SIZE;
+
+    // One pass per channel keeps a single block in RAM
+    GorillaEncoder encoder;
+    for (uint16_t channel = 0; channel < 256 && ok; channel++) {
+        if (!(channels[channel / 32] & (1UL << (channel % 32)))) {
+            continue;
+        }
+        encoder.begin(block, (uint8_t)channel);
+        for (uint64_t i = 0; i < rawRecords && ok; i++) {
+            LogEntry entry;
+            if (!reader.read(i, entry) || entry.channel != channel) {
+                continue;
+            }
+            if (!encoder.add(entry.timeMs, entry.value, entry.flags)) {
+                encoder.finish();
+                ok = archive.write(block, GORILLA_BLOCK_SIZE) == GORILLA_BLOCK_SIZE;
+                expected.blocks++;
+                encoder.begin(block, (uint8_t)channel);
+                encoder.add(entry.timeMs, entry.value, entry.flags);
+            }
+        }
+        encoder.finish();
+        ok = ok && archive.write(block, GORILLA_BLOCK_SIZE) == GORILLA_BLOCK_SIZE;
+        expected.blocks++;
+        vTaskDelay(1); // let the SD writer in between channels
+    }
+    size_t rawSize = raw.size();
+    raw.close();
+
+    if (expected.samples == 0) {
+        expected.firstMs = segment.firstMs;
+        expected.lastMs = segment.lastMs;
+    }
+    encodeArchiveHeader(expected, block);
+    ok = ok && archive.seek(0) && archive.write(block, GORILLA_BLOCK_SIZE) == GORILLA_BLOCK_SIZE;
+    archive.close();
+
+    // Verify what actually reached the card
+    archive = SD.open(tempPath, FILE_READ);
+    ok = ok && archive && verify(archive, expected);
+    size_t archiveSize = archive ? archive.size() : 0;
+    archive.close();
+    // Held until here so clear() leaves the .tmp alone while it is open
+    logWriter.releaseSegment(segment.day);
+
+    SegmentInfo result = { segment.day, expected.firstMs, expected.lastMs, SEGMENT_ARCHIVE };
+    if (!ok || !logWriter.installArchive(result, tempPath)) {
+        SD.remove(tempPath);
+        failures++;
+        Serial.printf("Archiving %s failed\n", logWriter.segmentPath(segment.day).c_str());
+        return false;
+    }
+
+    archived++;
+    rawBytes += rawSize;
+    archiveBytes += archiveSize;
+    lastMillis = millis() - start;
+    return true;
+}
+
+JSONVar SegmentArchiver::statusJson() const {
+    JSONVar status;
+    status["enabled"] = (bool)ARCHIVE_ENABLED;
+    status["archived"] = (double)archived;
+    status["failures"] = (double)failures;
+    status["rawBytes"] = (double)rawBytes;
+    status["archiveBytes"] = (double)archiveBytes;
+    status["ratio"] = archiveBytes ? (double)rawBytes / archiveBytes : 0.0;
+    status["lastMs"] = (double)lastMillis;
+    return status;
+}
@@ -0,0 +1,195 @@
+/**
+ * @file segment_compactor.cpp
+ * @brief Sliced compaction of old segments to 1-minute buckets.
+ */
+
+#include "segment_compactor.h"
+#include "log_query.h"
+#include "log_writer.h"
+#include "segment_archiver.h"
+#include "timestamp.h"
+
+SegmentCompactor segmentCompactor;
+
+void SegmentCompactor::begin() {
+#if COMPACT_ENABLED
+    // The LogQuery of a run lives on the task stack
+    xTaskCreatePinnedToCore(compactorTask, "compactor", 8192, this, 0, nullptr, 0);
+#endif
+}
+
+void SegmentCompactor::compactorTask(void* param) {
+    SegmentCompactor* self = (SegmentCompactor*)param;
+    for (;;) {
+        SegmentInfo segment;
+        while (self->findCandidate(segment)) {
+            if (!self->compact(segment)) {
+                break; // retried at the next check
+            }
+        }
+        vTaskDelay(pdMS_TO_TICKS(COMPACT_CHECK_INTERVAL_MS));
+    }
+}
+
+bool SegmentCompactor::findCandidate(SegmentInfo& segment) {
+    if (!timestampService.synced()) {
+        return false;
+    }
+    uint32_t today = segmentDay(timestampService.nowEpochMs());
+    if (today <= COMPACT_AFTER_DAYS) {
+        return false;
+    }
+    // With archiving on, raw segments belong to the archiver until they are archives
+    uint8_t format = ARCHIVE_ENABLED ? SEGMENT_ARCHIVE : SEGMENT_RAW;
+    return logWriter.findCompactCandidate(today - COMPACT_AFTER_DAYS, format, segment);
+}
+
+void SegmentCompactor::step() {
+    if (++sliceCount >= COMPACT_SLICE_RECORDS) {
+        sliceCount = 0;
+        slices++;
+        vTaskDelay(pdMS_TO_TICKS(COMPACT_SLICE_PAUSE_MS));
+    }
+}
+
+void SegmentCompactor::storeBucket(void* context, const RollupBucket& bucket) {
+    SegmentCompactor* self = (SegmentCompactor*)context;
+    if (bucket.tier != 0) {
+        return;
+    }
+    encodeRollupBucket(bucket, self->buffer + self->buffered * ROLLUP_RECORD_SIZE);
+    self->written.buckets++;
+    self->written.samples += bucket.count;
+    self->written.firstMs = min(self->written.firstMs, bucket.startMs);
+    self->written.lastMs = max(self->written.lastMs, bucket.startMs);
+    if (++self->buffered == COMPACT_BUFFER_BUCKETS) {
+        self->writeBuffered();
+    }
+}
+
+void SegmentCompactor::writeBuffered() {
+    size_t length = buffered * ROLLUP_RECORD_SIZE;
+    outputOk = outputOk && output.write(buffer, length) == length;
+    buffered = 0;
+}
+
+bool SegmentCompactor::verify(File& compacted, const RollupSegmentHeader& expected) {
+    RollupSegmentHeader header;
+    if (compacted.read(buffer, ROLLUP_RECORD_SIZE) != ROLLUP_RECORD_SIZE
+        || !decodeRollupSegmentHeader(buffer, header)) {
+        return false;
+    }
+
+    RollupSegmentHeader found = { 0, 0, INT64_MAX, INT64_MIN };
+    while (found.buckets < header.buckets) {
+        uint32_t remaining = header.buckets - found.buckets;
+        size_t count = remaining < COMPACT_BUFFER_BUCKETS ? remaining : COMPACT_BUFFER_BUCKETS;
+        if (compacted.read(buffer, count * ROLLUP_RECORD_SIZE) != count * ROLLUP_RECORD_SIZE) {
+            return false;
+        }
+        for (size_t i = 0; i < count; i++) {
+            RollupBucket bucket;
+            if (!decodeRollupBucket(buffer + i * ROLLUP_RECORD_SIZE, bucket) || bucket.tier != 0) {
+                return false;
+            }
+            found.buckets++;
+            found.samples += bucket.count;
+            found.firstMs = min(found.firstMs, bucket.startMs);
+            found.lastMs = max(found.lastMs, bucket.startMs);
+            step();
+        }
+    }
+    bool range = found.buckets == 0 || (found.firstMs == expected.firstMs && found.lastMs == expected.lastMs);
+    return header.buckets == expected.buckets && header.samples == expected.samples
+        && found.samples == expected.samples && range;
+}
+
+bool SegmentCompactor::compact(const SegmentInfo& segment) {
+    unsigned long start = millis();
+    // Held while the .tmp is open, so clear() leaves it alone; the query holds the day again while reading
+    if (!logWriter.acquireSegment(segment)) {
+        return false; // dropped meanwhile, or retried at the next check
+    }
+    String sourcePath = logWriter.segmentPath(segment.day, segment.format);
+    File source = SD.open(sourcePath, FILE_READ);
+    size_t sourceSize = source ? source.size() : 0;
+    source.close();
+
+    String tempPath = logWriter.segmentPath(segment.day, SEGMENT_COMPACT) + ".tmp";
+    output = SD.open(tempPath, FILE_WRITE);
+    if (!output) {
+        logWriter.releaseSegment(segment.day);
+        failures++;
+        return false;
+    }
+    // Header record is rewritten once the totals are known
+    memset(buffer, 0, ROLLUP_RECORD_SIZE);
+    outputOk = output.write(buffer, ROLLUP_RECORD_SIZE) == ROLLUP_RECORD_SIZE;
+    written = { 0, 0, INT64_MAX, INT64_MIN };
+    buffered = 0;
+    aggregator.begin(storeBucket, this);
+
+    // The whole segment regardless of sample times, so records held back
+    // before time sync stay with the day they were logged in
+    LogQuery query(INT64_MIN, INT64_MAX, LOG_QUERY_ALL_CHANNELS);
+    query.limitDays(segment.day, segment.day);
+    uint32_t added = 0;
+    LogEntry entry;
+    while (outputOk && query.next(entry)) {
+        if (!(entry.flags & RECORD_FLAG_INVALID)) {
+            aggregator.add(entry.channel, entry.timeMs, entry.value);
+            added++;
+        }
+        step();
+    }
+    aggregator.closeAll();
+    writeBuffered();
+
+    RollupSegmentHeader expected = written;
+    if (expected.buckets == 0) {
+        expected.firstMs = segment.firstMs;
+        expected.lastMs = segment.lastMs;
+    }
+    encodeRollupSegmentHeader(expected, buffer);
+    bool ok = outputOk && output.seek(0) && output.write(buffer, ROLLUP_RECORD_SIZE) == ROLLUP_RECORD_SIZE;
+    output.close();
+
+    // Verify what actually reached the card
+    File check = SD.open(tempPath, FILE_READ);
+    ok = ok && check && verify(check, expected);
+    size_t compactSize = check ? check.size() : 0;
+    check.close();
+    logWriter.releaseSegment(segment.day);
+
+    SegmentInfo result = { segment.day, expected.firstMs, expected.lastMs, SEGMENT_COMPACT };
+    if (!ok || !logWriter.installArchive(result, tempPath, segment.format)) {
+        SD.remove(tempPath);
+        failures++;
+        Serial.printf("Compacting %s failed\n", sourcePath.c_str());
+        return false;
+    }
+
+    compacted++;
+    samples += expected.samples;
+    lateSamples += added - expected.samples;
+    sourceBytes += sourceSize;
+    compactBytes += compactSize;
+    lastMillis = millis() - start;
+    return true;
+}
+
+JSONVar SegmentCompactor::statusJson() const {
+    JSONVar status;
+    status["enabled"] = (bool)COMPACT_ENABLED;
+    status["afterDays"] = COMPACT_AFTER_DAYS;
+    status["compacted"] = (double)compacted;
+    status["failures"] = (double)failures;
+    status["samples"] = (double)samples;
+    status["lateSamples"] = (double)lateSamples;
+    status["slices"] = (double)slices;
+    status["sourceBytes"] = (double)sourceBytes;
+    status["compactBytes"] = (double)compactBytes;
+    status["ratio"] = compactBytes ? (double)sourceBytes / compactBytes : 0.0;
+    status["lastMs"] = (double)lastMillis;
+    return status;
+}
@@ -0,0 +1,163 @@
+/**
+ * @file segment_index.cpp
+ * @brief Segment naming and the in-memory segment index.
+ */
+
+#include "segment_index.h"
+#include <stdio.h>
+#include <string.h>
+
+uint32_t segmentDay(int64_t epochMs) {
+    return epochMs < 0 ? 0 : (uint32_t)(epochMs / SEGMENT_DAY_MS);
+}
+
+// Civil date conversions after H. Hinnant's days_from_civil/civil_from_days
+void segmentFileName(uint32_t day, uint8_t format, char* out) {
+    int64_t z = (int64_t)day + 719468;
+    int64_t era = z / 146097;
+    unsigned doe = (unsigned)(z - era * 146097);
+    unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    unsigned mp = (5 * doy + 2) / 153;
+    unsigned d = doy - (153 * mp + 2) / 5 + 1;
+    unsigned m = mp < 10 ? mp + 3 : mp - 9;
+    unsigned y = (unsigned)(yoe + era * 400) + (m <= 2);
+    snprintf(out, SEGMENT_NAME_LENGTH, "%04u%02u%02u.%s", y % 10000, m % 100, d % 100,
+        format == SEGMENT_ARCHIVE ? "gor" : format == SEGMENT_COMPACT ? "min" : "bin");
+}
+
+bool parseSegmentFileName(const char* name, uint32_t& day, uint8_t& format) {
+    if (strlen(name) != SEGMENT_NAME_LENGTH - 1) {
+        return false;
+    }
+    if (strcmp(name + 8, ".bin") == 0) {
+        format = SEGMENT_RAW;
+    } else if (strcmp(name + 8, ".gor") == 0) {
+        format = SEGMENT_ARCHIVE;
+    } else if (strcmp(name + 8, ".min") == 0) {
+        format = SEGMENT_COMPACT;
+    } else {
+        return false;
+    }
+    unsigned value = 0;
+    for (int i = 0; i < 8; i++) {
+        if (name[i] < '0' || name[i] > '9') {
+            return false;
+        }
+        value = value * 10 + (name[i] - '0');
+    }
+    unsigned y = value / 10000;
+    unsigned m = value / 100 % 100;
+    unsigned d = value % 100;
+    if (y < 1970 || m < 1 || m > 12 || d < 1 || d > 31) {
+        return false;
+    }
+
+    y -= m <= 2;
+    unsigned era = y / 400;
+    unsigned yoe = y - era * 400;
+    unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    day = era * 146097 + doe - 719468;
+    return true;
+}
+
+size_t SegmentIndex::lowerBound(uint32_t day) const {
+    size_t low = 0;
+    size_t high = total;
+    while (low < high) {
+        size_t mid = (low + high) / 2;
+        if (segments[mid].day < day) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+bool SegmentIndex::add(const SegmentInfo& segment, uint32_t& evicted) {
+    size_t pos = lowerBound(segment.day);
+    if (pos < total && segments[pos].day == segment.day) {
+        segments[pos] = segment;
+        return false;
+    }
+    bool full = total == LOG_MAX_SEGMENTS;
+    if (full) {
+        if (pos == 0) {
+            evicted = segment.day; // older than everything we keep
+            return true;
+        }
+        evicted = segments[0].day;
+        memmove(segments, segments + 1, (total - 1) * sizeof(SegmentInfo));
+        total--;
+        pos--;
+    }
+    memmove(segments + pos + 1, segments + pos, (total - pos) * sizeof(SegmentInfo));
+    segments[pos] = segment;
+    total++;
+    return full;
+}
+
+bool SegmentIndex::update(uint32_t day, int64_t timeMs, uint32_t& evicted) {
+    // The segment being written is almost always the last one
+    size_t pos = total > 0 && segments[total - 1].day == day ? total - 1 : lowerBound(day);
+    if (pos < total && segments[pos].day == day) {
+        SegmentInfo& segment = segments[pos];
+        if (timeMs < segment.firstMs) {
+            segment.firstMs = timeMs;
+        }
+        if (timeMs > segment.lastMs) {
+            segment.lastMs = timeMs;
+        }
+        return false;
+    }
+    SegmentInfo segment = { day, timeMs, timeMs, SEGMENT_RAW };
+    return add(segment, evicted);
+}
+
+void SegmentIndex::remove(uint32_t day) {
+    size_t pos = lowerBound(day);
+    if (pos < total && segments[pos].day == day) {
+        memmove(segments + pos, segments + pos + 1, (total - pos - 1) * sizeof(SegmentInfo));
+        total--;
+    }
+}
+
+bool SegmentIndex::find(uint32_t day, SegmentInfo& segment) const {
+    size_t pos = lowerBound(day);
+    if (pos < total && segments[pos].day == day) {
+        segment = segments[pos];
+        return true;
+    }
+    return false;
+}
+
+bool SegmentIndex::findOverlapping(uint32_t minDay, int64_t fromMs, int64_t toMs, SegmentInfo& segment) const {
+    // Segments may hold a few older samples, so start one day early and check the ranges
+    uint32_t fromDay = segmentDay(fromMs);
+    uint32_t startDay = fromDay > 0 ? fromDay - 1 : 0;
+    for (size_t i = lowerBound(startDay > minDay ? startDay : minDay); i < total; i++) {
+        if (segments[i].firstMs > toMs) {
+            if (segmentDay(toMs) < segments[i].day) {
+                return false;
+            }
+            continue;
+        }
+        if (segments[i].lastMs >= fromMs) {
+            segment = segments[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SegmentIndex::findBefore(uint32_t beforeDay, uint8_t format, SegmentInfo& segment) const {
+    for (size_t i = 0; i < total && segments[i].day < beforeDay; i++) {
+        if (segments[i].format == format) {
+            segment = segments[i];
+            return true;
+        }
+    }
+    return false;
+}
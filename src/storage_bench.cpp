@@ -0,0 +1,108 @@
+/**
+ * @file storage_bench.cpp
+ * @brief SD write path benchmark task.
+ */
+
+#include "storage_bench.h"
+#include "log_writer.h"
+
+StorageBench storageBench;
+
+alignas(4) static uint8_t benchBuffer[LOG_SECTOR_SIZE]; // only used by the bench task
+
+bool StorageBench::start(uint32_t kilobytes) {
+    if (active) {
+        return false;
+    }
+    size = constrain(kilobytes, 1u, (uint32_t)BENCH_MAX_KB) * 1024;
+    active = true;
+    xTaskCreatePinnedToCore(benchTask, "sdbench", 4096, this, 0, nullptr, 0);
+    return true;
+}
+
+void StorageBench::benchTask(void* param) {
+    StorageBench* self = (StorageBench*)param;
+    memset(benchBuffer, 0xA5, sizeof(benchBuffer));
+    self->append = self->runAppend();
+    SD.remove(BENCH_PATH);
+    self->aligned = self->runAligned();
+    SD.remove(BENCH_PATH);
+    self->runs++;
+    self->active = false;
+    vTaskDelete(nullptr);
+}
+
+BenchResult StorageBench::runAppend() {
+    BenchResult result;
+    SD.remove(BENCH_PATH);
+    File file = SD.open(BENCH_PATH, FILE_APPEND);
+    if (!file) {
+        return result;
+    }
+    unsigned long start = micros();
+    result.ok = true;
+    while (result.bytes < size) {
+        unsigned long t = micros();
+        if (file.write(benchBuffer, BENCH_APPEND_SIZE) != BENCH_APPEND_SIZE) {
+            result.ok = false;
+            break;
+        }
+        result.bytes += BENCH_APPEND_SIZE;
+        if (result.bytes % BENCH_FLUSH_BYTES == 0) {
+            file.flush();
+        }
+        result.maxWriteMicros = max(result.maxWriteMicros, (uint32_t)(micros() - t));
+    }
+    file.close();
+    result.micros = micros() - start;
+    return result;
+}
+
+BenchResult StorageBench::runAligned() {
+    BenchResult result;
+    File file = SD.open(BENCH_PATH, "w+");
+    if (!file) {
+        return result;
+    }
+    // The allocation is part of the cost, as it is for the log writer
+    unsigned long start = micros();
+    result.ok = extendLogFile(file, size);
+    while (result.ok && result.bytes < size) {
+        unsigned long t = micros();
+        if (!file.seek(result.bytes) || file.write(benchBuffer, LOG_SECTOR_SIZE) != LOG_SECTOR_SIZE) {
+            result.ok = false;
+            break;
+        }
+        result.bytes += LOG_SECTOR_SIZE;
+        if (result.bytes % BENCH_FLUSH_BYTES == 0) {
+            file.flush();
+        }
+        result.maxWriteMicros = max(result.maxWriteMicros, (uint32_t)(micros() - t));
+    }
+    file.close();
+    result.micros = micros() - start;
+    return result;
+}
+
+static JSONVar resultJson(const BenchResult& result) {
+    JSONVar json;
+    json["ok"] = result.ok;
+    json["bytes"] = (double)result.bytes;
+    json["ms"] = result.micros / 1000.0;
+    json["kBps"] = result.micros ? result.bytes * 1e6 / 1024.0 / result.micros : 0.0;
+    json["maxWriteUs"] = (double)result.maxWriteMicros;
+    return json;
+}
+
+JSONVar StorageBench::statusJson() const {
+    JSONVar status;
+    status["running"] = (bool)active;
+    status["runs"] = (double)runs;
+    if (runs > 0) {
+        JSONVar appendJson = resultJson(append);
+        JSONVar alignedJson = resultJson(aligned);
+        status["append"] = appendJson;
+        status["aligned"] = alignedJson;
+    }
+    return status;
+}
@@ -0,0 +1,78 @@
+/**
+ * @file store_and_burst.cpp
+ * @brief RTC memory sample buffer for the store-and-burst mode.
+ */
+
+#include "store_and_burst.h"
+#include "timestamp.h"
+#include <esp_sleep.h>
+
+// RTC slow memory survives deep sleep; it is cleared on power-on
+RTC_DATA_ATTR static BurstSample rtcSamples[BURST_BUFFER_SAMPLES]; /**< Circular sample buffer. */
+RTC_DATA_ATTR static uint16_t rtcHead = 0; /**< Index of the oldest sample. */
+RTC_DATA_ATTR static uint16_t rtcCount = 0; /**< Number of buffered samples. */
+RTC_DATA_ATTR static uint32_t rtcLastBurst = 0; /**< Epoch time of the last burst, 0 before the first. */
+RTC_DATA_ATTR static uint32_t rtcDropped = 0; /**< Samples overwritten because the buffer was full. */
+RTC_DATA_ATTR static float rtcEnergyPerSample = 0; /**< Estimate from the last successful burst. */
+
+StoreAndBurst storeAndBurst;
+
+void StoreAndBurst::store(time_t time, float celsius) {
+    if (rtcCount == BURST_BUFFER_SAMPLES) {
+        rtcHead = (rtcHead + 1) % BURST_BUFFER_SAMPLES;
+        rtcCount--;
+        rtcDropped++;
+    }
+    BurstSample& slot = rtcSamples[(rtcHead + rtcCount) % BURST_BUFFER_SAMPLES];
+    slot.time = (uint32_t)time;
+    slot.centiCelsius = (int16_t)lroundf(celsius * 100.0f);
+    rtcCount++;
+}
+
+bool StoreAndBurst::burstDue(time_t now) const {
+    return rtcLastBurst == 0
+        || rtcCount >= BURST_BUFFER_SAMPLES
+        || (uint32_t)now - rtcLastBurst >= BURST_INTERVAL_MIN * 60UL;
+}
+
+size_t StoreAndBurst::pending() const {
+    return rtcCount;
+}
+
+const BurstSample& StoreAndBurst::sample(size_t index) const {
+    return rtcSamples[(rtcHead + index) % BURST_BUFFER_SAMPLES];
+}
+
+void StoreAndBurst::fixUpTimes(int64_t deltaSeconds) {
+    for (size_t i = 0; i < rtcCount; i++) {
+        BurstSample& slot = rtcSamples[(rtcHead + i) % BURST_BUFFER_SAMPLES];
+        if (slot.time <= EPOCH_VALID_AFTER) {
+            slot.time = (uint32_t)(slot.time + deltaSeconds);
+        }
+    }
+}
+
+void StoreAndBurst::completeBurst(time_t now, size_t sent, int64_t radioMicros) {
+    sent = min(sent, (size_t)rtcCount);
+    rtcHead = (rtcHead + sent) % BURST_BUFFER_SAMPLES;
+    rtcCount -= sent;
+    rtcLastBurst = (uint32_t)now;
+
+    if (sent > 0) {
+        // t[s] * I[mA] * U[V] = E[mJ]
+        float millijoules = radioMicros / 1e6f * BURST_RADIO_CURRENT_MA * (BURST_SUPPLY_MV / 1000.0f);
+        rtcEnergyPerSample = millijoules / sent;
+    }
+    Serial.printf("Burst sent %u sample(s), radio on %lld ms, %.2f mJ/sample, %u dropped\n",
+                  (unsigned)sent, radioMicros / 1000, rtcEnergyPerSample, rtcDropped);
+}
+
+float StoreAndBurst::energyPerSampleMj() const {
+    return rtcEnergyPerSample;
+}
+
+void StoreAndBurst::sleep() const {
+    Serial.flush();
+    esp_sleep_enable_timer_wakeup((uint64_t)BURST_SAMPLE_INTERVAL_S * 1000000ULL);
+    esp_deep_sleep_start();
+}
@@ -0,0 +1,176 @@
+/**
+ * @file temperature_buses.cpp
+ * @brief Multi-bus DS18B20 sampling with parallel conversions.
+ */
+
+#include "temperature_buses.h"
+
+#define SCRATCHPAD_SIZE 9 /**< Bytes in a DS18x20 scratchpad including the CRC. */
+
+static const uint8_t busPins[] = { TEMP_SENSOR_PINS }; /**< Configured OneWire bus pins. */
+
+TemperatureBuses temperatureBuses;
+
+void TemperatureBuses::begin() {
+    busTotal = min(sizeof(busPins) / sizeof(busPins[0]), (size_t)MAX_TEMP_BUSES);
+    probeTotal = 0;
+    conversionMillis = 0;
+
+    for (uint8_t bus = 0; bus < busTotal; bus++) {
+        pinMode(busPins[bus], INPUT_PULLUP);
+        wires[bus].begin(busPins[bus]);
+        sensors[bus].setOneWire(&wires[bus]);
+        sensors[bus].begin();
+        // Conversions are awaited once for all buses in collectReadings()
+        sensors[bus].setWaitForConversion(false);
+
+        uint8_t found = sensors[bus].getDeviceCount();
+        for (uint8_t i = 0; i < found && probeTotal < MAX_TEMP_PROBES; i++) {
+            TemperatureProbe& probe = probes[probeTotal];
+            if (!sensors[bus].getAddress(probe.address, i)) {
+                continue;
+            }
+            probe.bus = bus;
+            probe.celsius = DEVICE_DISCONNECTED_C;
+            probeTotal++;
+        }
+
+        unsigned long wait = (unsigned long)sensors[bus].millisToWaitForConversion(sensors[bus].getResolution());
+        conversionMillis = max(conversionMillis, wait);
+        Serial.printf("OneWire bus %u on GPIO %u: %u probe(s)\n", bus, busPins[bus], found);
+    }
+}
+
+void TemperatureBuses::startConversions() {
+    conversionStart = millis();
+    for (uint8_t bus = 0; bus < busTotal; bus++) {
+        sensors[bus].requestTemperatures();
+    }
+}
+
+/**
+ * @brief Convert a validated scratchpad to degrees Celsius.
+ * @param address ROM address of the probe, used to tell DS18S20 apart.
+ * @param scratchPad Scratchpad contents.
+ * @return Temperature in degrees Celsius.
+ */
+static float scratchPadToCelsius(const uint8_t* address, const uint8_t* scratchPad) {
+    int32_t raw = (((int16_t)scratchPad[1]) << 11) | (((int16_t)scratchPad[0]) << 3);
+    if (address[0] == DS18S20MODEL) {
+        // Extended resolution from COUNT_REMAIN (6) and COUNT_PER_C (7)
+        uint8_t countPerC = scratchPad[7];
+        if (countPerC != 0) {
+            raw = ((raw & 0xfff0) << 3) - 32 + (((countPerC - scratchPad[6]) << 7) / countPerC);
+        }
+    }
+    return DallasTemperature::rawToCelsius(raw);
+}
+
+bool TemperatureBuses::readProbe(TemperatureProbe& probe, unsigned long sweepStart) {
+    unsigned long start = micros();
+    uint8_t scratchPad[SCRATCHPAD_SIZE];
+    bool valid = false;
+
+    for (uint8_t attempt = 0; attempt <= TEMP_READ_RETRIES; attempt++) {
+        if (attempt > 0) {
+            if (micros() - sweepStart >= TEMP_READ_BUDGET_US) {
+                budgetHit = true;
+                break;
+            }
+            probe.stats.retries++;
+        }
+
+        if (!sensors[probe.bus].readScratchPad(probe.address, scratchPad)) {
+            probe.stats.disconnects++;
+            continue;
+        }
+
+        bool allZeros = true;
+        for (uint8_t i = 0; i < SCRATCHPAD_SIZE; i++) {
+            allZeros &= scratchPad[i] == 0;
+        }
+        if (allZeros) {
+            // A shorted bus reads all zeros, which passes the CRC
+            probe.stats.disconnects++;
+            continue;
+        }
+        if (OneWire::crc8(scratchPad, SCRATCHPAD_SIZE - 1) != scratchPad[SCRATCHPAD_SIZE - 1]) {
+            probe.stats.crcErrors++;
+            continue;
+        }
+
+        valid = true;
+        break;
+    }
+
+    if (valid) {
+        probe.celsius = scratchPadToCelsius(probe.address, scratchPad);
+        probe.stats.reads++;
+    } else {
+        probe.celsius = DEVICE_DISCONNECTED_C;
+        probe.stats.failures++;
+    }
+
+    uint32_t latency = micros() - start;
+    probe.stats.lastLatencyUs = latency;
+    probe.stats.maxLatencyUs = max(probe.stats.maxLatencyUs, latency);
+    probe.stats.totalLatencyUs += latency;
+    return valid;
+}
+
+size_t TemperatureBuses::collectReadings() {
+    unsigned long elapsed = millis() - conversionStart;
+    if (elapsed < conversionMillis) {
+        delay(conversionMillis - elapsed);
+    }
+
+    unsigned long sweepStart = micros();
+    budgetHit = false;
+    size_t valid = 0;
+    for (size_t i = 0; i < probeTotal; i++) {
+        if (readProbe(probes[i], sweepStart)) {
+            valid++;
+        }
+    }
+
+    sweeps++;
+    if (budgetHit) {
+        budgetExhausted++;
+    }
+    sweepMillis = millis() - conversionStart;
+    return valid;
+}
+
+JSONVar TemperatureBuses::statusJson() const {
+    JSONVar status;
+    status["buses"] = busTotal;
+    status["sweeps"] = (double)sweeps;
+    status["sweepMs"] = (double)sweepMillis;
+    status["budgetExhausted"] = (double)budgetExhausted;
+
+    JSONVar list = JSON.parse("[]");
+    for (size_t i = 0; i < probeTotal; i++) {
+        const TemperatureProbe& probe = probes[i];
+        char address[17];
+        for (uint8_t b = 0; b < 8; b++) {
+            snprintf(address + b * 2, 3, "%02X", probe.address[b]);
+        }
+
+        JSONVar entry;
+        entry["bus"] = probe.bus;
+        entry["address"] = address;
+        entry["temp"] = probe.celsius;
+        entry["reads"] = (double)probe.stats.reads;
+        entry["crcErrors"] = (double)probe.stats.crcErrors;
+        entry["disconnects"] = (double)probe.stats.disconnects;
+        entry["retries"] = (double)probe.stats.retries;
+        entry["failures"] = (double)probe.stats.failures;
+        entry["lastLatencyUs"] = (double)probe.stats.lastLatencyUs;
+        entry["maxLatencyUs"] = (double)probe.stats.maxLatencyUs;
+        uint32_t attempts = probe.stats.reads + probe.stats.failures;
+        entry["meanLatencyUs"] = attempts ? (double)probe.stats.totalLatencyUs / attempts : 0.0;
+        list[(int)i] = entry;
+    }
+    status["probes"] = list;
+    return status;
+}
@@ -0,0 +1,67 @@
+/**
+ * @file time_sync.cpp
+ * @brief Background time synchronisation and held record fix-up.
+ */
+
+#include "time_sync.h"
+#include "timestamp.h"
+#include "record_log.h"
+#include <esp_timer.h>
+
+TimeSync timeSync;
+
+void TimeSync::begin(long gmtOffsetSec, int daylightOffsetSec, const char* server, RecordSink recordSink) {
+    sink = recordSink;
+    // configTime() only starts SNTP; the answer arrives asynchronously
+    configTime(gmtOffsetSec, daylightOffsetSec, server);
+}
+
+int64_t TimeSync::monotonicMs() {
+    return esp_timer_get_time() / 1000;
+}
+
+void TimeSync::hold(const String& record) {
+    if (pendingCount == TIME_SYNC_PENDING_RECORDS) {
+        pendingHead = (pendingHead + 1) % TIME_SYNC_PENDING_RECORDS;
+        pendingCount--;
+        dropped++;
+    }
+    pending[(pendingHead + pendingCount) % TIME_SYNC_PENDING_RECORDS] = record;
+    pendingCount++;
+}
+
+bool TimeSync::poll() {
+    if (done || !timestampService.synced()) {
+        return false;
+    }
+    done = true;
+    offsetMs = timestampService.nowEpochMs() - monotonicMs();
+
+    for (; pendingCount > 0; pendingCount--) {
+        String& line = pending[pendingHead];
+        JSONVar record = JSON.parse(line);
+        line = String();
+        pendingHead = (pendingHead + 1) % TIME_SYNC_PENDING_RECORDS;
+        if (JSON.typeof_(record) != "object" || !record.hasOwnProperty("uptimeMs")) {
+            continue;
+        }
+
+        int64_t uptime = (int64_t)(double)record["uptimeMs"];
+        record["uptimeMs"] = undefined;
+        fixedUp++;
+        if (sink) {
+            sink(record, uptime + offsetMs, RECORD_FLAG_TIME_FIXED_UP);
+        }
+    }
+    return true;
+}
+
+JSONVar TimeSync::statusJson() const {
+    JSONVar status;
+    status["synced"] = done;
+    status["offsetMs"] = (double)offsetMs;
+    status["pending"] = (double)pendingCount;
+    status["fixedUp"] = (double)fixedUp;
+    status["dropped"] = (double)dropped;
+    return status;
+}
@@ -0,0 +1,60 @@
+/**
+ * @file timestamp.cpp
+ * @brief Cached timestamp formatting.
+ */
+
+#include "timestamp.h"
+#include <sys/time.h>
+
+TimestampService timestampService;
+
+int64_t TimestampService::nowEpochMs() const {
+    struct timeval now;
+    gettimeofday(&now, nullptr);
+    return (int64_t)now.tv_sec * 1000 + now.tv_usec / 1000;
+}
+
+bool TimestampService::synced() const {
+    return time(nullptr) > EPOCH_VALID_AFTER;
+}
+
+void TimestampService::refreshCache(time_t seconds) {
+    struct tm local;
+    localtime_r(&seconds, &local);
+    strftime(prefix, sizeof(prefix), "%Y-%m-%dT%H:", &local);
+    strftime(zone, sizeof(zone), "%z", &local);
+    hourStart = seconds - local.tm_min * 60 - local.tm_sec;
+    cacheValid = true;
+}
+
+size_t TimestampService::formatIso(int64_t epochMs, char* out) {
+    time_t seconds = (time_t)(epochMs / 1000);
+    if (!cacheValid || seconds < hourStart || seconds >= hourStart + 3600) {
+        // Zone changes happen on hour boundaries, so the suffix is cached with the hour
+        refreshCache(seconds);
+    }
+
+    uint32_t offset = (uint32_t)(seconds - hourStart);
+    uint32_t minutes = offset / 60;
+    uint32_t secs = offset % 60;
+
+    memcpy(out, prefix, 14);
+    out[14] = '0' + minutes / 10;
+    out[15] = '0' + minutes % 10;
+    out[16] = ':';
+    out[17] = '0' + secs / 10;
+    out[18] = '0' + secs % 10;
+    size_t zoneLength = strlen(zone);
+    memcpy(out + 19, zone, zoneLength + 1);
+    return 19 + zoneLength;
+}
+
+void TimestampService::stamp(JSONVar& record, int64_t epochMs) {
+#if TIMESTAMP_MODE == TIMESTAMP_EPOCH_MS
+    record["time"] = (double)epochMs;
+#else
+    char text[TIMESTAMP_ISO_LENGTH];
+    formatIso(epochMs, text);
+    record["time"] = text;
+#endif
+}
@@ -0,0 +1,133 @@
+/**
+ * @file gorilla_bench.cpp
+ * @brief Host benchmark of the Gorilla block codec on a recorded log.
+ *
+ * Encodes every channel of a binary sensor log into Gorilla blocks,
+ * decodes them again, checks the round trip and reports speed and size.
+ *
+ * Build from the repository root:
+ *     g++ -std=c++11 -O2 -Iinclude tools/gorilla_bench/gorilla_bench.cpp src/gorilla.cpp src/record_log.cpp -o gorilla_bench
+ * Usage:
+ *     gorilla_bench sensorData.bin
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <map>
+#include <vector>
+#include "gorilla.h"
+
+/**
+ * @brief RecordLogReader source over a stdio file.
+ */
+static size_t readFile(void* context, uint64_t offset, uint8_t* buffer, size_t length) {
+    FILE* file = (FILE*)context;
+    if (fseeko(file, (off_t)offset, SEEK_SET) != 0) {
+        return 0;
+    }
+    return fread(buffer, 1, length, file);
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <log>\n", argv[0]);
+        return 2;
+    }
+
+    FILE* file = fopen(argv[1], "rb");
+    if (!file) {
+        perror(argv[1]);
+        return 1;
+    }
+    fseeko(file, 0, SEEK_END);
+    RecordLogReader reader;
+    if (!reader.open(readFile, file, (uint64_t)ftello(file))) {
+        fprintf(stderr, "%s: not a sensor log\n", argv[1]);
+        return 1;
+    }
+
+    std::map<uint8_t, std::vector<LogEntry>> series;
+    size_t total = 0;
+    for (uint64_t i = 0; i < reader.count(); i++) {
+        LogEntry entry;
+        if (reader.read(i, entry)) {
+            series[entry.channel].push_back(entry);
+            total++;
+        }
+    }
+    fclose(file);
+    if (total == 0) {
+        fprintf(stderr, "%s: no readable records\n", argv[1]);
+        return 1;
+    }
+
+    // Repeat small inputs so the timings are measurable
+    int rounds = total < 1000000 ? (int)(1000000 / total) + 1 : 1;
+    std::vector<uint8_t> blocks;
+    std::map<uint8_t, size_t> channelBlocks;
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; round++) {
+        blocks.clear();
+        for (auto& channel : series) {
+            uint8_t block[GORILLA_BLOCK_SIZE];
+            GorillaEncoder encoder;
+            encoder.begin(block, channel.first);
+            for (const LogEntry& entry : channel.second) {
+                if (!encoder.add(entry.timeMs, entry.value, entry.flags)) {
+                    encoder.finish();
+                    blocks.insert(blocks.end(), block, block + GORILLA_BLOCK_SIZE);
+                    channelBlocks[channel.first] += round == 0;
+                    encoder.begin(block, channel.first);
+                    encoder.add(entry.timeMs, entry.value, entry.flags);
+                }
+            }
+            encoder.finish();
+            blocks.insert(blocks.end(), block, block + GORILLA_BLOCK_SIZE);
+            channelBlocks[channel.first] += round == 0;
+        }
+    }
+    double encodeSeconds = secondsSince(start) / rounds;
+
+    size_t decoded = 0;
+    bool mismatch = false;
+    start = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; round++) {
+        std::map<uint8_t, size_t> position;
+        decoded = 0;
+        for (size_t offset = 0; offset < blocks.size(); offset += GORILLA_BLOCK_SIZE) {
+            GorillaDecoder decoder;
+            if (!decoder.open(&blocks[offset])) {
+                mismatch = true;
+                break;
+            }
+            LogEntry entry;
+            while (decoder.next(entry)) {
+                const LogEntry& expected = series[entry.channel][position[entry.channel]++];
+                if (round == 0 && (expected.timeMs != entry.timeMs || memcmp(&expected.value, &entry.value, 4) != 0
+                        || expected.flags != entry.flags)) {
+                    mismatch = true;
+                }
+                decoded++;
+            }
+        }
+    }
+    double decodeSeconds = secondsSince(start) / rounds;
+
+    printf("samples          %zu in %zu channel(s)\n", total, series.size());
+    printf("raw log          %.2f bytes/sample\n", (double)RECORD_SIZE);
+    printf("gorilla blocks   %zu x %d bytes, %.2f bytes/sample, %.1fx smaller\n", blocks.size() / GORILLA_BLOCK_SIZE,
+        GORILLA_BLOCK_SIZE, (double)blocks.size() / total, (double)total * RECORD_SIZE / blocks.size());
+    for (auto& channel : series) {
+        printf("  channel %-3u    %zu samples, %.2f bytes/sample\n", channel.first, channel.second.size(),
+            (double)channelBlocks[channel.first] * GORILLA_BLOCK_SIZE / channel.second.size());
+    }
+    printf("encode           %.1f ns/sample\n", encodeSeconds * 1e9 / total);
+    printf("decode           %.1f ns/sample\n", decodeSeconds * 1e9 / total);
+    printf("round trip       %s\n", !mismatch && decoded == total ? "ok" : "MISMATCH");
+    return !mismatch && decoded == total ? 0 : 1;
+}
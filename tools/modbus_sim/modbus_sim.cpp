@@ -0,0 +1,306 @@
+/**
+ * @file modbus_sim.cpp
+ * @brief Host throughput test of the Modbus RTU master against a pty slave.
+ *
+ * A simulated slave thread answers read requests on the slave side of a
+ * pseudo terminal, holding each answer back for the time the request and
+ * response take on the wire at the chosen baud rate. The master side uses
+ * the same framing, span planning and parsing as modbus_meters.cpp: the
+ * register map is batched into spans, meters are polled round robin with
+ * the t3.5 gap between frames, and the exception-sized head of a response
+ * is read before the rest. Every Nth request the slave can be made to
+ * corrupt the checksum, answer from the wrong address or stay silent, to
+ * check that each failure ends up in the right counter.
+ *
+ * Build from the repository root:
+ *     g++ -std=c++11 -O2 -Iinclude tools/modbus_sim/modbus_sim.cpp src/modbus_rtu.cpp -o modbus_sim -lpthread
+ * Usage:
+ *     modbus_sim [baud] [seconds] [meters] [fault every N requests, 0 for none] [max gap]
+ */
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "modbus_rtu.h"
+
+#define SIM_FUNCTION MODBUS_READ_INPUT /**< Function code used by the meters. */
+#define SIM_TIMEOUT_MS 100 /**< MODBUS_RESPONSE_TIMEOUT_MS. */
+#define SIM_MAX_SPANS 8 /**< MAX_MODBUS_SPANS. */
+#define SIM_BITS_PER_BYTE 10 /**< 8N1. */
+
+/**
+ * @brief Register map of modbus_meters.cpp.
+ */
+static const ModbusPoint meterPoints[] = {
+    { "voltage", 0x0000, MODBUS_FLOAT32, 1.0f },
+    { "current", 0x0006, MODBUS_FLOAT32, 1.0f },
+    { "activePower", 0x000C, MODBUS_FLOAT32, 1.0f },
+    { "powerFactor", 0x001E, MODBUS_FLOAT32, 1.0f },
+    { "frequency", 0x0046, MODBUS_FLOAT32, 1.0f },
+    { "importEnergy", 0x0048, MODBUS_FLOAT32, 1000.0f },
+};
+static const size_t meterPointCount = sizeof(meterPoints) / sizeof(meterPoints[0]);
+
+/**
+ * @brief Failure the slave injects into a response.
+ */
+enum SimFault {
+    FAULT_CRC, /**< Flip a bit after the checksum was computed. */
+    FAULT_ADDRESS, /**< Answer with another slave address. */
+    FAULT_SILENT, /**< Do not answer at all. */
+    FAULT_COUNT
+};
+
+static std::atomic<bool> running(true);
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void sleepMicros(uint32_t micros) {
+    std::this_thread::sleep_for(std::chrono::microseconds(micros));
+}
+
+/**
+ * @brief Read up to length bytes, giving up after timeoutMs without data (Stream::readBytes).
+ */
+static size_t readBytes(int fd, uint8_t* buffer, size_t length, int timeoutMs) {
+    size_t got = 0;
+    while (got < length) {
+        struct pollfd ready = { fd, POLLIN, 0 };
+        if (poll(&ready, 1, timeoutMs) <= 0) {
+            break;
+        }
+        ssize_t n = read(fd, buffer + got, length - got);
+        if (n <= 0) {
+            break;
+        }
+        got += (size_t)n;
+    }
+    return got;
+}
+
+static void writeAll(int fd, const uint8_t* buffer, size_t length) {
+    while (length > 0) {
+        ssize_t n = write(fd, buffer, length);
+        if (n <= 0) {
+            return;
+        }
+        buffer += n;
+        length -= (size_t)n;
+    }
+}
+
+/**
+ * @brief Slave thread: answers read requests for addresses 1..meters.
+ *
+ * Register r holds the value r, so the master can check every register it
+ * receives.
+ */
+static void slaveTask(int fd, uint32_t baud, uint8_t meters, uint32_t faultEvery) {
+    uint8_t request[MODBUS_REQUEST_LENGTH];
+    uint8_t response[5 + 2 * MODBUS_MAX_READ_REGISTERS];
+    uint32_t requests = 0;
+    uint32_t faults = 0;
+    while (running) {
+        if (readBytes(fd, request, sizeof(request), 50) != sizeof(request)) {
+            continue;
+        }
+        uint16_t crc = modbusCrc16(request, 6);
+        if (request[6] != (crc & 0xFF) || request[7] != (crc >> 8) || request[0] == 0 || request[0] > meters) {
+            continue; // not addressed to a simulated meter
+        }
+        requests++;
+
+        uint16_t start = (uint16_t)(request[2] << 8 | request[3]);
+        uint16_t count = (uint16_t)(request[4] << 8 | request[5]);
+        size_t length;
+        response[0] = request[0];
+        if (request[1] != SIM_FUNCTION || count == 0 || count > MODBUS_MAX_READ_REGISTERS) {
+            response[1] = request[1] | 0x80;
+            response[2] = count == 0 || count > MODBUS_MAX_READ_REGISTERS ? 0x03 : 0x01;
+            length = 3;
+        } else {
+            response[1] = request[1];
+            response[2] = (uint8_t)(2 * count);
+            for (uint16_t i = 0; i < count; i++) {
+                response[3 + 2 * i] = (uint8_t)((start + i) >> 8);
+                response[4 + 2 * i] = (uint8_t)(start + i);
+            }
+            length = 3 + 2 * count;
+        }
+        crc = modbusCrc16(response, length);
+        response[length++] = crc & 0xFF;
+        response[length++] = crc >> 8;
+
+        if (faultEvery > 0 && requests % faultEvery == 0) {
+            switch (faults++ % FAULT_COUNT) {
+                case FAULT_CRC:
+                    response[length / 2] ^= 0x01;
+                    break;
+                case FAULT_ADDRESS:
+                    response[0] ^= 0x40; // checksum stays valid for the wrong address
+                    crc = modbusCrc16(response, length - 2);
+                    response[length - 2] = crc & 0xFF;
+                    response[length - 1] = crc >> 8;
+                    break;
+                case FAULT_SILENT:
+                    continue;
+            }
+        }
+
+        // Request and response on the wire, plus the gap before answering
+        size_t wireBytes = sizeof(request) + length;
+        sleepMicros((uint32_t)(wireBytes * SIM_BITS_PER_BYTE * 1000000ULL / baud) + modbusFrameGapMicros(baud));
+        writeAll(fd, response, length);
+    }
+}
+
+/**
+ * @brief Master counters, as kept per meter in modbus_meters.cpp.
+ */
+struct MasterStats {
+    uint32_t requests = 0; /**< Requests sent. */
+    uint32_t registersRead = 0; /**< Registers received in valid responses. */
+    uint32_t timeouts = 0; /**< Requests without a complete answer. */
+    uint32_t crcErrors = 0; /**< Responses with a bad checksum. */
+    uint32_t badFrames = 0; /**< Responses with a wrong address, function or length. */
+    uint32_t exceptions = 0; /**< Exception responses. */
+    uint32_t wrongValues = 0; /**< Registers that did not hold their own number. */
+};
+
+/**
+ * @brief One request and response, following ModbusMeters::readSpan().
+ */
+static void readSpan(int fd, uint8_t address, const ModbusSpan& span, uint32_t gapUs, MasterStats& stats) {
+    uint8_t request[MODBUS_REQUEST_LENGTH];
+    uint8_t response[5 + 2 * MODBUS_MAX_READ_REGISTERS];
+    uint16_t registers[MODBUS_MAX_READ_REGISTERS];
+    modbusBuildReadRequest(request, address, SIM_FUNCTION, span.start, span.count);
+
+    sleepMicros(gapUs);
+    tcflush(fd, TCIFLUSH); // late bytes from a previous timeout
+    writeAll(fd, request, sizeof(request));
+    stats.requests++;
+
+    size_t expected = modbusReadResponseLength(span.count);
+    size_t length = readBytes(fd, response, MODBUS_EXCEPTION_LENGTH, SIM_TIMEOUT_MS);
+    if (length == MODBUS_EXCEPTION_LENGTH && response[1] == SIM_FUNCTION) {
+        length += readBytes(fd, response + length, expected - length, SIM_TIMEOUT_MS);
+    }
+
+    uint8_t exceptionCode = 0;
+    switch (modbusParseReadResponse(response, length, address, SIM_FUNCTION, span.count, registers, &exceptionCode)) {
+        case MODBUS_OK:
+            stats.registersRead += span.count;
+            for (uint16_t i = 0; i < span.count; i++) {
+                stats.wrongValues += registers[i] != span.start + i;
+            }
+            break;
+        case MODBUS_CRC_ERROR:
+            stats.crcErrors++;
+            break;
+        case MODBUS_BAD_FRAME:
+            stats.badFrames++;
+            break;
+        case MODBUS_EXCEPTION:
+            stats.exceptions++;
+            break;
+        case MODBUS_TIMEOUT:
+            stats.timeouts++;
+            break;
+    }
+}
+
+/**
+ * @brief Open a pty pair in raw mode.
+ * @param slave Receives the slave side descriptor.
+ * @return Master side descriptor, -1 on failure.
+ */
+static int openPty(int& slave) {
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+        return -1;
+    }
+    slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+    if (slave < 0) {
+        return -1;
+    }
+    struct termios raw;
+    tcgetattr(slave, &raw);
+    cfmakeraw(&raw);
+    tcsetattr(slave, TCSANOW, &raw);
+    tcgetattr(master, &raw);
+    cfmakeraw(&raw);
+    tcsetattr(master, TCSANOW, &raw);
+    return master;
+}
+
+int main(int argc, char** argv) {
+    uint32_t baud = argc > 1 ? (uint32_t)atoi(argv[1]) : 9600;
+    int seconds = argc > 2 ? atoi(argv[2]) : 10;
+    int meters = argc > 3 ? atoi(argv[3]) : 3;
+    uint32_t faultEvery = argc > 4 ? (uint32_t)atoi(argv[4]) : 0;
+    uint16_t maxGap = argc > 5 ? (uint16_t)atoi(argv[5]) : 16;
+    if (baud == 0 || seconds <= 0 || meters <= 0 || meters > 247) {
+        fprintf(stderr, "usage: %s [baud] [seconds] [meters] [fault every N requests, 0 for none] [max gap]\n", argv[0]);
+        return 2;
+    }
+
+    int slave;
+    int master = openPty(slave);
+    if (master < 0) {
+        perror("pty");
+        return 1;
+    }
+
+    ModbusSpan spans[SIM_MAX_SPANS];
+    size_t spanCount = modbusPlanSpans(meterPoints, meterPointCount, maxGap, spans, SIM_MAX_SPANS);
+    uint32_t mapRegisters = 0;
+    for (size_t s = 0; s < spanCount; s++) {
+        mapRegisters += spans[s].count;
+    }
+    uint32_t gapUs = modbusFrameGapMicros(baud);
+    printf("%u baud, %d meter(s), %u request(s) of %u registers per meter, t3.5 %u us\n",
+           (unsigned)baud, meters, (unsigned)spanCount, (unsigned)mapRegisters, (unsigned)gapUs);
+
+    std::thread slaveThread(slaveTask, slave, baud, (uint8_t)meters, faultEvery);
+    MasterStats stats;
+    uint32_t rounds = 0;
+    auto started = std::chrono::steady_clock::now();
+    while (secondsSince(started) < seconds) {
+        for (int m = 1; m <= meters; m++) {
+            for (size_t s = 0; s < spanCount; s++) {
+                readSpan(master, (uint8_t)m, spans[s], gapUs, stats);
+            }
+        }
+        rounds++;
+    }
+    double elapsed = secondsSince(started);
+    running = false;
+    slaveThread.join();
+    close(master);
+    close(slave);
+
+    // Wire limit: every request and response at full speed with one gap before each frame
+    double frameSeconds = 0;
+    for (size_t s = 0; s < spanCount; s++) {
+        size_t bytes = MODBUS_REQUEST_LENGTH + modbusReadResponseLength(spans[s].count);
+        frameSeconds += bytes * SIM_BITS_PER_BYTE / (double)baud + 2 * gapUs / 1e6;
+    }
+    double rate = stats.registersRead / elapsed;
+    double wireLimit = mapRegisters / frameSeconds;
+    printf("%u rounds, %u requests in %.1f s\n", (unsigned)rounds, (unsigned)stats.requests, elapsed);
+    printf("registers/s: %.0f (wire limit %.0f, %.0f%%)\n", rate, wireLimit, rate * 100 / wireLimit);
+    printf("timeouts %u, crcErrors %u, badFrames %u, exceptions %u, wrong values %u\n",
+           (unsigned)stats.timeouts, (unsigned)stats.crcErrors, (unsigned)stats.badFrames,
+           (unsigned)stats.exceptions, (unsigned)stats.wrongValues);
+    return 0;
+}
@@ -0,0 +1,137 @@
+/**
+ * @file power_bench.cpp
+ * @brief Host benchmark of the power kernel on synthetic mains waveforms.
+ *
+ * Generates 12-bit voltage and current samples at the device's channel
+ * rate for a few load shapes, feeds them through PowerKernel in capture
+ * blocks, and reports the time and CPU cycles per sample together with
+ * the error of Vrms, Irms, real power and power factor against their
+ * analytic values. The device reports its own cycles per sample in the
+ * power section of /status.
+ *
+ * Build from the repository root:
+ *     g++ -std=c++11 -O2 -Iinclude tools/power_bench/power_bench.cpp src/power_kernel.cpp -o power_bench
+ * Usage:
+ *     power_bench [seconds per waveform]
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <random>
+#include <vector>
+#include "power_kernel.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define CHANNEL_RATE_HZ 10000 /**< POWER_CHANNEL_RATE_HZ with the default sample rate. */
+#define BLOCK_SAMPLES 512 /**< POWER_BLOCK_SAMPLES. */
+#define MAX_CYCLES_PER_BLOCK 16 /**< As in power_monitor.cpp. */
+#define SETTLE_SECONDS 2 /**< Cycles left out while the DC tracker settles. */
+#define ADC_BIAS 2048 /**< Bias of both channels in counts. */
+
+/**
+ * @brief One synthetic load.
+ */
+struct Waveform {
+    const char* name; /**< Label in the report. */
+    double mainsHz; /**< Mains frequency. */
+    double voltsPeak; /**< Voltage amplitude in counts. */
+    double ampsPeak; /**< Fundamental current amplitude in counts. */
+    double lagDegrees; /**< Phase lag of the current fundamental. */
+    double thirdHarmonic; /**< 3rd harmonic current relative to the fundamental, in phase. */
+    double noise; /**< Uniform noise amplitude in counts on both channels. */
+};
+
+static const Waveform waveforms[] = {
+    { "resistive 50 Hz", 50, 1500, 1000, 0, 0, 0 },
+    { "resistive 60 Hz", 60, 1500, 1000, 0, 0, 0 },
+    { "inductive 37 deg", 50, 1500, 1000, 37, 0, 0 },
+    { "3rd harmonic 30%", 50, 1500, 800, 0, 0.3, 0 },
+    { "noisy, light load", 50, 1500, 60, 20, 0, 8 },
+};
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static uint64_t cpuCycles() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static uint16_t toAdc(double value) {
+    long counts = lround(ADC_BIAS + value);
+    return (uint16_t)(counts < 0 ? 0 : counts > 4095 ? 4095 : counts);
+}
+
+static double relativeError(double measured, double expected) {
+    return expected != 0 ? (measured - expected) / expected * 100 : measured;
+}
+
+int main(int argc, char** argv) {
+    int seconds = argc > 1 ? atoi(argv[1]) : 30;
+    if (seconds <= SETTLE_SECONDS) {
+        fprintf(stderr, "usage: %s [seconds per waveform, > %d]\n", argv[0], SETTLE_SECONDS);
+        return 2;
+    }
+
+    printf("%-18s %8s %8s %9s %9s %9s %9s\n", "waveform", "ns/smp", "cyc/smp", "Vrms %", "Irms %", "P %", "PF diff");
+    std::mt19937 random(1);
+    for (const Waveform& wave : waveforms) {
+        size_t total = (size_t)seconds * CHANNEL_RATE_HZ;
+        total -= total % BLOCK_SAMPLES;
+        std::vector<uint16_t> voltage(total), current(total);
+        std::uniform_real_distribution<double> noise(-wave.noise, wave.noise);
+        double lag = wave.lagDegrees * M_PI / 180;
+        for (size_t n = 0; n < total; n++) {
+            double phase = 2 * M_PI * wave.mainsHz * n / CHANNEL_RATE_HZ;
+            double amps = wave.ampsPeak * (sin(phase - lag) + wave.thirdHarmonic * sin(3 * phase));
+            voltage[n] = toAdc(wave.voltsPeak * sin(phase) + noise(random));
+            current[n] = toAdc(amps + noise(random));
+        }
+
+        PowerKernel kernel(CHANNEL_RATE_HZ / 70, CHANNEL_RATE_HZ / 20);
+        PowerWindow window;
+        PowerCycle cycles[MAX_CYCLES_PER_BLOCK];
+        size_t settle = (size_t)SETTLE_SECONDS * CHANNEL_RATE_HZ;
+        double spent = 0;
+        uint64_t spentCycles = 0;
+        for (size_t offset = 0; offset < total; offset += BLOCK_SAMPLES) {
+            auto started = std::chrono::steady_clock::now();
+            uint64_t startCycles = cpuCycles();
+            size_t count = kernel.process(&voltage[offset], &current[offset], BLOCK_SAMPLES, cycles, MAX_CYCLES_PER_BLOCK);
+            spentCycles += cpuCycles() - startCycles;
+            spent += secondsSince(started);
+            for (size_t c = 0; offset >= settle && c < count; c++) {
+                window.add(cycles[c]);
+            }
+        }
+
+        // Q4 RMS and Q8 power back to counts
+        double vRms = window.samples ? sqrt((double)window.sumV2 / window.samples) / 16 : 0;
+        double iRms = window.samples ? sqrt((double)window.sumI2 / window.samples) / 16 : 0;
+        double power = window.samples ? (double)window.sumP / window.samples / 256 : 0;
+        double pf = vRms * iRms > 0 ? power / (vRms * iRms) : 0;
+
+        double expectedV = wave.voltsPeak / sqrt(2.0);
+        double expectedI = wave.ampsPeak / sqrt(2.0) * sqrt(1 + wave.thirdHarmonic * wave.thirdHarmonic);
+        double expectedP = wave.voltsPeak * wave.ampsPeak / 2 * cos(lag);
+        // Noise adds its own RMS, 1/sqrt(3) of the amplitude for uniform noise
+        expectedV = sqrt(expectedV * expectedV + wave.noise * wave.noise / 3);
+        expectedI = sqrt(expectedI * expectedI + wave.noise * wave.noise / 3);
+        double expectedPf = expectedP / (expectedV * expectedI);
+
+        double nanos = spent * 1e9 / total;
+        double perSample = (double)spentCycles / total;
+        printf("%-18s %8.2f %8.1f %9.3f %9.3f %9.3f %9.4f\n", wave.name, nanos, perSample,
+               relativeError(vRms, expectedV), relativeError(iRms, expectedI),
+               relativeError(power, expectedP), pf - expectedPf);
+    }
+    return 0;
+}
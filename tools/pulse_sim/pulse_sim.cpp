@@ -0,0 +1,172 @@
+/**
+ * @file pulse_sim.cpp
+ * @brief Host simulation of the pulse input at increasing pulse rates.
+ *
+ * Drives the real PulseRing and PulseMeter with synthetic pulse trains in
+ * simulated time: the interrupt counts and pushes every pulse, the loop
+ * drains the ring every drain interval and each record closes a meter
+ * window, as on the device. For every rate the energy and power are
+ * checked against the exact values and the ring drops are counted, which
+ * gives the highest pulse rate the ring size and drain interval sustain.
+ * The time per pulse of the ring and meter code on the host is measured
+ * as well. Simulated time starts just before the 32-bit microsecond
+ * counter wraps. The interrupt latency of the chip is not modelled; it
+ * caps the real rate at a few hundred kHz.
+ *
+ * Build from the repository root:
+ *     g++ -std=c++11 -O2 -Iinclude tools/pulse_sim/pulse_sim.cpp src/pulse_meter.cpp -o pulse_sim
+ * Usage:
+ *     pulse_sim [drain interval ms] [record interval s] [imp/kWh]
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <memory>
+#include "pulse_meter.h"
+#include "pulse_ring.h"
+
+#ifndef PULSE_RING_SIZE
+#define PULSE_RING_SIZE 1024 /**< Same default as pulse_input.h. */
+#endif
+
+#define SIM_RECORDS 20 /**< Record windows simulated per rate. */
+
+typedef PulseRing<uint32_t, PULSE_RING_SIZE> Ring;
+
+/**
+ * @brief Outcome of one simulated pulse rate.
+ */
+struct SimResult {
+    uint64_t pulses; /**< Pulses generated. */
+    uint32_t dropped; /**< Timestamps lost because the ring was full. */
+    size_t maxDepth; /**< Deepest ring seen before a drain. */
+    double energyError; /**< Relative error of the accumulated energy. */
+    double powerError; /**< Relative error of the last window's mean power. */
+    double peakW; /**< Peak power of the last window. */
+};
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * @brief Run SIM_RECORDS record windows at a fixed pulse rate.
+ */
+static SimResult simulate(double rateHz, uint32_t drainUs, uint32_t recordUs, float pulsesPerKWh) {
+    std::unique_ptr<Ring> ring(new Ring()); // too large for the stack with big ring sizes
+
+    PulseMeter meter(pulsesPerKWh);
+    PulseSnapshot counters = { 0, 0 };
+    uint32_t start = 0xFFFFFFFFu - 5000000u;
+    meter.reset(counters);
+
+    SimResult result = {};
+    double periodUs = 1e6 / rateHz;
+    double nextPulse = periodUs;
+    uint64_t elapsed = 0;
+    uint64_t nextDrain = drainUs;
+    uint64_t nextRecord = recordUs;
+    uint64_t end = (uint64_t)recordUs * SIM_RECORDS;
+
+    while (elapsed < end) {
+        // Advance to the next event: a pulse, a drain or a record
+        uint64_t pulseAt = (uint64_t)nextPulse;
+        uint64_t eventAt = pulseAt < nextDrain ? pulseAt : nextDrain;
+        elapsed = eventAt < nextRecord ? eventAt : nextRecord;
+        uint32_t now = start + (uint32_t)elapsed;
+
+        if (elapsed == pulseAt) {
+            counters.total++;
+            counters.lastPulseUs = now;
+            if (!ring->push(now)) {
+                result.dropped++;
+            }
+            result.pulses++;
+            nextPulse += periodUs;
+        }
+        if (elapsed == nextDrain || elapsed == nextRecord) {
+            if (ring->size() > result.maxDepth) {
+                result.maxDepth = ring->size();
+            }
+            uint32_t timestamp;
+            while (ring->pop(timestamp)) {
+                meter.consume(timestamp);
+            }
+            if (elapsed == nextDrain) {
+                nextDrain += drainUs;
+            }
+        }
+        if (elapsed == nextRecord) {
+            meter.account(counters, now);
+            nextRecord += recordUs;
+        }
+    }
+
+    double expectedWh = result.pulses * 1000.0 / pulsesPerKWh;
+    double expectedW = rateHz * 3600.0 * 1000.0 / pulsesPerKWh;
+    result.energyError = expectedWh > 0 ? fabs(meter.energyWh() - expectedWh) / expectedWh : 0;
+    result.powerError = fabs(meter.powerW() - expectedW) / expectedW;
+    result.peakW = meter.peakPowerW();
+    return result;
+}
+
+/**
+ * @brief Host time per pulse of push, pop and consume.
+ */
+static double nanosPerPulse(float pulsesPerKWh) {
+    static Ring ring;
+    PulseMeter meter(pulsesPerKWh);
+    const uint32_t rounds = 20000;
+    uint32_t now = 0;
+    auto started = std::chrono::steady_clock::now();
+    for (uint32_t r = 0; r < rounds; r++) {
+        for (size_t i = 0; i < Ring::capacity; i++) {
+            ring.push(now);
+            now += 37;
+        }
+        uint32_t timestamp;
+        while (ring.pop(timestamp)) {
+            meter.consume(timestamp);
+        }
+    }
+    double seconds = secondsSince(started);
+    if (meter.instantPowerW() < 0) {
+        printf("unexpected power\n"); // keeps the loop from being optimised away
+    }
+    return seconds * 1e9 / ((double)rounds * Ring::capacity);
+}
+
+int main(int argc, char** argv) {
+    uint32_t drainMs = argc > 1 ? (uint32_t)atoi(argv[1]) : 10;
+    uint32_t recordS = argc > 2 ? (uint32_t)atoi(argv[2]) : 3;
+    float pulsesPerKWh = argc > 3 ? (float)atof(argv[3]) : 1000.0f;
+    if (drainMs == 0 || recordS == 0 || pulsesPerKWh <= 0) {
+        fprintf(stderr, "usage: %s [drain interval ms] [record interval s] [imp/kWh]\n", argv[0]);
+        return 2;
+    }
+
+    printf("Ring %u slots, drained every %u ms, records every %u s, %.0f imp/kWh\n",
+           (unsigned)Ring::capacity, (unsigned)drainMs, (unsigned)recordS, pulsesPerKWh);
+    printf("%10s %12s %10s %8s %10s %10s %12s\n", "rate Hz", "pulses", "dropped", "depth", "energy %", "power %", "peak W");
+
+    static const double rates[] = { 1, 10, 100, 1e3, 1e4, 5e4, 1e5, 2e5, 5e5, 1e6 };
+    double sustained = 0;
+    for (double rate : rates) {
+        SimResult result = simulate(rate, drainMs * 1000, recordS * 1000000, pulsesPerKWh);
+        printf("%10.0f %12llu %10u %8u %10.4f %10.4f %12.0f\n", rate, (unsigned long long)result.pulses,
+               (unsigned)result.dropped, (unsigned)result.maxDepth, result.energyError * 100,
+               result.powerError * 100, result.peakW);
+        if (result.dropped == 0 && result.energyError < 1e-6) {
+            sustained = rate;
+        }
+    }
+
+    // The ring holds one drain interval of pulses
+    double limit = Ring::capacity * 1000.0 / drainMs;
+    printf("Highest simulated rate without drops: %.0f Hz (ring limit %.0f Hz)\n", sustained, limit);
+    double nanos = nanosPerPulse(pulsesPerKWh);
+    printf("Host push + pop + consume: %.1f ns per pulse\n", nanos);
+    return 0;
+}